@@ -0,0 +1,289 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+#ifdef __linux__
+#include <dirent.h>
+#endif
+
+#include <subevent/subevent.hpp>
+
+SEV_USING_NS
+
+// usage: happy_eyeballs_test
+//
+// TcpClient::connect() to names with several addresses (from a stub
+// name service): a listener on 127.0.0.1, a "blackhole" on 127.0.0.2
+// (a listener with a full backlog, SYNs are dropped) and an unroutable
+// address. a dead first address must cost one attempt delay (250 ms),
+// not the connect timeout, and the losing attempts must be closed
+// (counted in /proc/self/fd on linux). the exit code is 1 on a failure.
+
+typedef std::chrono::steady_clock Clock;
+
+static const uint16_t Port = 9000;
+
+static const char* const Listener = "127.0.0.1";
+static const char* const Blackhole = "127.0.0.2";
+static const char* const Unroutable = "192.0.2.1";
+
+static std::list<IpEndPoint> lookup(
+    const std::string& node, const AddressFamily&, const Socket::Type&)
+{
+    std::list<IpEndPoint> endPoints;
+
+    if (node == "fallback.test")
+    {
+        endPoints.push_back(IpEndPoint(Blackhole, 0));
+        endPoints.push_back(IpEndPoint(Listener, 0));
+    }
+    else if (node == "unroutable.test")
+    {
+        endPoints.push_back(IpEndPoint(Unroutable, 0));
+        endPoints.push_back(IpEndPoint(Listener, 0));
+    }
+    else if (node == "first.test")
+    {
+        endPoints.push_back(IpEndPoint(Listener, 0));
+        endPoints.push_back(IpEndPoint(Blackhole, 0));
+    }
+    else if (node == "dead.test")
+    {
+        endPoints.push_back(IpEndPoint(Blackhole, 0));
+        endPoints.push_back(IpEndPoint(Unroutable, 0));
+    }
+
+    return endPoints;
+}
+
+// open files, -1 if unknown
+static int32_t countFiles()
+{
+#ifdef __linux__
+    DIR* dir = opendir("/proc/self/fd");
+    if (dir == nullptr)
+    {
+        return -1;
+    }
+
+    int32_t count = 0;
+    while (readdir(dir) != nullptr)
+    {
+        ++count;
+    }
+
+    closedir(dir);
+
+    return count;
+#else
+    return -1;
+#endif
+}
+
+static uint64_t elapsedMsec(Clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        Clock::now() - start).count();
+}
+
+//---------------------------------------------------------------------------//
+// EyeballsTest
+//---------------------------------------------------------------------------//
+
+class EyeballsTest
+{
+public:
+    EyeballsTest(NetWorker* netWorker)
+        : mNetWorker(netWorker), mCaseIndex(0), mFailures(0), mFiles(-1)
+    {
+        mCases.push_back([this]() { testFallback(); });
+        mCases.push_back([this]() { testUnroutable(); });
+        mCases.push_back([this]() { testFirst(); });
+        mCases.push_back([this]() { testDead(); });
+    }
+
+    void start()
+    {
+        mCaseIndex = 0;
+        mCases[0]();
+    }
+
+    size_t getFailures() const
+    {
+        return mFailures;
+    }
+
+private:
+    typedef std::function<bool(int32_t errorCode, uint64_t msec)> Expect;
+
+    void check(bool ok, const std::string& what, uint64_t msec)
+    {
+        std::cout << (ok ? "OK " : "FAIL ") << what
+            << " " << msec << "ms" << std::endl;
+
+        if (!ok)
+        {
+            ++mFailures;
+        }
+    }
+
+    void next()
+    {
+        // the handler returns before the next case
+        mNetWorker->postTask([this]() {
+            if (++mCaseIndex == mCases.size())
+            {
+                Application::getCurrent()->stop();
+                return;
+            }
+
+            mCases[mCaseIndex]();
+        });
+    }
+
+    void connect(const std::string& name,
+        uint32_t msecTimeout, const Expect& expect)
+    {
+        Clock::time_point start = Clock::now();
+
+        if (mCaseIndex == 0)
+        {
+            mFiles = countFiles();
+        }
+
+        mClient = TcpClient::newInstance(mNetWorker);
+        mClient->connect(name, Port,
+            [this, name, start, expect](
+                const TcpClientPtr& client, int32_t errorCode) {
+
+            uint64_t msec = elapsedMsec(start);
+
+            bool ok = expect(errorCode, msec) && ((errorCode != 0) ||
+                (client->getPeerEndPoint().getAddress() == Listener));
+
+            client->close();
+
+            // the server side closes too, then no socket is left
+            mTimer.start(100, false, [this, name, msec, ok](Timer*) {
+                check(ok && (countFiles() == mFiles), name, msec);
+                next();
+            });
+        }, msecTimeout);
+    }
+
+    // the second address after the attempt delay
+    void testFallback()
+    {
+        connect("fallback.test", 10 * 1000,
+            [](int32_t errorCode, uint64_t msec) {
+            return (errorCode == 0) && (msec >= 250) && (msec < 1000);
+        });
+    }
+
+    // fails at once or is overtaken after the delay
+    void testUnroutable()
+    {
+        connect("unroutable.test", 10 * 1000,
+            [](int32_t errorCode, uint64_t msec) {
+            return (errorCode == 0) && (msec < 1000);
+        });
+    }
+
+    // the first address answers, the second is never tried
+    void testFirst()
+    {
+        connect("first.test", 10 * 1000,
+            [](int32_t errorCode, uint64_t msec) {
+            return (errorCode == 0) && (msec < 250);
+        });
+    }
+
+    // every attempt is closed on the timeout
+    void testDead()
+    {
+        connect("dead.test", 600,
+            [](int32_t errorCode, uint64_t msec) {
+            return (errorCode == -5102) && (msec >= 600) && (msec < 1500);
+        });
+    }
+
+    NetWorker* mNetWorker;
+
+    std::vector<std::function<void()>> mCases;
+    size_t mCaseIndex;
+    size_t mFailures;
+
+    TcpClientPtr mClient;
+    Timer mTimer;
+    int32_t mFiles;
+};
+
+//---------------------------------------------------------------------------//
+// Main
+//---------------------------------------------------------------------------//
+
+SEV_IMPL_GLOBAL
+
+int main(int, char**)
+{
+    Resolver::getInstance().setLookupHandler(lookup);
+
+    NetApplication app;
+
+    // a listener that takes one connection and drops the rest
+    Socket blackhole;
+    Socket backlog;
+
+    if (!blackhole.create(AddressFamily::Ipv4,
+            Socket::Type::Tcp, Socket::Protocol::Tcp) ||
+        !blackhole.bind(IpEndPoint(Blackhole, Port)) ||
+        !blackhole.listen(0) ||
+        !backlog.create(AddressFamily::Ipv4,
+            Socket::Type::Tcp, Socket::Protocol::Tcp))
+    {
+        std::cout << "blackhole error" << std::endl;
+        return 1;
+    }
+
+    backlog.connect(IpEndPoint(Blackhole, Port));
+
+    TcpServerPtr server = TcpServer::newInstance(&app);
+    server->getSocketOption().setReuseAddress(true);
+
+    std::list<TcpChannelPtr> channelList;
+
+    if (!server->open(IpEndPoint(Listener, Port),
+        [&app, &channelList](
+            const TcpServerPtr& server, const TcpChannelPtr& newChannel) {
+
+        if (server->accept(&app, newChannel))
+        {
+            channelList.push_back(newChannel);
+
+            newChannel->setCloseHandler(
+                [&channelList](const TcpChannelPtr& channel) {
+                channelList.remove(channel);
+            });
+        }
+    }))
+    {
+        std::cout << "open error" << std::endl;
+        return 1;
+    }
+
+    EyeballsTest test(&app);
+
+    app.post([&test]() {
+        test.start();
+    });
+
+    app.run();
+
+    server->close();
+
+    std::cout << ((test.getFailures() == 0) ? "OK" : "NG") << std::endl;
+
+    return (test.getFailures() == 0) ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include <subevent/subevent.hpp>
+#include <subevent/subevent_http.hpp>
+
+SEV_USING_NS
+
+// usage: http_chunked_benchmark [mbytes]
+//
+// decodes a chunked body of mbytes (default 256) with
+// HttpContentReceiver, read by read as it would come from a socket.
+// the body goes to a content handler that only counts it, so this is
+// the cost of the framing. every case is printed as one JSON line,
+// the exit code is 1 if a decoded body has the wrong size.
+
+typedef std::chrono::steady_clock Clock;
+
+struct Case
+{
+    size_t chunkSize;
+    size_t readSize;    // bytes per onReceive(), 0: all at once
+};
+
+static std::string makeWire(size_t chunkSize, size_t bodySize)
+{
+    std::string chunk(chunkSize, 'a');
+
+    char hex[32];
+    std::snprintf(hex, sizeof(hex), "%zx\r\n", chunkSize);
+
+    std::string wire;
+    wire.reserve(bodySize + (bodySize / chunkSize + 1) * 32);
+
+    for (size_t size = 0; size < bodySize; size += chunkSize)
+    {
+        wire += hex;
+        wire += chunk;
+        wire += "\r\n";
+    }
+
+    wire += "0\r\n\r\n";
+
+    return wire;
+}
+
+static bool run(const Case& benchCase,
+    const std::vector<char>& wire, size_t bodySize, double& seconds)
+{
+    HttpRequest message;
+    message.getHeader().set(
+        HttpHeaderField::TransferEncoding, "chunked");
+
+    HttpContentReceiver receiver;
+    receiver.init(message);
+
+    size_t total = 0;
+
+    // streamed, the body is not stored
+    receiver.setContentHandler([&total](const char*, size_t size) {
+        total += size;
+    });
+
+    size_t readSize = (benchCase.readSize != 0) ?
+        benchCase.readSize : wire.size();
+
+    // the reads are cut out of the wire beforehand
+    std::vector<std::vector<char>> reads;
+    for (size_t offset = 0; offset < wire.size(); offset += readSize)
+    {
+        size_t size = std::min(readSize, wire.size() - offset);
+        reads.emplace_back(
+            wire.begin() + offset, wire.begin() + offset + size);
+    }
+
+    Clock::time_point start = Clock::now();
+
+    for (const std::vector<char>& read : reads)
+    {
+        StringReader reader(read);
+
+        if (!receiver.onReceive(reader))
+        {
+            return false;
+        }
+    }
+
+    seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    return receiver.isCompleted() && (total == bodySize);
+}
+
+//---------------------------------------------------------------------------//
+// Main
+//---------------------------------------------------------------------------//
+
+SEV_IMPL_GLOBAL
+
+int main(int argc, char** argv)
+{
+    size_t mbytes = (argc > 1) ? std::atoi(argv[1]) : 256;
+    size_t bodySize = mbytes * 1024 * 1024;
+
+    size_t errors = 0;
+
+    for (size_t chunkSize : { 16, 256, 4096, 16384, 65536 })
+    {
+        std::string data = makeWire(chunkSize, bodySize);
+        std::vector<char> wire(data.begin(), data.end());
+
+        // exact multiple of the chunk size
+        size_t expected =
+            (bodySize + chunkSize - 1) / chunkSize * chunkSize;
+
+        for (size_t readSize : { 1460, 16384, 262144, 0 })
+        {
+            Case benchCase;
+            benchCase.chunkSize = chunkSize;
+            benchCase.readSize = readSize;
+
+            double seconds = 0;
+            bool ok = run(benchCase, wire, expected, seconds);
+
+            if (!ok)
+            {
+                ++errors;
+            }
+
+            if (seconds <= 0)
+            {
+                seconds = 1e-9;
+            }
+
+            std::ostringstream line;
+            line << "{\"chunk_size\":" << chunkSize
+                << ",\"read_size\":" << readSize
+                << ",\"mbytes\":" << (wire.size() / (1024.0 * 1024))
+                << ",\"ok\":" << (ok ? 1 : 0)
+                << ",\"seconds\":" << seconds
+                << ",\"mbytes_per_sec\":"
+                << (wire.size() / (1024.0 * 1024) / seconds)
+                << "}";
+
+            std::cout << line.str() << std::endl;
+        }
+    }
+
+    return (errors == 0) ? 0 : 1;
+}
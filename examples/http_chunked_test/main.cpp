@@ -0,0 +1,295 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+
+#include <subevent/subevent.hpp>
+#include <subevent/subevent_http.hpp>
+
+SEV_USING_NS
+
+// usage: http_chunked_test [iterations] [seed]
+//
+// feeds random chunked bodies to HttpContentReceiver split at random
+// points (down to one byte per read) and compares the decoded body.
+// malformed bodies must be rejected, corrupted ones must not crash.
+// failures are printed with the seed to replay them, the exit code is 1.
+
+typedef std::mt19937 Random32;
+
+static size_t gFailures = 0;
+
+static void fail(const std::string& what, uint32_t seed, size_t iteration)
+{
+    std::cout << "FAIL " << what << " seed=" << seed
+        << " iteration=" << iteration << std::endl;
+    ++gFailures;
+}
+
+//---------------------------------------------------------------------------//
+// Wire
+//---------------------------------------------------------------------------//
+
+struct Wire
+{
+    std::string body;
+    std::string data;
+};
+
+static Wire makeWire(Random32& random)
+{
+    Wire wire;
+
+    size_t chunks = random() % 12;
+
+    for (size_t index = 0; index < chunks; ++index)
+    {
+        size_t size = 1 + random() % ((random() % 8 == 0) ? 70000 : 300);
+
+        std::string chunk(size, '\0');
+        for (char& c : chunk)
+        {
+            c = static_cast<char>(random());
+        }
+
+        wire.body += chunk;
+
+        // hex in either case, sometimes with leading zeros
+        char hex[32];
+        std::snprintf(hex, sizeof(hex),
+            (random() % 2) ? "%zx" : "%zX", size);
+
+        size_t zeros = ((random() % 3) == 0) ? (random() % 20) : 0;
+
+        wire.data += std::string(zeros, '0');
+        wire.data += hex;
+
+        if (random() % 4 == 0)
+        {
+            wire.data += ";name=value";
+        }
+
+        wire.data += "\r\n" + chunk + "\r\n";
+    }
+
+    wire.data += std::string(random() % 4, '0');
+    wire.data += "0\r\n";
+
+    if (random() % 2)
+    {
+        wire.data += "X-Trailer: a\r\nY: b\r\n";
+    }
+
+    wire.data += "\r\n";
+
+    return wire;
+}
+
+//---------------------------------------------------------------------------//
+// Feed
+//---------------------------------------------------------------------------//
+
+enum class FeedResult
+{
+    Completed,
+    Incomplete,
+    Error
+};
+
+// maxRead 0: all at once
+static FeedResult feed(const std::string& data,
+    Random32& random, size_t maxRead,
+    std::string& body, size_t& consumed)
+{
+    HttpRequest message;
+    message.getHeader().set(
+        HttpHeaderField::TransferEncoding, "chunked");
+
+    HttpContentReceiver receiver;
+
+    if (!receiver.init(message))
+    {
+        return FeedResult::Error;
+    }
+
+    consumed = 0;
+
+    while ((consumed < data.size()) && !receiver.isCompleted())
+    {
+        size_t size = data.size() - consumed;
+
+        if (maxRead != 0)
+        {
+            size = std::min<size_t>(size, 1 + random() % maxRead);
+        }
+
+        std::vector<char> buffer(
+            data.begin() + consumed, data.begin() + consumed + size);
+        StringReader reader(buffer);
+
+        if (!receiver.onReceive(reader))
+        {
+            return FeedResult::Error;
+        }
+
+        consumed += reader.getCur();
+
+        // all but what follows the body is taken
+        if ((reader.getCur() != size) && !receiver.isCompleted())
+        {
+            return FeedResult::Error;
+        }
+    }
+
+    if (!receiver.isCompleted())
+    {
+        return FeedResult::Incomplete;
+    }
+
+    std::vector<char> decoded = receiver.getData();
+    body.assign(decoded.begin(), decoded.end());
+
+    return FeedResult::Completed;
+}
+
+//---------------------------------------------------------------------------//
+// Cases
+//---------------------------------------------------------------------------//
+
+static void testRandom(uint32_t seed, size_t iterations)
+{
+    Random32 random(seed);
+
+    for (size_t iteration = 0; iteration < iterations; ++iteration)
+    {
+        Wire wire = makeWire(random);
+
+        // the next message follows the body
+        std::string data = wire.data + "NEXT";
+
+        for (size_t maxRead : { 1, 7, 64, 4096, 0 })
+        {
+            std::string body;
+            size_t consumed;
+
+            FeedResult result = feed(data, random, maxRead, body, consumed);
+
+            if (result != FeedResult::Completed)
+            {
+                fail("random not completed", seed, iteration);
+                return;
+            }
+
+            if ((body != wire.body) || (data.substr(consumed) != "NEXT"))
+            {
+                fail("random body differs", seed, iteration);
+                return;
+            }
+        }
+    }
+}
+
+static void testCorrupted(uint32_t seed, size_t iterations)
+{
+    Random32 random(seed);
+
+    for (size_t iteration = 0; iteration < iterations; ++iteration)
+    {
+        Wire wire = makeWire(random);
+
+        std::string data = wire.data;
+
+        for (size_t count = 1 + random() % 4; count > 0; --count)
+        {
+            data[random() % data.size()] = static_cast<char>(random());
+        }
+
+        // any result, no crash and nothing past the input
+        std::string body;
+        size_t consumed;
+
+        feed(data, random, 1 + random() % 32, body, consumed);
+
+        if (consumed > data.size())
+        {
+            fail("corrupted overrun", seed, iteration);
+            return;
+        }
+    }
+}
+
+static void testFixed()
+{
+    struct Fixed
+    {
+        const char* data;
+        FeedResult expected;
+        const char* body;
+    };
+
+    const Fixed cases[] = {
+        { "5\r\nhello\r\n0\r\n\r\n", FeedResult::Completed, "hello" },
+        { "5;a=b\r\nhello\r\n0\r\nX: y\r\n\r\n",
+            FeedResult::Completed, "hello" },
+        // leading zeros are not size digits
+        { "000000000000000005\r\nhello\r\n0\r\n\r\n",
+            FeedResult::Completed, "hello" },
+        { "00000000000000000000000000000000\r\n\r\n",
+            FeedResult::Completed, "" },
+        { "5\r\nhel", FeedResult::Incomplete, "" },
+        { "zz\r\n", FeedResult::Error, "" },
+        { "\r\n", FeedResult::Error, "" },
+        { "5\r\nhelloXX", FeedResult::Error, "" },
+        { "5\n", FeedResult::Error, "" },
+        // more significant digits than size_t
+        { (sizeof(size_t) == 8) ?
+            "10000000000000000\r\n" : "100000000\r\n",
+            FeedResult::Error, "" },
+    };
+
+    Random32 random(0);
+
+    for (const Fixed& fixed : cases)
+    {
+        for (size_t maxRead : { 1, 0 })
+        {
+            std::string body;
+            size_t consumed;
+
+            FeedResult result =
+                feed(fixed.data, random, maxRead, body, consumed);
+
+            if ((result != fixed.expected) ||
+                ((result == FeedResult::Completed) && (body != fixed.body)))
+            {
+                fail(std::string("fixed \"") + fixed.data + "\"", 0, 0);
+            }
+        }
+    }
+}
+
+//---------------------------------------------------------------------------//
+// Main
+//---------------------------------------------------------------------------//
+
+SEV_IMPL_GLOBAL
+
+int main(int argc, char** argv)
+{
+    size_t iterations = (argc > 1) ? std::atoi(argv[1]) : 1000;
+    uint32_t seed = (argc > 2) ?
+        static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) :
+        std::random_device()();
+
+    testFixed();
+    testRandom(seed, iterations);
+    testCorrupted(seed, iterations);
+
+    std::cout << ((gFailures == 0) ? "OK" : "NG")
+        << " seed=" << seed
+        << " iterations=" << iterations << std::endl;
+
+    return (gFailures == 0) ? 0 : 1;
+}
@@ -0,0 +1,290 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <algorithm>
+
+#include <subevent/subevent.hpp>
+#include <subevent/subevent_http.hpp>
+
+SEV_USING_NS
+
+// usage: http_client_pool_benchmark [requests] [concurrency]
+//
+// small GET requests on loopback, `concurrency` in flight, sent
+// through an HttpClientPool (maxConnectionsPerOrigin = concurrency)
+// and with a new HttpClient (and connection) per request. every case
+// is printed as one JSON line with the connections the server has
+// accepted, the exit code is 1 if a response was wrong or missing.
+
+typedef std::chrono::steady_clock Clock;
+
+static const std::string ResponseBody = "hello";
+
+// counted on the server thread, reset between the cases
+static std::atomic<size_t> gAccepted(0);
+
+//---------------------------------------------------------------------------//
+// HelloThread
+//---------------------------------------------------------------------------//
+
+class HelloThread : public HttpChannelThread
+{
+public:
+    HelloThread(Thread* parent)
+        : HttpChannelThread(parent)
+    {
+        setRequestHandler("/", [](const HttpChannelPtr& channel) {
+            channel->sendHttpResponse(
+                HttpStatusCode::Ok, "OK", ResponseBody);
+        });
+    }
+
+protected:
+    void onAccept(const TcpChannelPtr&) override
+    {
+        ++gAccepted;
+    }
+};
+
+//---------------------------------------------------------------------------//
+// Benchmark
+//---------------------------------------------------------------------------//
+
+class Benchmark
+{
+public:
+    Benchmark(NetWorker* netWorker, const std::string& url,
+        size_t requests, size_t concurrency)
+        : mNetWorker(netWorker), mUrl(url),
+          mRequests(requests), mConcurrency(concurrency),
+          mCaseIndex(0), mSent(0), mDone(0), mCaseErrors(0), mErrors(0)
+    {
+        mRequest.setMethod(HttpMethod::Get);
+    }
+
+    void start()
+    {
+        mCaseIndex = 0;
+        startCase();
+    }
+
+    size_t getErrors() const
+    {
+        return mErrors;
+    }
+
+private:
+    bool isPoolCase() const
+    {
+        return (mCaseIndex == 0);
+    }
+
+    void startCase()
+    {
+        if (mCaseIndex == 2)
+        {
+            Application::getCurrent()->stop();
+            return;
+        }
+
+        mSent = 0;
+        mDone = 0;
+        mCaseErrors = 0;
+        mLatencies.clear();
+        mLatencies.reserve(mRequests);
+        gAccepted = 0;
+
+        if (isPoolCase())
+        {
+            HttpClientPool::Option option;
+            option.maxConnectionsPerOrigin = mConcurrency;
+
+            mPool = HttpClientPool::newInstance(mNetWorker, option);
+        }
+
+        mStart = Clock::now();
+
+        while ((mSent < mRequests) && (mSent - mDone < mConcurrency))
+        {
+            sendNext();
+        }
+    }
+
+    void sendNext()
+    {
+        ++mSent;
+
+        Clock::time_point sendTime = Clock::now();
+
+        HttpResponseHandler handler =
+            [this, sendTime](const HttpClientPtr& httpClient, int errorCode) {
+            onResponse(httpClient, errorCode, sendTime);
+        };
+
+        bool result;
+
+        if (isPoolCase())
+        {
+            result = mPool->request(mUrl, mRequest, handler);
+        }
+        else
+        {
+            HttpClientPtr httpClient = HttpClient::newInstance(mNetWorker);
+            httpClient->getRequest() = mRequest;
+
+            result = httpClient->request(mUrl, handler);
+        }
+
+        if (!result)
+        {
+            onResponse(nullptr, -1, sendTime);
+        }
+    }
+
+    void onResponse(const HttpClientPtr& httpClient, int errorCode,
+        Clock::time_point sendTime)
+    {
+        Clock::time_point now = Clock::now();
+
+        mLatencies.push_back(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                now - sendTime).count()));
+
+        if ((errorCode != 0) || (httpClient == nullptr) ||
+            (httpClient->getResponse().getBodyAsString() != ResponseBody))
+        {
+            ++mCaseErrors;
+        }
+
+        if ((httpClient != nullptr) && !isPoolCase())
+        {
+            // one connection per request
+            httpClient->close();
+        }
+
+        if (++mDone == mRequests)
+        {
+            endCase(now);
+            return;
+        }
+
+        if (mSent < mRequests)
+        {
+            sendNext();
+        }
+    }
+
+    void endCase(Clock::time_point end)
+    {
+        double seconds =
+            std::chrono::duration<double>(end - mStart).count();
+
+        if (seconds <= 0)
+        {
+            seconds = 1e-9;
+        }
+
+        std::sort(mLatencies.begin(), mLatencies.end());
+
+        std::ostringstream line;
+        line << "{\"case\":\"" << (isPoolCase() ? "pool" : "per_request")
+            << "\",\"requests\":" << mDone
+            << ",\"concurrency\":" << mConcurrency
+            << ",\"errors\":" << mCaseErrors
+            << ",\"connections\":" << gAccepted
+            << ",\"seconds\":" << seconds
+            << ",\"requests_per_sec\":" << (mDone / seconds)
+            << ",\"p50_us\":" << percentile(0.50)
+            << ",\"p99_us\":" << percentile(0.99)
+            << ",\"max_us\":" << percentile(1.0)
+            << "}";
+
+        std::cout << line.str() << std::endl;
+
+        mErrors += mCaseErrors;
+
+        if (isPoolCase())
+        {
+            mPool->close();
+            mPool.reset();
+        }
+
+        ++mCaseIndex;
+
+        // the handler returns before the next case
+        mNetWorker->postTask([this]() {
+            startCase();
+        });
+    }
+
+    double percentile(double rank) const
+    {
+        if (mLatencies.empty())
+        {
+            return 0;
+        }
+
+        size_t index = static_cast<size_t>(rank * (mLatencies.size() - 1));
+
+        return mLatencies[index] / 1000.0;
+    }
+
+    NetWorker* mNetWorker;
+    std::string mUrl;
+    HttpRequest mRequest;
+    size_t mRequests;
+    size_t mConcurrency;
+
+    size_t mCaseIndex;
+    HttpClientPoolPtr mPool;
+
+    size_t mSent;
+    size_t mDone;
+    size_t mCaseErrors;
+    size_t mErrors;
+
+    Clock::time_point mStart;
+    std::vector<uint64_t> mLatencies;
+};
+
+//---------------------------------------------------------------------------//
+// Main
+//---------------------------------------------------------------------------//
+
+SEV_IMPL_GLOBAL
+
+int main(int argc, char** argv)
+{
+    size_t requests = (argc > 1) ? std::atoi(argv[1]) : 10000;
+    size_t concurrency = (argc > 2) ? std::atoi(argv[2]) : 4;
+
+    HttpServerApp app;
+    app.getTcpServer()->getSocketOption().setReuseAddress(true);
+
+    app.createThread<HelloThread>(1);
+
+    uint16_t port = 9000;
+
+    if (!app.open(IpEndPoint(port)))
+    {
+        std::cout << "open error" << std::endl;
+        return 1;
+    }
+
+    std::ostringstream url;
+    url << "http://127.0.0.1:" << port << "/";
+
+    Benchmark benchmark(&app, url.str(), requests, concurrency);
+
+    app.post([&benchmark]() {
+        benchmark.start();
+    });
+
+    app.run();
+
+    return (benchmark.getErrors() == 0) ? 0 : 1;
+}
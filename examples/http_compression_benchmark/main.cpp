@@ -0,0 +1,376 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+
+#include <sys/resource.h>
+
+#include <subevent/subevent.hpp>
+#include <subevent/subevent_http.hpp>
+
+SEV_USING_NS
+
+// usage: http_compression_benchmark [requests] [level]
+//
+// a server thread with response compression and a client on loopback,
+// one request at a time on a kept-alive connection. each payload is
+// fetched as is (identity) and gzip compressed (decoded by the client).
+// every case is printed as one JSON line with the body bytes on the
+// wire and the CPU time per request of the server (serialize and
+// compress) and of the client thread (receive and inflate). the exit
+// code is 1 if a decoded body differs.
+
+typedef std::chrono::steady_clock Clock;
+
+#ifndef SEV_SUPPORTS_ZLIB
+#error "zlib is required"
+#endif
+
+//---------------------------------------------------------------------------//
+// Payload
+//---------------------------------------------------------------------------//
+
+struct Payload
+{
+    std::string path;
+    std::string contentType;
+    std::string body;
+};
+
+static std::vector<Payload> makePayloads()
+{
+    std::mt19937 random(1);
+    std::vector<Payload> payloads;
+
+    // an API response
+    Payload json;
+    json.path = "/json";
+    json.contentType = "application/json";
+    json.body = "[";
+
+    for (int index = 0; index < 500; ++index)
+    {
+        char item[256];
+        std::snprintf(item, sizeof(item),
+            "%s{\"id\":%d,\"name\":\"item-%u\",\"price\":%u.%02u,"
+            "\"tags\":[\"a\",\"b\"],\"stock\":%u}",
+            (index == 0) ? "" : ",", index,
+            static_cast<unsigned>(random() % 100000),
+            static_cast<unsigned>(random() % 1000),
+            static_cast<unsigned>(random() % 100),
+            static_cast<unsigned>(random() % 50));
+        json.body += item;
+    }
+
+    json.body += "]";
+    payloads.push_back(json);
+
+    // a page
+    Payload html;
+    html.path = "/html";
+    html.contentType = "text/html";
+    html.body = "<html><body><table>";
+
+    for (int index = 0; index < 400; ++index)
+    {
+        html.body += "<tr><td class=\"name\">row " +
+            std::to_string(index) + "</td><td class=\"value\">" +
+            std::to_string(random() % 1000000) + "</td></tr>";
+    }
+
+    html.body += "</table></body></html>";
+    payloads.push_back(html);
+
+    // random text, compresses little
+    Payload noise;
+    noise.path = "/noise";
+    noise.contentType = "text/plain";
+    noise.body.resize(32 * 1024);
+
+    for (char& c : noise.body)
+    {
+        c = static_cast<char>(' ' + random() % 95);
+    }
+
+    payloads.push_back(noise);
+
+    return payloads;
+}
+
+// createThread() passes the parent only
+static std::vector<Payload> gPayloads;
+static int gLevel = Z_DEFAULT_COMPRESSION;
+
+// per case, reset by the client between the cases
+static std::atomic<uint64_t> gWireBytes(0);
+static std::atomic<uint64_t> gServerNsec(0);
+static std::atomic<size_t> gServed(0);
+
+static uint64_t getThreadCpuNsec()
+{
+    struct rusage usage;
+
+#ifdef RUSAGE_THREAD
+    getrusage(RUSAGE_THREAD, &usage);
+#else
+    getrusage(RUSAGE_SELF, &usage);
+#endif
+
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) *
+        1000000000ULL +
+        (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000ULL;
+}
+
+//---------------------------------------------------------------------------//
+// PayloadThread
+//---------------------------------------------------------------------------//
+
+class PayloadThread : public HttpChannelThread
+{
+public:
+    PayloadThread(Thread* parent)
+        : HttpChannelThread(parent)
+    {
+        HttpCompressionOption option;
+        option.level = gLevel;
+
+        enableCompression(option);
+
+        for (size_t index = 0; index < gPayloads.size(); ++index)
+        {
+            setRequestHandler(gPayloads[index].path,
+                [index](const HttpChannelPtr& channel) {
+                onPayload(channel, gPayloads[index]);
+            });
+        }
+    }
+
+protected:
+    static void onPayload(
+        const HttpChannelPtr& channel, const Payload& payload)
+    {
+        uint64_t start = getThreadCpuNsec();
+
+        HttpResponse response;
+        response.setStatusCode(HttpStatusCode::Ok);
+        response.setMessage("OK");
+        response.getHeader().set(
+            HttpHeaderField::ContentType, payload.contentType);
+        response.setBody(payload.body);
+
+        // compressed in place
+        channel->sendHttpResponse(response);
+
+        gWireBytes += response.getBody().size();
+        gServerNsec += getThreadCpuNsec() - start;
+        ++gServed;
+    }
+};
+
+//---------------------------------------------------------------------------//
+// Benchmark
+//---------------------------------------------------------------------------//
+
+class Benchmark
+{
+public:
+    Benchmark(NetWorker* netWorker, const std::string& url, size_t requests)
+        : mNetWorker(netWorker), mUrl(url), mRequests(requests),
+          mCaseIndex(0), mSent(0), mCaseErrors(0), mErrors(0)
+    {
+    }
+
+    void start()
+    {
+        for (size_t index = 0; index < gPayloads.size(); ++index)
+        {
+            for (bool gzip : { false, true })
+            {
+                mCases.push_back(std::make_pair(index, gzip));
+            }
+        }
+
+        mHttpClient = HttpClient::newInstance(mNetWorker);
+
+        mCaseIndex = 0;
+        startCase();
+    }
+
+    size_t getErrors() const
+    {
+        return mErrors;
+    }
+
+private:
+    void startCase()
+    {
+        if (mCaseIndex == mCases.size())
+        {
+            mHttpClient->close();
+            Application::getCurrent()->stop();
+            return;
+        }
+
+        mSent = 0;
+        mCaseErrors = 0;
+        gWireBytes = 0;
+        gServerNsec = 0;
+        gServed = 0;
+
+        mStart = Clock::now();
+        mStartCpu = getThreadCpuNsec();
+
+        sendNext();
+    }
+
+    void sendNext()
+    {
+        const Payload& payload = gPayloads[mCases[mCaseIndex].first];
+        bool gzip = mCases[mCaseIndex].second;
+
+        HttpClient::RequestOption option;
+        option.decompression = gzip;
+
+        HttpRequest& request = mHttpClient->getRequest();
+        request.clear();
+        request.setMethod(HttpMethod::Get);
+
+        ++mSent;
+
+        if (!mHttpClient->request(mUrl + payload.path,
+            SEV_BIND_2(this, Benchmark::onResponse), option))
+        {
+            ++mCaseErrors;
+            endCase();
+        }
+    }
+
+    void onResponse(const HttpClientPtr& httpClient, int errorCode)
+    {
+        const Payload& payload = gPayloads[mCases[mCaseIndex].first];
+        const HttpResponse& response = httpClient->getResponse();
+
+        // the header describes the decoded body
+        if ((errorCode != 0) ||
+            (response.getBody().size() != payload.body.size()) ||
+            (response.getBodyAsString() != payload.body) ||
+            response.getHeader().has(HttpHeaderField::ContentEncoding) ||
+            (response.getHeader().getContentLength() !=
+                payload.body.size()))
+        {
+            ++mCaseErrors;
+        }
+
+        if (mSent == mRequests)
+        {
+            endCase();
+            return;
+        }
+
+        sendNext();
+    }
+
+    void endCase()
+    {
+        double seconds =
+            std::chrono::duration<double>(Clock::now() - mStart).count();
+        uint64_t clientNsec = getThreadCpuNsec() - mStartCpu;
+
+        // the response can arrive before the server has counted it
+        while ((mCaseErrors == 0) && (gServed < mSent))
+        {
+            std::this_thread::yield();
+        }
+
+        if (seconds <= 0)
+        {
+            seconds = 1e-9;
+        }
+
+        const Payload& payload = gPayloads[mCases[mCaseIndex].first];
+        bool gzip = mCases[mCaseIndex].second;
+
+        std::ostringstream line;
+        line << "{\"payload\":\"" << payload.path.substr(1)
+            << "\",\"encoding\":\"" << (gzip ? "gzip" : "identity")
+            << "\",\"requests\":" << mSent
+            << ",\"errors\":" << mCaseErrors
+            << ",\"body_bytes\":" << payload.body.size()
+            << ",\"wire_bytes\":" << (gWireBytes / mSent)
+            << ",\"ratio\":"
+            << (static_cast<double>(gWireBytes) / mSent /
+                payload.body.size())
+            << ",\"server_cpu_us\":" << (gServerNsec / 1000.0 / mSent)
+            << ",\"client_cpu_us\":" << (clientNsec / 1000.0 / mSent)
+            << ",\"requests_per_sec\":" << (mSent / seconds)
+            << "}";
+
+        std::cout << line.str() << std::endl;
+
+        mErrors += mCaseErrors;
+
+        ++mCaseIndex;
+        startCase();
+    }
+
+    NetWorker* mNetWorker;
+    std::string mUrl;
+    size_t mRequests;
+
+    std::vector<std::pair<size_t, bool>> mCases;
+    size_t mCaseIndex;
+
+    HttpClientPtr mHttpClient;
+    size_t mSent;
+    size_t mCaseErrors;
+    size_t mErrors;
+
+    Clock::time_point mStart;
+    uint64_t mStartCpu;
+};
+
+//---------------------------------------------------------------------------//
+// Main
+//---------------------------------------------------------------------------//
+
+SEV_IMPL_GLOBAL
+
+int main(int argc, char** argv)
+{
+    size_t requests = (argc > 1) ? std::atoi(argv[1]) : 2000;
+    gLevel = (argc > 2) ? std::atoi(argv[2]) : Z_DEFAULT_COMPRESSION;
+
+    gPayloads = makePayloads();
+
+    HttpServerApp app;
+    app.getTcpServer()->getSocketOption().setReuseAddress(true);
+
+    app.createThread<PayloadThread>(1);
+
+    uint16_t port = 9000;
+
+    if (!app.open(IpEndPoint(port)))
+    {
+        std::cout << "open error" << std::endl;
+        return 1;
+    }
+
+    std::ostringstream url;
+    url << "http://127.0.0.1:" << port;
+
+    Benchmark benchmark(&app, url.str(), requests);
+
+    app.post([&benchmark]() {
+        benchmark.start();
+    });
+
+    app.run();
+
+    return (benchmark.getErrors() == 0) ? 0 : 1;
+}
@@ -0,0 +1,281 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <subevent/subevent.hpp>
+#include <subevent/subevent_http.hpp>
+
+SEV_USING_NS
+
+// usage: http_download_benchmark [mbytes] [directory] [repeat]
+//
+// a server thread sends a file (mbytes, default 1024) on loopback and
+// the client downloads it with RequestOption::outputFileName. the
+// "stream" case discards the body in a content handler, the ceiling
+// without the disk. every run is printed as one JSON line, the exit
+// code is 1 if a download failed or differs from the source.
+
+typedef std::chrono::steady_clock Clock;
+
+static const size_t BlockSize = 1024 * 1024;
+
+static void fillBlock(std::vector<char>& block, uint64_t blockIndex)
+{
+    for (size_t index = 0; index < block.size(); index += 8)
+    {
+        uint64_t value = (blockIndex << 32) + index;
+        memcpy(&block[index], &value, 8);
+    }
+}
+
+static bool createSource(const std::string& fileName, size_t mbytes)
+{
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    std::vector<char> block(BlockSize);
+
+    for (size_t index = 0; index < mbytes; ++index)
+    {
+        fillBlock(block, index);
+        file.write(block.data(), block.size());
+    }
+
+    return file.good();
+}
+
+static bool verify(const std::string& fileName, size_t mbytes)
+{
+    std::ifstream file(fileName, std::ios::binary);
+    std::vector<char> expected(BlockSize);
+    std::vector<char> block(BlockSize);
+
+    for (size_t index = 0; index < mbytes; ++index)
+    {
+        fillBlock(expected, index);
+
+        if (!file.read(block.data(), block.size()) ||
+            (memcmp(block.data(), expected.data(), block.size()) != 0))
+        {
+            return false;
+        }
+    }
+
+    // nothing after the last block
+    return (file.get() == EOF);
+}
+
+//---------------------------------------------------------------------------//
+// FileServerThread
+//---------------------------------------------------------------------------//
+
+// createThread() passes the parent only
+static std::string gSourceFileName;
+
+class FileServerThread : public HttpChannelThread
+{
+public:
+    FileServerThread(Thread* parent)
+        : HttpChannelThread(parent)
+    {
+        setRequestHandler("/", SEV_BIND_1(this, FileServerThread::onGet));
+    }
+
+protected:
+    void onGet(const HttpChannelPtr& channel)
+    {
+        HttpResponse response;
+        response.setStatusCode(HttpStatusCode::Ok);
+        response.setMessage("OK");
+
+        channel->sendHttpResponseFile(response, gSourceFileName);
+    }
+};
+
+//---------------------------------------------------------------------------//
+// Benchmark
+//---------------------------------------------------------------------------//
+
+class Benchmark
+{
+public:
+    Benchmark(NetWorker* netWorker, const std::string& url,
+        const std::string& outputFileName, size_t mbytes, size_t repeat)
+        : mNetWorker(netWorker), mUrl(url),
+          mOutputFileName(outputFileName), mMBytes(mbytes),
+          mRepeat(repeat), mRun(0), mStreamed(0), mErrors(0)
+    {
+    }
+
+    void start()
+    {
+        mRun = 0;
+        startRun();
+    }
+
+    size_t getErrors() const
+    {
+        return mErrors;
+    }
+
+private:
+    bool isStreamRun() const
+    {
+        // stream first, then file
+        return (mRun < mRepeat);
+    }
+
+    void startRun()
+    {
+        if (mRun == mRepeat * 2)
+        {
+            Application::getCurrent()->stop();
+            return;
+        }
+
+        std::remove(mOutputFileName.c_str());
+
+        HttpClient::RequestOption option;
+        option.timeout = 0;
+
+        mStreamed = 0;
+
+        if (isStreamRun())
+        {
+            option.contentHandler = [this](const char*, size_t size) {
+                mStreamed += size;
+            };
+        }
+        else
+        {
+            option.outputFileName = mOutputFileName;
+        }
+
+        mHttpClient = HttpClient::newInstance(mNetWorker);
+        mHttpClient->getRequest().setMethod(HttpMethod::Get);
+
+        mStart = Clock::now();
+
+        if (!mHttpClient->request(
+            mUrl, SEV_BIND_2(this, Benchmark::onResponse), option))
+        {
+            ++mErrors;
+            Application::getCurrent()->stop();
+        }
+    }
+
+    void onResponse(const HttpClientPtr& httpClient, int errorCode)
+    {
+        double seconds =
+            std::chrono::duration<double>(Clock::now() - mStart).count();
+
+        bool ok = (errorCode == 0) &&
+            (httpClient->getResponse().getStatusCode() ==
+                HttpStatusCode::Ok);
+
+        if (ok)
+        {
+            if (isStreamRun())
+            {
+                ok = (mStreamed == mMBytes * BlockSize);
+            }
+            else
+            {
+                // out of the timing
+                ok = verify(mOutputFileName, mMBytes);
+            }
+        }
+
+        if (!ok)
+        {
+            ++mErrors;
+        }
+
+        std::ostringstream line;
+        line << "{\"case\":\"" << (isStreamRun() ? "stream" : "file")
+            << "\",\"mbytes\":" << mMBytes
+            << ",\"error\":" << errorCode
+            << ",\"ok\":" << (ok ? 1 : 0)
+            << ",\"seconds\":" << seconds
+            << ",\"mbytes_per_sec\":" << (mMBytes / seconds)
+            << "}";
+
+        std::cout << line.str() << std::endl;
+
+        httpClient->close();
+
+        ++mRun;
+
+        mNetWorker->postTask([this]() {
+            mHttpClient.reset();
+            startRun();
+        });
+    }
+
+    NetWorker* mNetWorker;
+    std::string mUrl;
+    std::string mOutputFileName;
+    size_t mMBytes;
+    size_t mRepeat;
+
+    size_t mRun;
+    uint64_t mStreamed;
+    size_t mErrors;
+
+    HttpClientPtr mHttpClient;
+    Clock::time_point mStart;
+};
+
+//---------------------------------------------------------------------------//
+// Main
+//---------------------------------------------------------------------------//
+
+SEV_IMPL_GLOBAL
+
+int main(int argc, char** argv)
+{
+    size_t mbytes = (argc > 1) ? std::atoi(argv[1]) : 1024;
+    std::string directory = (argc > 2) ? argv[2] : ".";
+    size_t repeat = (argc > 3) ? std::atoi(argv[3]) : 3;
+
+    gSourceFileName = directory + "/download_source.bin";
+    std::string outputFileName = directory + "/download_output.bin";
+
+    if (!createSource(gSourceFileName, mbytes))
+    {
+        std::cout << "cannot create " << gSourceFileName << std::endl;
+        return 1;
+    }
+
+    HttpServerApp app;
+    app.getTcpServer()->getSocketOption().setReuseAddress(true);
+
+    app.createThread<FileServerThread>(1);
+
+    uint16_t port = 9000;
+
+    if (!app.open(IpEndPoint(port)))
+    {
+        std::cout << "open error" << std::endl;
+        return 1;
+    }
+
+    std::ostringstream url;
+    url << "http://127.0.0.1:" << port << "/";
+
+    Benchmark benchmark(&app, url.str(), outputFileName, mbytes, repeat);
+
+    app.post([&benchmark]() {
+        benchmark.start();
+    });
+
+    app.run();
+
+    std::remove(gSourceFileName.c_str());
+    std::remove(outputFileName.c_str());
+
+    return (benchmark.getErrors() == 0) ? 0 : 1;
+}
@@ -0,0 +1,265 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <cstdlib>
+
+#include <subevent/subevent.hpp>
+#include <subevent/subevent_http.hpp>
+
+SEV_USING_NS
+
+// usage: https_file_benchmark <cert> <key> <file> [repeat]
+//
+// a server thread sends file over https on loopback with
+// sendHttpResponseFile(), cert and key are PEM files, for example
+//   openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:P-256
+//     -nodes -days 1 -subj /CN=localhost -keyout key.pem -out cert.pem
+// the "https" case encrypts in user space, the "https_ktls" case
+// enables kernel TLS (SslContext::setKtls) so that the file can go
+// out with SSL_sendfile(). without the tls ULP in the kernel
+// ("kernel_tls":0) the second case falls back to user space. the
+// client discards the body in a content handler. every run is printed
+// as one JSON line, the exit code is 1 if a download failed.
+
+typedef std::chrono::steady_clock Clock;
+
+#ifndef SEV_SUPPORTS_SSL
+#error "OpenSSL is required"
+#endif
+
+// the tls ULP is registered (linux)
+static bool hasKernelTls()
+{
+    std::ifstream file("/proc/sys/net/ipv4/tcp_available_ulp");
+    std::string ulp;
+
+    while (file >> ulp)
+    {
+        if (ulp == "tls")
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+//---------------------------------------------------------------------------//
+// SendFileThread
+//---------------------------------------------------------------------------//
+
+// createThread() passes the parent only
+static std::string gSourceFileName;
+
+class SendFileThread : public HttpChannelThread
+{
+public:
+    SendFileThread(Thread* parent)
+        : HttpChannelThread(parent)
+    {
+        setRequestHandler("/", SEV_BIND_1(this, SendFileThread::onGet));
+    }
+
+protected:
+    void onGet(const HttpChannelPtr& channel)
+    {
+        HttpResponse response;
+        response.setStatusCode(HttpStatusCode::Ok);
+        response.setMessage("OK");
+
+        channel->sendHttpResponseFile(response, gSourceFileName);
+    }
+};
+
+//---------------------------------------------------------------------------//
+// Benchmark
+//---------------------------------------------------------------------------//
+
+class Benchmark
+{
+public:
+    Benchmark(NetWorker* netWorker, const std::string& url,
+        const SslContextPtr& serverSslCtx, uint64_t fileSize, size_t repeat)
+        : mNetWorker(netWorker), mUrl(url), mServerSslCtx(serverSslCtx),
+          mFileSize(fileSize), mRepeat(repeat), mRun(0), mStreamed(0),
+          mErrors(0)
+    {
+        mSslCtx = SslContext::newInstance(TLS_client_method());
+    }
+
+    void start()
+    {
+        mRun = 0;
+        startRun();
+    }
+
+    size_t getErrors() const
+    {
+        return mErrors;
+    }
+
+private:
+    bool isKtlsRun() const
+    {
+        // user space first, then kernel TLS
+        return (mRun >= mRepeat);
+    }
+
+    void startRun()
+    {
+        if (mRun == mRepeat * 2)
+        {
+            Application::getCurrent()->stop();
+            return;
+        }
+
+        // taken by the next connection, the server is idle now
+        if (!mServerSslCtx->setKtls(isKtlsRun()))
+        {
+            std::cout << "kernel TLS is not built in OpenSSL" << std::endl;
+            Application::getCurrent()->stop();
+            return;
+        }
+
+        HttpClient::RequestOption option;
+        option.timeout = 0;
+        option.sslCtx = mSslCtx;
+
+        mStreamed = 0;
+
+        option.contentHandler = [this](const char*, size_t size) {
+            mStreamed += size;
+        };
+
+        mHttpClient = HttpClient::newInstance(mNetWorker);
+        mHttpClient->getRequest().setMethod(HttpMethod::Get);
+
+        mStart = Clock::now();
+
+        if (!mHttpClient->request(
+            mUrl, SEV_BIND_2(this, Benchmark::onResponse), option))
+        {
+            ++mErrors;
+            Application::getCurrent()->stop();
+        }
+    }
+
+    void onResponse(const HttpClientPtr& httpClient, int errorCode)
+    {
+        double seconds =
+            std::chrono::duration<double>(Clock::now() - mStart).count();
+
+        bool ok = (errorCode == 0) &&
+            (httpClient->getResponse().getStatusCode() ==
+                HttpStatusCode::Ok) &&
+            (mStreamed == mFileSize);
+
+        if (!ok)
+        {
+            ++mErrors;
+        }
+
+        double mbytes = mFileSize / (1024.0 * 1024.0);
+
+        std::ostringstream line;
+        line << "{\"case\":\"" << (isKtlsRun() ? "https_ktls" : "https")
+            << "\",\"kernel_tls\":" << (hasKernelTls() ? 1 : 0)
+            << ",\"mbytes\":" << mbytes
+            << ",\"error\":" << errorCode
+            << ",\"ok\":" << (ok ? 1 : 0)
+            << ",\"seconds\":" << seconds
+            << ",\"mbytes_per_sec\":" << (mbytes / seconds)
+            << "}";
+
+        std::cout << line.str() << std::endl;
+
+        httpClient->close();
+
+        ++mRun;
+
+        mNetWorker->postTask([this]() {
+            mHttpClient.reset();
+            startRun();
+        });
+    }
+
+    NetWorker* mNetWorker;
+    std::string mUrl;
+    SslContextPtr mServerSslCtx;
+    SslContextPtr mSslCtx;
+    uint64_t mFileSize;
+    size_t mRepeat;
+
+    size_t mRun;
+    uint64_t mStreamed;
+    size_t mErrors;
+
+    HttpClientPtr mHttpClient;
+    Clock::time_point mStart;
+};
+
+//---------------------------------------------------------------------------//
+// Main
+//---------------------------------------------------------------------------//
+
+SEV_IMPL_GLOBAL
+
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::cout << "usage: https_file_benchmark <cert> <key> <file> "
+            "[repeat]" << std::endl;
+        return 1;
+    }
+
+    gSourceFileName = argv[3];
+    size_t repeat = (argc > 4) ? std::atoi(argv[4]) : 3;
+
+    std::ifstream file(gSourceFileName, std::ios::binary | std::ios::ate);
+
+    if (!file)
+    {
+        std::cout << "cannot open " << gSourceFileName << std::endl;
+        return 1;
+    }
+
+    uint64_t fileSize = file.tellg();
+    file.close();
+
+    SslContextPtr sslCtx = SslContext::newInstance(TLS_server_method());
+
+    if (!sslCtx->setCertificateFile(argv[1], SSL_FILETYPE_PEM) ||
+        !sslCtx->setPrivateKeyFile(argv[2], SSL_FILETYPE_PEM))
+    {
+        std::cout << "certificate error" << std::endl;
+        return 1;
+    }
+
+    HttpServerApp app;
+    app.getTcpServer()->getSocketOption().setReuseAddress(true);
+
+    app.createThread<SendFileThread>(1);
+
+    uint16_t port = 9000;
+
+    if (!app.open(IpEndPoint(port), sslCtx))
+    {
+        std::cout << "open error" << std::endl;
+        return 1;
+    }
+
+    std::ostringstream url;
+    url << "https://127.0.0.1:" << port << "/";
+
+    Benchmark benchmark(&app, url.str(), sslCtx, fileSize, repeat);
+
+    app.post([&benchmark]() {
+        benchmark.start();
+    });
+
+    app.run();
+
+    return (benchmark.getErrors() == 0) ? 0 : 1;
+}
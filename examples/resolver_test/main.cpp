@@ -0,0 +1,303 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+
+#include <subevent/subevent.hpp>
+
+SEV_USING_NS
+
+// usage: resolver_test
+//
+// TcpClient::connect() by name against a stub name service
+// (Resolver::setLookupHandler) and a listener on loopback: the cache,
+// a failed lookup, the connect timeout spent in a slow lookup, close()
+// while resolving, a thread deleted before its lookup completes and the
+// exit while a lookup never returns. the exit code is 1 on a failure.
+
+typedef std::chrono::steady_clock Clock;
+
+// per stub lookup
+static const uint32_t SlowMsec = 1000;
+
+static std::atomic<size_t> gLookups(0);
+
+static std::list<IpEndPoint> lookup(
+    const std::string& node, const AddressFamily&, const Socket::Type&)
+{
+    ++gLookups;
+
+    std::list<IpEndPoint> endPoints;
+
+    if (node == "block.test")
+    {
+        // a name server that does not answer
+        for (;;)
+        {
+            std::this_thread::sleep_for(std::chrono::seconds(60));
+        }
+    }
+
+    if (node.compare(0, 4, "slow") == 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(SlowMsec));
+    }
+
+    if (node != "fail.test")
+    {
+        endPoints.push_back(IpEndPoint("127.0.0.1", 0));
+    }
+
+    return endPoints;
+}
+
+static uint64_t elapsedMsec(Clock::time_point start)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        Clock::now() - start).count();
+}
+
+//---------------------------------------------------------------------------//
+// ResolverTest
+//---------------------------------------------------------------------------//
+
+class ResolverTest
+{
+public:
+    ResolverTest(NetWorker* netWorker, uint16_t port)
+        : mNetWorker(netWorker), mPort(port), mCaseIndex(0), mFailures(0)
+    {
+        mCases.push_back([this]() { testConnect(); });
+        mCases.push_back([this]() { testCached(); });
+        mCases.push_back([this]() { testFailed(); });
+        mCases.push_back([this]() { testTimeout(); });
+        mCases.push_back([this]() { testClose(); });
+        mCases.push_back([this]() { testThreadDeleted(); });
+        mCases.push_back([this]() { testBlocked(); });
+    }
+
+    void start()
+    {
+        mCaseIndex = 0;
+        mCases[0]();
+    }
+
+    size_t getFailures() const
+    {
+        return mFailures;
+    }
+
+private:
+    void check(bool ok, const std::string& what)
+    {
+        std::cout << (ok ? "OK " : "FAIL ") << what << std::endl;
+
+        if (!ok)
+        {
+            ++mFailures;
+        }
+    }
+
+    void next()
+    {
+        // the handler returns before the next case
+        mNetWorker->postTask([this]() {
+            if (++mCaseIndex == mCases.size())
+            {
+                Application::getCurrent()->stop();
+                return;
+            }
+
+            mCases[mCaseIndex]();
+        });
+    }
+
+    // resolved by the stub and connected
+    void testConnect()
+    {
+        mClient = TcpClient::newInstance(mNetWorker);
+        mClient->connect("local.test", mPort,
+            [this](const TcpClientPtr& client, int32_t errorCode) {
+
+            check((errorCode == 0) && (gLookups == 1) &&
+                (client->getPeerEndPoint().getPort() == mPort),
+                "connect");
+
+            client->close();
+            next();
+        });
+    }
+
+    // the same name again, from the cache
+    void testCached()
+    {
+        mClient = TcpClient::newInstance(mNetWorker);
+        mClient->connect("local.test", mPort,
+            [this](const TcpClientPtr& client, int32_t errorCode) {
+
+            check((errorCode == 0) && (gLookups == 1), "cached");
+
+            client->close();
+            next();
+        });
+    }
+
+    void testFailed()
+    {
+        mClient = TcpClient::newInstance(mNetWorker);
+        mClient->connect("fail.test", mPort,
+            [this](const TcpClientPtr&, int32_t errorCode) {
+
+            check(errorCode == -5110, "failed");
+            next();
+        });
+    }
+
+    // the timeout covers the lookup
+    void testTimeout()
+    {
+        Clock::time_point start = Clock::now();
+
+        mClient = TcpClient::newInstance(mNetWorker);
+        mClient->connect("slow-timeout.test", mPort,
+            [this, start](const TcpClientPtr&, int32_t errorCode) {
+
+            check((errorCode == -5102) && (elapsedMsec(start) < SlowMsec),
+                "timeout");
+
+            // the late result must not reach the client
+            mTimer.start(SlowMsec + 200, false, [this](Timer*) {
+                check(mClient->isClosed(), "timeout late result");
+                next();
+            });
+        }, 100);
+    }
+
+    // close() cancels the lookup, the client can connect again
+    void testClose()
+    {
+        mCalled = false;
+
+        mClient = TcpClient::newInstance(mNetWorker);
+        mClient->connect("slow-close.test", mPort,
+            [this](const TcpClientPtr&, int32_t) {
+            mCalled = true;
+        });
+
+        mClient->close();
+
+        mClient->connect("local.test", mPort,
+            [this](const TcpClientPtr& client, int32_t errorCode) {
+
+            check(errorCode == 0, "connect after close");
+            client->close();
+
+            mTimer.start(SlowMsec + 200, false, [this](Timer*) {
+                check(!mCalled, "close while resolving");
+                next();
+            });
+        });
+    }
+
+    // the result is dropped, not posted to a deleted thread
+    void testThreadDeleted()
+    {
+        NetThread* thread = new NetThread();
+        thread->start();
+
+        uint16_t port = mPort;
+
+        thread->post([port]() {
+            TcpClientPtr client =
+                TcpClient::newInstance(NetWorker::getCurrent());
+
+            client->connect("slow-thread.test", port,
+                [](const TcpClientPtr&, int32_t) {
+            });
+        });
+
+        mTimer.start(100, false, [this, thread](Timer*) {
+            thread->stop();
+            thread->wait();
+            delete thread;
+
+            mTimer.start(SlowMsec + 200, false, [this](Timer*) {
+                check(true, "thread deleted");
+                next();
+            });
+        });
+    }
+
+    // the process exits, the lookup thread stays blocked
+    void testBlocked()
+    {
+        mClient = TcpClient::newInstance(mNetWorker);
+        mClient->connect("block.test", mPort,
+            [this](const TcpClientPtr&, int32_t errorCode) {
+
+            check(errorCode == -5102, "blocked");
+            next();
+        }, 100);
+    }
+
+    NetWorker* mNetWorker;
+    uint16_t mPort;
+
+    std::vector<std::function<void()>> mCases;
+    size_t mCaseIndex;
+    size_t mFailures;
+
+    TcpClientPtr mClient;
+    Timer mTimer;
+    bool mCalled;
+};
+
+//---------------------------------------------------------------------------//
+// Main
+//---------------------------------------------------------------------------//
+
+SEV_IMPL_GLOBAL
+
+int main(int, char**)
+{
+    Resolver::getInstance().setLookupHandler(lookup);
+
+    NetApplication app;
+    TcpServerPtr server = TcpServer::newInstance(&app);
+    server->getSocketOption().setReuseAddress(true);
+
+    uint16_t port = 9000;
+
+    std::list<TcpChannelPtr> channelList;
+
+    if (!server->open(IpEndPoint(port),
+        [&app, &channelList](
+            const TcpServerPtr& server, const TcpChannelPtr& newChannel) {
+
+        if (server->accept(&app, newChannel))
+        {
+            channelList.push_back(newChannel);
+        }
+    }))
+    {
+        std::cout << "open error" << std::endl;
+        return 1;
+    }
+
+    ResolverTest test(&app, port);
+
+    app.post([&test]() {
+        test.start();
+    });
+
+    app.run();
+
+    server->close();
+
+    std::cout << ((test.getFailures() == 0) ? "OK" : "NG") << std::endl;
+
+    return (test.getFailures() == 0) ? 0 : 1;
+}
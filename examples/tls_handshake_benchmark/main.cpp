@@ -0,0 +1,301 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include <subevent/subevent.hpp>
+#include <subevent/subevent_http.hpp>
+
+SEV_USING_NS
+
+// usage: tls_handshake_benchmark [requests]
+//
+// https GET requests on loopback, one at a time and each on a new
+// connection, so every request is a TLS handshake. the server has a
+// self-signed certificate made at start and rotates its ticket keys.
+// the "full" cases disable the client session cache, the "resumed"
+// cases resume the session of the previous connection. every case is
+// printed as one JSON line with the handshakes the server resumed,
+// the exit code is 1 if a response was wrong or missing.
+
+typedef std::chrono::steady_clock Clock;
+
+#ifndef SEV_SUPPORTS_SSL
+#error "OpenSSL is required"
+#endif
+
+static const std::string ResponseBody = "hello";
+
+// a P-256 key and a certificate for localhost, valid for a day
+static bool setSelfSignedCertificate(const SslContextPtr& sslCtx)
+{
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* keyCtx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+
+    if ((keyCtx == nullptr) ||
+        (EVP_PKEY_keygen_init(keyCtx) <= 0) ||
+        (EVP_PKEY_CTX_set_ec_paramgen_curve_nid(
+            keyCtx, NID_X9_62_prime256v1) <= 0) ||
+        (EVP_PKEY_keygen(keyCtx, &key) <= 0))
+    {
+        EVP_PKEY_CTX_free(keyCtx);
+        return false;
+    }
+
+    EVP_PKEY_CTX_free(keyCtx);
+
+    X509* cert = X509_new();
+    X509_set_version(cert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 60 * 60);
+    X509_set_pubkey(cert, key);
+
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+        reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+
+    bool result =
+        (X509_sign(cert, key, EVP_sha256()) > 0) &&
+        (SSL_CTX_use_certificate(sslCtx->getHandle(), cert) == 1) &&
+        (SSL_CTX_use_PrivateKey(sslCtx->getHandle(), key) == 1);
+
+    X509_free(cert);
+    EVP_PKEY_free(key);
+
+    return result;
+}
+
+//---------------------------------------------------------------------------//
+// HelloThread
+//---------------------------------------------------------------------------//
+
+class HelloThread : public HttpChannelThread
+{
+public:
+    HelloThread(Thread* parent)
+        : HttpChannelThread(parent)
+    {
+        setRequestHandler("/", [](const HttpChannelPtr& channel) {
+            channel->sendHttpResponse(
+                HttpStatusCode::Ok, "OK", ResponseBody);
+        });
+    }
+};
+
+//---------------------------------------------------------------------------//
+// Benchmark
+//---------------------------------------------------------------------------//
+
+class Benchmark
+{
+public:
+    Benchmark(NetWorker* netWorker, const std::string& url,
+        const SslContextPtr& serverSslCtx, size_t requests)
+        : mNetWorker(netWorker), mUrl(url), mServerSslCtx(serverSslCtx),
+          mRequests(requests), mCaseIndex(0), mDone(0), mCaseErrors(0),
+          mErrors(0), mStartHits(0)
+    {
+    }
+
+    void start()
+    {
+        mCaseIndex = 0;
+        startCase();
+    }
+
+    size_t getErrors() const
+    {
+        return mErrors;
+    }
+
+private:
+    struct Case
+    {
+        const char* version;
+        int maxVersion;
+        bool resumed;
+    };
+
+    const Case& getCase() const
+    {
+        static const Case cases[] = {
+            { "tls1.2", TLS1_2_VERSION, false },
+            { "tls1.2", TLS1_2_VERSION, true },
+            { "tls1.3", TLS1_3_VERSION, false },
+            { "tls1.3", TLS1_3_VERSION, true },
+        };
+
+        return cases[mCaseIndex];
+    }
+
+    void startCase()
+    {
+        if (mCaseIndex == 4)
+        {
+            Application::getCurrent()->stop();
+            return;
+        }
+
+        mSslCtx = SslContext::newInstance(TLS_client_method());
+        SSL_CTX_set_max_proto_version(
+            mSslCtx->getHandle(), getCase().maxVersion);
+
+        if (!getCase().resumed)
+        {
+            mSslCtx->setSessionCacheSize(0);
+        }
+
+        mDone = 0;
+        mCaseErrors = 0;
+        mStartHits = SSL_CTX_sess_hits(mServerSslCtx->getHandle());
+
+        mStart = Clock::now();
+
+        sendNext();
+    }
+
+    void sendNext()
+    {
+        HttpClient::RequestOption option;
+        option.sslCtx = mSslCtx;
+        option.sockOption.setTcpNoDelay(true);
+
+        HttpClientPtr httpClient = HttpClient::newInstance(mNetWorker);
+        httpClient->getRequest().setMethod(HttpMethod::Get);
+
+        if (!httpClient->request(
+            mUrl, SEV_BIND_2(this, Benchmark::onResponse), option))
+        {
+            ++mCaseErrors;
+            endCase();
+        }
+    }
+
+    void onResponse(const HttpClientPtr& httpClient, int errorCode)
+    {
+        if ((errorCode != 0) ||
+            (httpClient->getResponse().getBodyAsString() != ResponseBody))
+        {
+            ++mCaseErrors;
+        }
+
+        // one handshake per request
+        httpClient->close();
+
+        if (++mDone == mRequests)
+        {
+            endCase();
+            return;
+        }
+
+        sendNext();
+    }
+
+    void endCase()
+    {
+        double seconds =
+            std::chrono::duration<double>(Clock::now() - mStart).count();
+
+        if (seconds <= 0)
+        {
+            seconds = 1e-9;
+        }
+
+        long resumed =
+            SSL_CTX_sess_hits(mServerSslCtx->getHandle()) - mStartHits;
+
+        // the first handshake of a resumed case is a full one
+        if (getCase().resumed && (resumed + 1 < static_cast<long>(mDone)))
+        {
+            ++mCaseErrors;
+        }
+
+        std::ostringstream line;
+        line << "{\"case\":\""
+            << (getCase().resumed ? "resumed" : "full")
+            << "\",\"version\":\"" << getCase().version
+            << "\",\"handshakes\":" << mDone
+            << ",\"resumed\":" << resumed
+            << ",\"errors\":" << mCaseErrors
+            << ",\"seconds\":" << seconds
+            << ",\"handshakes_per_sec\":" << (mDone / seconds)
+            << "}";
+
+        std::cout << line.str() << std::endl;
+
+        mErrors += mCaseErrors;
+
+        ++mCaseIndex;
+
+        // the handler returns before the next case
+        mNetWorker->postTask([this]() {
+            startCase();
+        });
+    }
+
+    NetWorker* mNetWorker;
+    std::string mUrl;
+    SslContextPtr mServerSslCtx;
+    size_t mRequests;
+
+    size_t mCaseIndex;
+    SslContextPtr mSslCtx;
+
+    size_t mDone;
+    size_t mCaseErrors;
+    size_t mErrors;
+    long mStartHits;
+
+    Clock::time_point mStart;
+};
+
+//---------------------------------------------------------------------------//
+// Main
+//---------------------------------------------------------------------------//
+
+SEV_IMPL_GLOBAL
+
+int main(int argc, char** argv)
+{
+    size_t requests = (argc > 1) ? std::atoi(argv[1]) : 1000;
+
+    SslContextPtr sslCtx = SslContext::newInstance(TLS_server_method());
+
+    if (!setSelfSignedCertificate(sslCtx) ||
+        !sslCtx->setTicketKeyRotation(3600))
+    {
+        std::cout << "certificate error" << std::endl;
+        return 1;
+    }
+
+    HttpServerApp app;
+    app.getTcpServer()->getSocketOption().setReuseAddress(true);
+    app.getTcpServer()->getSocketOption().setTcpNoDelay(true);
+
+    app.createThread<HelloThread>(1);
+
+    uint16_t port = 9000;
+
+    if (!app.open(IpEndPoint(port), sslCtx))
+    {
+        std::cout << "open error" << std::endl;
+        return 1;
+    }
+
+    std::ostringstream url;
+    url << "https://127.0.0.1:" << port << "/";
+
+    Benchmark benchmark(&app, url.str(), sslCtx, requests);
+
+    app.post([&benchmark]() {
+        benchmark.start();
+    });
+
+    app.run();
+
+    return (benchmark.getErrors() == 0) ? 0 : 1;
+}
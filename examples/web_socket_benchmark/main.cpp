@@ -0,0 +1,567 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#include <subevent/subevent.hpp>
+#include <subevent/subevent_http.hpp>
+
+SEV_USING_NS
+
+// usage: web_socket_benchmark [clients] [messages] [server threads]
+//
+// an echo server and client threads on loopback, each client thread
+// has one connection. every case is printed as one JSON line, the
+// exit code is 1 if any echo was wrong or missing.
+
+typedef std::chrono::steady_clock Clock;
+
+//---------------------------------------------------------------------------//
+// Case / Result
+//---------------------------------------------------------------------------//
+
+struct Case
+{
+    size_t size;
+    size_t fragments;
+    bool mask;
+    size_t window;      // messages in flight per connection
+    size_t messages;    // per connection
+};
+
+struct Result
+{
+    std::vector<uint64_t> latencies;    // nsec
+    size_t messages = 0;
+    size_t errors = 0;
+    Clock::time_point start;
+    Clock::time_point end;
+};
+
+static void fillPayload(std::vector<char>& payload, uint64_t seq)
+{
+    for (size_t index = 0; index < payload.size(); ++index)
+    {
+        payload[index] = static_cast<char>((seq + index) % 251);
+    }
+}
+
+//---------------------------------------------------------------------------//
+// EchoThread
+//---------------------------------------------------------------------------//
+
+class EchoThread : public HttpChannelThread
+{
+public:
+    EchoThread(Thread* parent)
+        : HttpChannelThread(parent)
+    {
+        setRequestHandler("/", SEV_BIND_1(this, EchoThread::onMyHandler));
+    }
+
+protected:
+    void onMyHandler(const HttpChannelPtr& channel)
+    {
+        if (!channel->getRequest().isWsHandshakeRequest())
+        {
+            channel->sendHttpResponse(
+                HttpStatusCode::BadRequest, "Bad Request");
+            channel->close();
+            return;
+        }
+
+        channel->sendWsHandshakeResponse();
+
+        // the echo of a fragmented message waits for no ACK
+        channel->getSocketOption().setTcpNoDelay(true);
+
+        WsChannelPtr wsChannel = channel->upgradeToWebSocket();
+        mChannelList.push_back(wsChannel);
+
+        // fragments are reassembled, the echo is one frame
+        wsChannel->setDataFrameHandler(
+            [](const WsChannelPtr& wsChannel, const WsFramePtr& frame) {
+            wsChannel->send(
+                frame->getPayloadData(), frame->getPayloadSize());
+        });
+
+        wsChannel->setCloseHandler(
+            SEV_BIND_1(this, EchoThread::onMyTcpClose));
+    }
+
+    void onMyTcpClose(const TcpChannelPtr& channel)
+    {
+        mChannelList.remove_if(
+            [&channel](const WsChannelPtr& ws) { return channel == ws; });
+    }
+
+    void onExit() override
+    {
+        for (WsChannelPtr& wsChannel : mChannelList)
+        {
+            wsChannel->close();
+        }
+        mChannelList.clear();
+
+        HttpChannelThread::onExit();
+    }
+
+private:
+    std::list<WsChannelPtr> mChannelList;
+};
+
+//---------------------------------------------------------------------------//
+// ClientThread
+//---------------------------------------------------------------------------//
+
+typedef std::function<void(Result&&)> ResultHandler;
+
+class ClientThread : public NetThread
+{
+public:
+    ClientThread(Thread* parent, const std::string& url,
+        const Case& benchCase, const ResultHandler& resultHandler)
+        : NetThread(parent),
+          mUrl(url), mCase(benchCase), mResultHandler(resultHandler),
+          mSent(0), mReceived(0), mPayload(benchCase.size)
+    {
+        mResult.latencies.reserve(benchCase.messages);
+    }
+
+protected:
+    bool onInit() override
+    {
+        if (!NetThread::onInit())
+        {
+            return false;
+        }
+
+        mHttpClient = HttpClient::newInstance(this);
+
+        // fragments are written one by one
+        HttpClient::RequestOption option;
+        option.sockOption.setTcpNoDelay(true);
+
+        if (!mHttpClient->requestWsHandshake(mUrl, "",
+            SEV_BIND_2(this, ClientThread::onHandshake), option))
+        {
+            ++mResult.errors;
+            finish();
+        }
+
+        return true;
+    }
+
+    void onHandshake(const HttpClientPtr& httpClient, int errorCode)
+    {
+        if ((errorCode != 0) || !httpClient->verifyWsHandshakeResponse())
+        {
+            ++mResult.errors;
+            finish();
+            return;
+        }
+
+        mWsChannel = httpClient->upgradeToWebSocket();
+
+        mWsChannel->setDataFrameHandler(
+            SEV_BIND_2(this, ClientThread::onEcho));
+        mWsChannel->setCloseHandler(
+            [this](const TcpChannelPtr&) {
+            if (mReceived < mCase.messages)
+            {
+                ++mResult.errors;
+            }
+            finish();
+        });
+
+        mResult.start = Clock::now();
+
+        while ((mSent < mCase.messages) &&
+            (mSent - mReceived < mCase.window))
+        {
+            sendNext();
+        }
+    }
+
+    void onEcho(const WsChannelPtr&, const WsFramePtr& frame)
+    {
+        Clock::time_point now = Clock::now();
+
+        mResult.latencies.push_back(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                now - mSendTimes.front()).count()));
+        mSendTimes.pop_front();
+
+        fillPayload(mPayload, mReceived);
+
+        if ((frame->getPayloadSize() != mPayload.size()) ||
+            (memcmp(frame->getPayloadData(),
+                mPayload.data(), mPayload.size()) != 0))
+        {
+            ++mResult.errors;
+        }
+
+        ++mReceived;
+
+        if (mReceived == mCase.messages)
+        {
+            mResult.end = now;
+            mResult.messages = mReceived;
+            mWsChannel->close();
+            finish();
+            return;
+        }
+
+        if (mSent < mCase.messages)
+        {
+            sendNext();
+        }
+    }
+
+    void sendNext()
+    {
+        fillPayload(mPayload, mSent);
+        mSendTimes.push_back(Clock::now());
+        ++mSent;
+
+        if (mCase.mask && (mCase.fragments == 1))
+        {
+            mWsChannel->send(mPayload);
+            return;
+        }
+
+        if (mCase.mask)
+        {
+            mWsChannel->beginMessage();
+
+            for (size_t index = 0; index < mCase.fragments; ++index)
+            {
+                size_t begin, end;
+                getFragment(index, begin, end);
+
+                if (index + 1 < mCase.fragments)
+                {
+                    mWsChannel->appendMessage(
+                        &mPayload[begin], end - begin);
+                }
+                else
+                {
+                    mWsChannel->endMessage(
+                        &mPayload[begin], end - begin);
+                }
+            }
+
+            return;
+        }
+
+        // unmasked client frames, accepted by this server,
+        // to see what masking costs
+        for (size_t index = 0; index < mCase.fragments; ++index)
+        {
+            size_t begin, end;
+            getFragment(index, begin, end);
+
+            WsFrame frame((index == 0) ?
+                WsFrame::OpCode::Binary : WsFrame::OpCode::Continuation,
+                false);
+            frame.setFin(index + 1 == mCase.fragments);
+            frame.setPayloadLength(end - begin);
+
+            mWsChannel->send(frame, &mPayload[begin]);
+        }
+    }
+
+    void getFragment(size_t index, size_t& begin, size_t& end) const
+    {
+        begin = mPayload.size() * index / mCase.fragments;
+        end = mPayload.size() * (index + 1) / mCase.fragments;
+    }
+
+    void finish()
+    {
+        if (mResultHandler == nullptr)
+        {
+            return;
+        }
+
+        if (mResult.messages == 0)
+        {
+            mResult.end = Clock::now();
+        }
+
+        ResultHandler resultHandler = mResultHandler;
+        mResultHandler = nullptr;
+
+        // the handler runs on the parent
+        Result* result = new Result(std::move(mResult));
+
+        getParent()->post([resultHandler, result]() {
+            resultHandler(std::move(*result));
+            delete result;
+        });
+
+        stop();
+    }
+
+    void onExit() override
+    {
+        mWsChannel.reset();
+        mHttpClient.reset();
+
+        NetThread::onExit();
+    }
+
+private:
+    std::string mUrl;
+    Case mCase;
+    ResultHandler mResultHandler;
+
+    HttpClientPtr mHttpClient;
+    WsChannelPtr mWsChannel;
+
+    size_t mSent;
+    size_t mReceived;
+    std::vector<char> mPayload;
+    std::deque<Clock::time_point> mSendTimes;
+
+    Result mResult;
+};
+
+//---------------------------------------------------------------------------//
+// Benchmark
+//---------------------------------------------------------------------------//
+
+class Benchmark
+{
+public:
+    Benchmark(Thread* parent, const std::string& url, size_t clients)
+        : mParent(parent), mUrl(url), mClients(clients),
+          mCaseIndex(0), mDone(0), mErrors(0)
+    {
+    }
+
+    void addCase(const Case& benchCase)
+    {
+        mCases.push_back(benchCase);
+    }
+
+    void start()
+    {
+        mCaseIndex = 0;
+        startCase();
+    }
+
+    size_t getErrors() const
+    {
+        return mErrors;
+    }
+
+private:
+    void startCase()
+    {
+        if (mCaseIndex == mCases.size())
+        {
+            Application::getCurrent()->stop();
+            return;
+        }
+
+        mDone = 0;
+        mTotal = Result();
+
+        for (size_t index = 0; index < mClients; ++index)
+        {
+            ClientThread* thread = new ClientThread(
+                mParent, mUrl, mCases[mCaseIndex],
+                SEV_BIND_1(this, Benchmark::onClientDone));
+
+            if (!thread->start())
+            {
+                delete thread;
+
+                ++mTotal.errors;
+                ++mDone;
+            }
+        }
+
+        if (mDone == mClients)
+        {
+            endCase();
+        }
+    }
+
+    void onClientDone(Result&& result)
+    {
+        if (mDone == 0)
+        {
+            mTotal.start = result.start;
+            mTotal.end = result.end;
+        }
+        else
+        {
+            mTotal.start = std::min(mTotal.start, result.start);
+            mTotal.end = std::max(mTotal.end, result.end);
+        }
+
+        mTotal.latencies.insert(mTotal.latencies.end(),
+            result.latencies.begin(), result.latencies.end());
+        mTotal.messages += result.messages;
+        mTotal.errors += result.errors;
+
+        if (++mDone == mClients)
+        {
+            endCase();
+        }
+    }
+
+    void endCase()
+    {
+        const Case& benchCase = mCases[mCaseIndex];
+
+        std::vector<uint64_t>& latencies = mTotal.latencies;
+        std::sort(latencies.begin(), latencies.end());
+
+        double seconds =
+            std::chrono::duration<double>(mTotal.end - mTotal.start).count();
+
+        if (seconds <= 0)
+        {
+            seconds = 1e-9;
+        }
+
+        // the fragments out and one frame back
+        double framesPerSec =
+            (benchCase.fragments + 1.0) * mTotal.messages / seconds;
+        double bytesPerSec =
+            2.0 * mTotal.messages * benchCase.size / seconds;
+
+        std::ostringstream line;
+        line << "{\"size\":" << benchCase.size
+            << ",\"fragments\":" << benchCase.fragments
+            << ",\"mask\":" << (benchCase.mask ? 1 : 0)
+            << ",\"window\":" << benchCase.window
+            << ",\"clients\":" << mClients
+            << ",\"messages\":" << mTotal.messages
+            << ",\"errors\":" << mTotal.errors
+            << ",\"seconds\":" << seconds
+            << ",\"messages_per_sec\":" << (mTotal.messages / seconds)
+            << ",\"frames_per_sec\":" << framesPerSec
+            << ",\"mbytes_per_sec\":" << (bytesPerSec / (1024 * 1024))
+            << ",\"p50_us\":" << percentile(latencies, 0.50)
+            << ",\"p90_us\":" << percentile(latencies, 0.90)
+            << ",\"p99_us\":" << percentile(latencies, 0.99)
+            << ",\"p999_us\":" << percentile(latencies, 0.999)
+            << ",\"max_us\":" << percentile(latencies, 1.0)
+            << "}";
+
+        std::cout << line.str() << std::endl;
+
+        // a case that lost a connection is an error too
+        if ((mTotal.errors != 0) ||
+            (mTotal.messages != benchCase.messages * mClients))
+        {
+            ++mErrors;
+        }
+
+        ++mCaseIndex;
+        startCase();
+    }
+
+    static double percentile(
+        const std::vector<uint64_t>& sorted, double rank)
+    {
+        if (sorted.empty())
+        {
+            return 0;
+        }
+
+        size_t index = static_cast<size_t>(rank * (sorted.size() - 1));
+
+        return sorted[index] / 1000.0;
+    }
+
+    Thread* mParent;
+    std::string mUrl;
+    size_t mClients;
+
+    std::vector<Case> mCases;
+    size_t mCaseIndex;
+
+    size_t mDone;
+    Result mTotal;
+    size_t mErrors;
+};
+
+//---------------------------------------------------------------------------//
+// Main
+//---------------------------------------------------------------------------//
+
+SEV_IMPL_GLOBAL
+
+int main(int argc, char** argv)
+{
+    size_t clients = (argc > 1) ? std::atoi(argv[1]) : 4;
+    size_t messages = (argc > 2) ? std::atoi(argv[2]) : 10000;
+    size_t serverThreads = (argc > 3) ? std::atoi(argv[3]) : 2;
+
+    HttpServerApp app;
+    app.getTcpServer()->getSocketOption().setReuseAddress(true);
+
+    app.createThread<EchoThread>(serverThreads);
+
+    uint16_t port = 9000;
+
+    if (!app.open(IpEndPoint(port)))
+    {
+        std::cout << "open error" << std::endl;
+        return 1;
+    }
+
+    std::ostringstream url;
+    url << "ws://127.0.0.1:" << port << "/";
+
+    Benchmark benchmark(&app, url.str(), clients);
+
+    const size_t sizes[] = { 16, 125, 1024, 16 * 1024, 256 * 1024 };
+
+    for (size_t size : sizes)
+    {
+        // about the same bytes for the large ones
+        size_t count = messages;
+
+        if (size > 1024)
+        {
+            count = std::max<size_t>(messages * 1024 / size, 100);
+        }
+
+        for (size_t fragments : { 1, 4 })
+        {
+            for (bool mask : { true, false })
+            {
+                // latency, then throughput
+                for (size_t window : { 1, 16 })
+                {
+                    Case benchCase;
+                    benchCase.size = size;
+                    benchCase.fragments = fragments;
+                    benchCase.mask = mask;
+                    benchCase.window = window;
+                    benchCase.messages = count;
+
+                    benchmark.addCase(benchCase);
+                }
+            }
+        }
+    }
+
+    app.post([&benchmark]() {
+        benchmark.start();
+    });
+
+    app.run();
+
+    return (benchmark.getErrors() == 0) ? 0 : 1;
+}
@@ -0,0 +1,444 @@
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+
+#include <subevent/subevent.hpp>
+#include <subevent/subevent_http.hpp>
+
+SEV_USING_NS
+
+// usage: ws_frame_benchmark [frames]
+//
+// small WebSocket text frames on loopback over one connection: the
+// "down" cases are sent by the server (unmasked), the "up" cases by
+// the client (masked). payloads up to 125 bytes take the small frame
+// path of WsChannel::send, 126 and 1024 the WsFrame one. each case
+// sends frames (default 500000) in batches and is printed as one JSON
+// line, the exit code is 1 if a frame was wrong or missing.
+
+typedef std::chrono::steady_clock Clock;
+
+// frames per turn of the loop, the last one waits for its write
+static const size_t BatchSize = 64;
+
+static void fillPayload(std::string& payload, size_t seq)
+{
+    payload[0] = static_cast<char>('a' + (seq % 26));
+}
+
+static bool checkFrame(const WsFramePtr& frame, size_t seq, size_t size)
+{
+    return (frame->getOpCode() == WsFrame::OpCode::Text) &&
+        (frame->getPayloadSize() == size) &&
+        (frame->getPayloadData()[0] ==
+            static_cast<char>('a' + (seq % 26)));
+}
+
+//---------------------------------------------------------------------------//
+// FrameSender
+//---------------------------------------------------------------------------//
+
+// sends frames one batch per write
+class FrameSender
+{
+public:
+    FrameSender()
+        : mFrames(0), mSent(0)
+    {
+    }
+
+    void start(const WsChannelPtr& channel, size_t frames, size_t size)
+    {
+        mChannel = channel;
+        mFrames = frames;
+        mSent = 0;
+        mPayload.assign(size, 'x');
+
+        sendBatch();
+    }
+
+private:
+    void sendBatch()
+    {
+        for (size_t count = 0; mSent < mFrames; ++count)
+        {
+            fillPayload(mPayload, mSent);
+            ++mSent;
+
+            if ((count + 1 < BatchSize) && (mSent < mFrames))
+            {
+                mChannel->send(mPayload);
+                continue;
+            }
+
+            if (mSent == mFrames)
+            {
+                mChannel->send(mPayload);
+                mChannel.reset();
+                return;
+            }
+
+            mChannel->send(mPayload,
+                [this](const TcpChannelPtr&, int32_t errorCode) {
+                if (errorCode == 0)
+                {
+                    sendBatch();
+                }
+            });
+
+            return;
+        }
+    }
+
+    WsChannelPtr mChannel;
+    size_t mFrames;
+    size_t mSent;
+    std::string mPayload;
+};
+
+//---------------------------------------------------------------------------//
+// FrameThread
+//---------------------------------------------------------------------------//
+
+// one client, commands: "down <frames> <size>" and "up <frames> <size>"
+class FrameThread : public HttpChannelThread
+{
+public:
+    FrameThread(Thread* parent)
+        : HttpChannelThread(parent),
+          mUpFrames(0), mUpSize(0), mReceived(0), mErrors(0)
+    {
+        setRequestHandler("/", SEV_BIND_1(this, FrameThread::onMyHandler));
+    }
+
+protected:
+    void onMyHandler(const HttpChannelPtr& channel)
+    {
+        if (!channel->getRequest().isWsHandshakeRequest())
+        {
+            channel->sendHttpResponse(
+                HttpStatusCode::BadRequest, "Bad Request");
+            channel->close();
+            return;
+        }
+
+        channel->sendWsHandshakeResponse();
+        channel->getSocketOption().setTcpNoDelay(true);
+
+        mWsChannel = channel->upgradeToWebSocket();
+
+        mWsChannel->setDataFrameHandler(
+            SEV_BIND_2(this, FrameThread::onFrame));
+
+        // the server closes the connection after the close frames
+        mWsChannel->setControlFrameHandler(
+            [](const WsChannelPtr& wsChannel, const WsFramePtr& frame) {
+            // the frame is released by onControlFrame()
+            bool closeFrame =
+                (frame->getOpCode() == WsFrame::OpCode::ConnectionClose);
+
+            wsChannel->onControlFrame(frame);
+
+            if (closeFrame)
+            {
+                wsChannel->getTcpChannel()->close();
+            }
+        });
+
+        mWsChannel->setCloseHandler([this](const TcpChannelPtr&) {
+            mWsChannel.reset();
+        });
+    }
+
+    void onFrame(const WsChannelPtr& channel, const WsFramePtr& frame)
+    {
+        if (mReceived < mUpFrames)
+        {
+            if (!checkFrame(frame, mReceived, mUpSize))
+            {
+                ++mErrors;
+            }
+
+            if (++mReceived == mUpFrames)
+            {
+                std::ostringstream done;
+                done << "done " << mErrors;
+
+                channel->send(done.str());
+            }
+
+            return;
+        }
+
+        std::istringstream command(std::string(
+            frame->getPayloadData(), frame->getPayloadSize()));
+
+        std::string direction;
+        size_t frames = 0;
+        size_t size = 0;
+        command >> direction >> frames >> size;
+
+        if (direction == "down")
+        {
+            mSender.start(channel, frames, size);
+        }
+        else
+        {
+            mUpFrames = frames;
+            mUpSize = size;
+            mReceived = 0;
+            mErrors = 0;
+        }
+    }
+
+    void onExit() override
+    {
+        if (mWsChannel != nullptr)
+        {
+            mWsChannel->close();
+            mWsChannel.reset();
+        }
+
+        HttpChannelThread::onExit();
+    }
+
+private:
+    WsChannelPtr mWsChannel;
+    FrameSender mSender;
+
+    size_t mUpFrames;
+    size_t mUpSize;
+    size_t mReceived;
+    size_t mErrors;
+};
+
+//---------------------------------------------------------------------------//
+// Benchmark
+//---------------------------------------------------------------------------//
+
+class Benchmark
+{
+public:
+    Benchmark(NetWorker* netWorker, const std::string& url, size_t frames)
+        : mNetWorker(netWorker), mUrl(url), mFrames(frames),
+          mCaseIndex(0), mReceived(0), mCaseErrors(0), mErrors(0)
+    {
+        for (size_t size : { 16, 64, 125, 126, 1024 })
+        {
+            for (bool down : { true, false })
+            {
+                Case benchCase;
+                benchCase.size = size;
+                benchCase.down = down;
+
+                mCases.push_back(benchCase);
+            }
+        }
+    }
+
+    void start()
+    {
+        mHttpClient = HttpClient::newInstance(mNetWorker);
+
+        HttpClient::RequestOption option;
+        option.sockOption.setTcpNoDelay(true);
+
+        if (!mHttpClient->requestWsHandshake(mUrl, "",
+            SEV_BIND_2(this, Benchmark::onHandshake), option))
+        {
+            ++mErrors;
+            Application::getCurrent()->stop();
+        }
+    }
+
+    size_t getErrors() const
+    {
+        return mErrors;
+    }
+
+private:
+    struct Case
+    {
+        size_t size;
+        bool down;
+    };
+
+    void onHandshake(const HttpClientPtr& httpClient, int errorCode)
+    {
+        if ((errorCode != 0) || !httpClient->verifyWsHandshakeResponse())
+        {
+            ++mErrors;
+            Application::getCurrent()->stop();
+            return;
+        }
+
+        mWsChannel = httpClient->upgradeToWebSocket();
+
+        mWsChannel->setDataFrameHandler(
+            SEV_BIND_2(this, Benchmark::onFrame));
+        mWsChannel->setCloseHandler([this](const TcpChannelPtr&) {
+            if (mCaseIndex < mCases.size())
+            {
+                ++mErrors;
+            }
+
+            Application::getCurrent()->stop();
+        });
+
+        mCaseIndex = 0;
+        startCase();
+    }
+
+    void startCase()
+    {
+        if (mCaseIndex == mCases.size())
+        {
+            // stops when the server has answered the close frame
+            mWsChannel->close();
+            return;
+        }
+
+        const Case& benchCase = mCases[mCaseIndex];
+
+        mReceived = 0;
+        mCaseErrors = 0;
+
+        std::ostringstream command;
+        command << (benchCase.down ? "down " : "up ")
+            << mFrames << " " << benchCase.size;
+
+        mStart = Clock::now();
+
+        mWsChannel->send(command.str());
+
+        if (!benchCase.down)
+        {
+            mSender.start(mWsChannel, mFrames, benchCase.size);
+        }
+    }
+
+    void onFrame(const WsChannelPtr&, const WsFramePtr& frame)
+    {
+        const Case& benchCase = mCases[mCaseIndex];
+
+        if (benchCase.down)
+        {
+            if (!checkFrame(frame, mReceived, benchCase.size))
+            {
+                ++mCaseErrors;
+            }
+
+            if (++mReceived == mFrames)
+            {
+                endCase();
+            }
+
+            return;
+        }
+
+        // "done <errors>" from the server
+        std::istringstream done(std::string(
+            frame->getPayloadData(), frame->getPayloadSize()));
+
+        std::string word;
+        size_t errors = 1;
+        done >> word >> errors;
+
+        mReceived = mFrames;
+        mCaseErrors += errors;
+
+        endCase();
+    }
+
+    void endCase()
+    {
+        const Case& benchCase = mCases[mCaseIndex];
+
+        double seconds =
+            std::chrono::duration<double>(Clock::now() - mStart).count();
+
+        if (seconds <= 0)
+        {
+            seconds = 1e-9;
+        }
+
+        std::ostringstream line;
+        line << "{\"direction\":\"" << (benchCase.down ? "down" : "up")
+            << "\",\"size\":" << benchCase.size
+            << ",\"frames\":" << mReceived
+            << ",\"errors\":" << mCaseErrors
+            << ",\"seconds\":" << seconds
+            << ",\"frames_per_sec\":" << (mReceived / seconds)
+            << ",\"mbytes_per_sec\":"
+            << (mReceived * benchCase.size / seconds / (1024 * 1024))
+            << "}";
+
+        std::cout << line.str() << std::endl;
+
+        mErrors += mCaseErrors;
+
+        ++mCaseIndex;
+
+        // the handler returns before the next case
+        mNetWorker->postTask([this]() {
+            startCase();
+        });
+    }
+
+    NetWorker* mNetWorker;
+    std::string mUrl;
+    size_t mFrames;
+
+    std::vector<Case> mCases;
+    size_t mCaseIndex;
+
+    HttpClientPtr mHttpClient;
+    WsChannelPtr mWsChannel;
+    FrameSender mSender;
+
+    size_t mReceived;
+    size_t mCaseErrors;
+    size_t mErrors;
+
+    Clock::time_point mStart;
+};
+
+//---------------------------------------------------------------------------//
+// Main
+//---------------------------------------------------------------------------//
+
+SEV_IMPL_GLOBAL
+
+int main(int argc, char** argv)
+{
+    size_t frames = (argc > 1) ? std::atoi(argv[1]) : 500000;
+
+    HttpServerApp app;
+    app.getTcpServer()->getSocketOption().setReuseAddress(true);
+
+    app.createThread<FrameThread>(1);
+
+    uint16_t port = 9000;
+
+    if (!app.open(IpEndPoint(port)))
+    {
+        std::cout << "open error" << std::endl;
+        return 1;
+    }
+
+    std::ostringstream url;
+    url << "ws://127.0.0.1:" << port << "/";
+
+    Benchmark benchmark(&app, url.str(), frames);
+
+    app.post([&benchmark]() {
+        benchmark.start();
+    });
+
+    app.run();
+
+    return (benchmark.getErrors() == 0) ? 0 : 1;
+}
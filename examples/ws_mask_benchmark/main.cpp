@@ -0,0 +1,145 @@
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+
+#include <subevent/subevent.hpp>
+#include <subevent/subevent_http.hpp>
+
+SEV_USING_NS
+
+// usage: ws_mask_benchmark [mbytes]
+//
+// WebSocket payload masking: WsFrame::mask() (the kernel picked for
+// the cpu) against the byte loop it replaced, in place on buffers from
+// 16 bytes to 16 MB, aligned and at an odd address. each case masks
+// about mbytes (default 1024) and is printed as one JSON line, the
+// exit code is 1 if the results of the two differ.
+
+typedef std::chrono::steady_clock Clock;
+
+// the loop of the old WsFrame::serializePayload
+static void maskScalar(
+    unsigned char* data, size_t size,
+    const std::array<unsigned char, 4>& maskingKey)
+{
+    for (size_t index = 0; index < size; ++index)
+    {
+        data[index] ^= maskingKey[index % 4];
+    }
+}
+
+typedef void (*MaskFunction)(
+    unsigned char* data, size_t size,
+    const std::array<unsigned char, 4>& maskingKey);
+
+static void maskFrame(
+    unsigned char* data, size_t size,
+    const std::array<unsigned char, 4>& maskingKey)
+{
+    WsFrame::mask(data, size, maskingKey);
+}
+
+// GB/s
+static double run(MaskFunction function,
+    unsigned char* data, size_t size, size_t iterations,
+    const std::array<unsigned char, 4>& maskingKey, uint32_t& check)
+{
+    Clock::time_point start = Clock::now();
+
+    for (size_t count = 0; count < iterations; ++count)
+    {
+        function(data, size, maskingKey);
+
+        // the result is used
+        check += data[count % size];
+    }
+
+    double seconds =
+        std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (seconds <= 0)
+    {
+        seconds = 1e-9;
+    }
+
+    return static_cast<double>(size) * iterations / seconds / 1e9;
+}
+
+//---------------------------------------------------------------------------//
+// Main
+//---------------------------------------------------------------------------//
+
+SEV_IMPL_GLOBAL
+
+int main(int argc, char** argv)
+{
+    size_t mbytes = (argc > 1) ? std::atoi(argv[1]) : 1024;
+    size_t total = mbytes * 1024 * 1024;
+
+    const std::array<unsigned char, 4> maskingKey = {
+        { 0x12, 0x34, 0x56, 0x78 } };
+
+    size_t errors = 0;
+    uint32_t check = 0;
+
+    for (size_t size : { 16, 125, 1024, 65536, 1048576, 16777216 })
+    {
+        for (size_t offset : { 0, 1 })
+        {
+            // offset 1: not aligned for any kernel
+            std::vector<unsigned char> buffer(size + 64);
+            unsigned char* data = buffer.data() + offset;
+
+            for (size_t index = 0; index < size; ++index)
+            {
+                data[index] = static_cast<unsigned char>(index * 7);
+            }
+
+            // same result, masking twice restores the data
+            std::vector<unsigned char> expected(data, data + size);
+            maskScalar(expected.data(), size, maskingKey);
+
+            maskFrame(data, size, maskingKey);
+            bool ok = std::equal(expected.begin(), expected.end(), data);
+
+            maskFrame(data, size, maskingKey);
+            ok = ok && (data[size - 1] ==
+                static_cast<unsigned char>((size - 1) * 7));
+
+            if (!ok)
+            {
+                ++errors;
+            }
+
+            size_t iterations = std::max<size_t>(total / size, 1);
+
+            double scalar = run(
+                maskScalar, data, size, iterations, maskingKey, check);
+            double frame = run(
+                maskFrame, data, size, iterations, maskingKey, check);
+
+            std::ostringstream line;
+            line << "{\"size\":" << size
+                << ",\"aligned\":" << ((offset == 0) ? 1 : 0)
+                << ",\"ok\":" << (ok ? 1 : 0)
+                << ",\"byte_loop_gb_per_sec\":" << scalar
+                << ",\"mask_gb_per_sec\":" << frame
+                << ",\"speedup\":" << (frame / scalar)
+                << "}";
+
+            std::cout << line.str() << std::endl;
+        }
+    }
+
+    // keeps the loops
+    if (check == 0x5EAD5EAD)
+    {
+        std::cout << std::endl;
+    }
+
+    return (errors == 0) ? 0 : 1;
+}
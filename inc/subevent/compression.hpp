@@ -0,0 +1,305 @@
+#ifndef SUBEVENT_COMPRESSION_HPP
+#define SUBEVENT_COMPRESSION_HPP
+
+#ifdef SEV_SUPPORTS_ZLIB
+
+#include <list>
+#include <vector>
+#include <string>
+#include <memory>
+#include <atomic>
+
+#include <zlib.h>
+
+#include <subevent/std.hpp>
+
+SEV_NS_BEGIN
+
+enum class CompressionFormat
+{
+    Zlib,
+    Gzip,
+    Raw
+};
+
+//---------------------------------------------------------------------------//
+// Deflater
+//---------------------------------------------------------------------------//
+
+class Deflater
+{
+public:
+    SEV_DECL Deflater();
+    SEV_DECL ~Deflater();
+
+public:
+    SEV_DECL bool init(
+        CompressionFormat format,
+        int level = Z_DEFAULT_COMPRESSION,
+        int windowBits = MAX_WBITS,
+        int memLevel = 8);
+
+    // keeps the allocated state
+    SEV_DECL bool reset();
+
+    SEV_DECL void end();
+
+    // flush: Z_NO_FLUSH, Z_SYNC_FLUSH or Z_FINISH
+    // the output is appended to out.
+    SEV_DECL bool deflate(
+        const void* data, size_t size,
+        std::vector<char>& out, int flush);
+
+    SEV_DECL bool isInitialized() const
+    {
+        return mInitialized;
+    }
+
+    SEV_DECL CompressionFormat getFormat() const
+    {
+        return mFormat;
+    }
+
+private:
+    Deflater(const Deflater&) = delete;
+    Deflater& operator=(const Deflater&) = delete;
+
+    z_stream mStream;
+    bool mInitialized;
+    CompressionFormat mFormat;
+};
+
+typedef std::unique_ptr<Deflater> DeflaterPtr;
+
+//---------------------------------------------------------------------------//
+// Inflater
+//---------------------------------------------------------------------------//
+
+class Inflater
+{
+public:
+    SEV_DECL Inflater();
+    SEV_DECL ~Inflater();
+
+public:
+    // Zlib and Gzip are both accepted unless format is Raw.
+    SEV_DECL bool init(
+        CompressionFormat format,
+        int windowBits = MAX_WBITS);
+
+    // keeps the allocated state
+    SEV_DECL bool reset();
+
+    SEV_DECL void end();
+
+    // the output is appended to out.
+    // maxOutputSize: 0 unlimited
+    SEV_DECL bool inflate(
+        const void* data, size_t size,
+        std::vector<char>& out, size_t maxOutputSize = 0);
+
+    SEV_DECL bool isInitialized() const
+    {
+        return mInitialized;
+    }
+
+    SEV_DECL bool isFinished() const
+    {
+        return mFinished;
+    }
+
+private:
+    Inflater(const Inflater&) = delete;
+    Inflater& operator=(const Inflater&) = delete;
+
+    z_stream mStream;
+    bool mInitialized;
+    bool mFinished;
+};
+
+typedef std::unique_ptr<Inflater> InflaterPtr;
+
+//---------------------------------------------------------------------------//
+// DeflaterPool
+//---------------------------------------------------------------------------//
+
+// reuses deflate streams instead of init/end per message.
+// not thread safe, use one pool per thread.
+class DeflaterPool
+{
+public:
+    SEV_DECL explicit DeflaterPool(
+        int level = Z_DEFAULT_COMPRESSION, size_t maxIdle = 16);
+    SEV_DECL ~DeflaterPool();
+
+public:
+    SEV_DECL DeflaterPtr acquire(CompressionFormat format);
+    SEV_DECL void release(DeflaterPtr&& deflater);
+
+    SEV_DECL size_t getIdleCount() const
+    {
+        return mIdle.size();
+    }
+
+private:
+    DeflaterPool(const DeflaterPool&) = delete;
+    DeflaterPool& operator=(const DeflaterPool&) = delete;
+
+    int mLevel;
+    size_t mMaxIdle;
+    std::list<DeflaterPtr> mIdle;
+};
+
+//---------------------------------------------------------------------------//
+// WsDeflate
+//---------------------------------------------------------------------------//
+
+// permessage-deflate (RFC 7692)
+struct WsDeflateOption
+{
+    SEV_DECL WsDeflateOption()
+    {
+        level = Z_DEFAULT_COMPRESSION;
+        memLevel = 8;
+        serverMaxWindowBits = MAX_WBITS;
+        clientMaxWindowBits = MAX_WBITS;
+        serverNoContextTakeover = false;
+        clientNoContextTakeover = false;
+        minSize = 64;
+        maxMemory = 0;
+        maxMessageSize = 16 * 1024 * 1024;
+    }
+
+    int level;
+    int memLevel;
+
+    // LZ77 window of each side (9-15)
+    int serverMaxWindowBits;
+    int clientMaxWindowBits;
+
+    // the sender resets its stream after each message
+    bool serverNoContextTakeover;
+    bool clientNoContextTakeover;
+
+    // smaller messages are sent uncompressed
+    size_t minSize;
+
+    // zlib memory of all channels in bytes (0: unlimited).
+    // handshakes decline the extension beyond it, and streams
+    // without context takeover are freed after each message.
+    size_t maxMemory;
+
+    // inflated size of a message on a channel without its own
+    // WsChannel::setMaxMessageSize(), a larger one closes the
+    // channel with MessageTooBig. 0: unlimited
+    size_t maxMessageSize;
+};
+
+typedef std::shared_ptr<WsDeflateOption> WsDeflateOptionPtr;
+
+class WsDeflate;
+
+typedef std::shared_ptr<WsDeflate> WsDeflatePtr;
+
+// negotiated parameters and streams of one channel
+class WsDeflate
+{
+public:
+    SEV_DECL ~WsDeflate();
+
+public:
+    // server: accepts the first acceptable offer of
+    // Sec-WebSocket-Extensions, nullptr if none.
+    SEV_DECL static WsDeflatePtr accept(
+        const std::string& offers,
+        const WsDeflateOption& option,
+        std::string& response);
+
+    // client: empty if the memory budget is used up
+    SEV_DECL static std::string offer(const WsDeflateOption& option);
+
+    // client: false if the response is invalid
+    // (the connection must be failed), deflate is nullptr
+    // if the server declined the extension.
+    SEV_DECL static bool confirm(
+        const std::string& response,
+        const WsDeflateOption* option,
+        WsDeflatePtr& deflate);
+
+    // zlib memory of all channels
+    SEV_DECL static size_t getMemoryUsage()
+    {
+        return getMemoryCounter().load();
+    }
+
+public:
+    // one whole message, the output is appended to out.
+    // false if the message should be sent uncompressed.
+    SEV_DECL bool compress(
+        const void* data, size_t size, std::vector<char>& out);
+
+    // maxSize: 0 unlimited
+    SEV_DECL bool decompress(
+        const void* data, size_t size,
+        std::vector<char>& out, size_t maxSize = 0);
+
+    SEV_DECL size_t getMinSize() const
+    {
+        return mOption.minSize;
+    }
+
+    SEV_DECL size_t getMaxMessageSize() const
+    {
+        return mOption.maxMessageSize;
+    }
+
+private:
+    SEV_DECL WsDeflate(
+        const WsDeflateOption& option,
+        int sendWindowBits, bool sendNoContextTakeover,
+        int receiveWindowBits, bool receiveNoContextTakeover);
+
+    struct Params
+    {
+        bool serverNoContextTakeover = false;
+        bool clientNoContextTakeover = false;
+
+        // 0: not present, -1: present without a value
+        int serverMaxWindowBits = 0;
+        int clientMaxWindowBits = 0;
+    };
+
+    SEV_DECL static bool parseParams(
+        const std::string& extension, Params& params);
+    SEV_DECL static size_t getDeflateMemory(
+        int windowBits, int memLevel);
+    SEV_DECL static size_t getInflateMemory(int windowBits);
+    SEV_DECL static std::atomic<size_t>& getMemoryCounter();
+
+    SEV_DECL bool isPersistent(bool noContextTakeover) const
+    {
+        return !noContextTakeover || (mOption.maxMemory == 0);
+    }
+
+    WsDeflate(const WsDeflate&) = delete;
+    WsDeflate& operator=(const WsDeflate&) = delete;
+
+    WsDeflateOption mOption;
+
+    int mSendWindowBits;
+    bool mSendNoContextTakeover;
+    int mReceiveWindowBits;
+    bool mReceiveNoContextTakeover;
+
+    DeflaterPtr mDeflater;
+    InflaterPtr mInflater;
+
+    // memory of the persistent streams, counted from the handshake
+    size_t mReserved;
+};
+
+SEV_NS_END
+
+#endif // SEV_SUPPORTS_ZLIB
+
+#endif // SUBEVENT_COMPRESSION_HPP
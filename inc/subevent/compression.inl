@@ -0,0 +1,813 @@
+#ifndef SUBEVENT_COMPRESSION_INL
+#define SUBEVENT_COMPRESSION_INL
+
+#ifdef SEV_SUPPORTS_ZLIB
+
+#include <cstring>
+#include <climits>
+#include <cstdlib>
+
+#include <subevent/compression.hpp>
+#include <subevent/utility.hpp>
+
+SEV_NS_BEGIN
+
+//---------------------------------------------------------------------------//
+// Deflater
+//---------------------------------------------------------------------------//
+
+Deflater::Deflater()
+{
+    std::memset(&mStream, 0, sizeof(mStream));
+    mInitialized = false;
+    mFormat = CompressionFormat::Zlib;
+}
+
+Deflater::~Deflater()
+{
+    end();
+}
+
+bool Deflater::init(
+    CompressionFormat format, int level, int windowBits, int memLevel)
+{
+    end();
+
+    if (format == CompressionFormat::Gzip)
+    {
+        windowBits += 16;
+    }
+    else if (format == CompressionFormat::Raw)
+    {
+        windowBits = -windowBits;
+    }
+
+    int result = deflateInit2(&mStream, level,
+        Z_DEFLATED, windowBits, memLevel, Z_DEFAULT_STRATEGY);
+
+    if (result != Z_OK)
+    {
+        return false;
+    }
+
+    mInitialized = true;
+    mFormat = format;
+
+    return true;
+}
+
+bool Deflater::reset()
+{
+    if (!mInitialized)
+    {
+        return false;
+    }
+
+    return (deflateReset(&mStream) == Z_OK);
+}
+
+void Deflater::end()
+{
+    if (mInitialized)
+    {
+        deflateEnd(&mStream);
+        std::memset(&mStream, 0, sizeof(mStream));
+        mInitialized = false;
+    }
+}
+
+bool Deflater::deflate(
+    const void* data, size_t size, std::vector<char>& out, int flush)
+{
+    if (!mInitialized || (size > UINT_MAX))
+    {
+        return false;
+    }
+
+    mStream.next_in = static_cast<Bytef*>(const_cast<void*>(data));
+    mStream.avail_in = static_cast<uInt>(size);
+
+    size_t bound = deflateBound(&mStream, static_cast<uLong>(size));
+
+    for (;;)
+    {
+        size_t offset = out.size();
+        size_t avail = ((bound > 64) ? bound : 64);
+
+        out.resize(offset + avail);
+
+        mStream.next_out = reinterpret_cast<Bytef*>(&out[offset]);
+        mStream.avail_out = static_cast<uInt>(avail);
+
+        int result = ::deflate(&mStream, flush);
+
+        out.resize(out.size() - mStream.avail_out);
+
+        if ((result != Z_OK) &&
+            (result != Z_STREAM_END) &&
+            (result != Z_BUF_ERROR))
+        {
+            return false;
+        }
+
+        if (result == Z_STREAM_END)
+        {
+            break;
+        }
+
+        if ((mStream.avail_in == 0) && (mStream.avail_out != 0))
+        {
+            // all flushed
+            break;
+        }
+
+        bound = 1024;
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------//
+// Inflater
+//---------------------------------------------------------------------------//
+
+Inflater::Inflater()
+{
+    std::memset(&mStream, 0, sizeof(mStream));
+    mInitialized = false;
+    mFinished = false;
+}
+
+Inflater::~Inflater()
+{
+    end();
+}
+
+bool Inflater::init(CompressionFormat format, int windowBits)
+{
+    end();
+
+    if (format == CompressionFormat::Raw)
+    {
+        windowBits = -windowBits;
+    }
+    else
+    {
+        // automatic header detection
+        windowBits += 32;
+    }
+
+    if (inflateInit2(&mStream, windowBits) != Z_OK)
+    {
+        return false;
+    }
+
+    mInitialized = true;
+    mFinished = false;
+
+    return true;
+}
+
+bool Inflater::reset()
+{
+    if (!mInitialized)
+    {
+        return false;
+    }
+
+    mFinished = false;
+
+    return (inflateReset(&mStream) == Z_OK);
+}
+
+void Inflater::end()
+{
+    if (mInitialized)
+    {
+        inflateEnd(&mStream);
+        std::memset(&mStream, 0, sizeof(mStream));
+        mInitialized = false;
+    }
+}
+
+bool Inflater::inflate(
+    const void* data, size_t size,
+    std::vector<char>& out, size_t maxOutputSize)
+{
+    if (!mInitialized || (size > UINT_MAX))
+    {
+        return false;
+    }
+
+    if (mFinished)
+    {
+        // trailing garbage is ignored
+        return true;
+    }
+
+    mStream.next_in = static_cast<Bytef*>(const_cast<void*>(data));
+    mStream.avail_in = static_cast<uInt>(size);
+
+    size_t outputSize = 0;
+    size_t avail = ((size < 4096) ? 16384 : (size * 4));
+
+    for (;;)
+    {
+        size_t offset = out.size();
+
+        out.resize(offset + avail);
+
+        mStream.next_out = reinterpret_cast<Bytef*>(&out[offset]);
+        mStream.avail_out = static_cast<uInt>(avail);
+
+        int result = ::inflate(&mStream, Z_SYNC_FLUSH);
+
+        size_t written = avail - mStream.avail_out;
+        out.resize(offset + written);
+        outputSize += written;
+
+        if ((maxOutputSize != 0) && (outputSize > maxOutputSize))
+        {
+            // too large
+            return false;
+        }
+
+        if (result == Z_STREAM_END)
+        {
+            mFinished = true;
+            break;
+        }
+
+        if ((result != Z_OK) && (result != Z_BUF_ERROR))
+        {
+            return false;
+        }
+
+        if ((mStream.avail_in == 0) && (mStream.avail_out != 0))
+        {
+            // need more input
+            break;
+        }
+
+        if ((result == Z_BUF_ERROR) && (written == 0))
+        {
+            // no progress
+            break;
+        }
+    }
+
+    return true;
+}
+
+//---------------------------------------------------------------------------//
+// DeflaterPool
+//---------------------------------------------------------------------------//
+
+DeflaterPool::DeflaterPool(int level, size_t maxIdle)
+{
+    mLevel = level;
+    mMaxIdle = maxIdle;
+}
+
+DeflaterPool::~DeflaterPool()
+{
+}
+
+DeflaterPtr DeflaterPool::acquire(CompressionFormat format)
+{
+    for (auto it = mIdle.begin(); it != mIdle.end(); ++it)
+    {
+        if ((*it)->getFormat() == format)
+        {
+            DeflaterPtr deflater = std::move(*it);
+            mIdle.erase(it);
+
+            return deflater;
+        }
+    }
+
+    DeflaterPtr deflater(new Deflater());
+
+    if (!deflater->init(format, mLevel))
+    {
+        return nullptr;
+    }
+
+    return deflater;
+}
+
+void DeflaterPool::release(DeflaterPtr&& deflater)
+{
+    if ((deflater == nullptr) || (mIdle.size() >= mMaxIdle))
+    {
+        deflater.reset();
+        return;
+    }
+
+    if (!deflater->reset())
+    {
+        deflater.reset();
+        return;
+    }
+
+    mIdle.push_back(std::move(deflater));
+}
+
+//---------------------------------------------------------------------------//
+// WsDeflate
+//---------------------------------------------------------------------------//
+
+WsDeflate::WsDeflate(
+    const WsDeflateOption& option,
+    int sendWindowBits, bool sendNoContextTakeover,
+    int receiveWindowBits, bool receiveNoContextTakeover)
+    : mOption(option)
+{
+    mSendWindowBits = sendWindowBits;
+    mSendNoContextTakeover = sendNoContextTakeover;
+    mReceiveWindowBits = receiveWindowBits;
+    mReceiveNoContextTakeover = receiveNoContextTakeover;
+
+    mReserved = 0;
+
+    if (isPersistent(mSendNoContextTakeover))
+    {
+        mReserved += getDeflateMemory(mSendWindowBits, mOption.memLevel);
+    }
+
+    if (isPersistent(mReceiveNoContextTakeover))
+    {
+        mReserved += getInflateMemory(mReceiveWindowBits);
+    }
+
+    getMemoryCounter() += mReserved;
+}
+
+WsDeflate::~WsDeflate()
+{
+    if (mDeflater != nullptr && !isPersistent(mSendNoContextTakeover))
+    {
+        getMemoryCounter() -=
+            getDeflateMemory(mSendWindowBits, mOption.memLevel);
+    }
+
+    if (mInflater != nullptr && !isPersistent(mReceiveNoContextTakeover))
+    {
+        getMemoryCounter() -= getInflateMemory(mReceiveWindowBits);
+    }
+
+    getMemoryCounter() -= mReserved;
+}
+
+WsDeflatePtr WsDeflate::accept(
+    const std::string& offers,
+    const WsDeflateOption& option,
+    std::string& response)
+{
+    response.clear();
+
+    for (const auto& offer : String::split(offers, ","))
+    {
+        Params params;
+
+        if (!parseParams(offer, params) || (params.serverMaxWindowBits < 0))
+        {
+            continue;
+        }
+
+        // server window, 8 is not supported by zlib
+        int serverBits = option.serverMaxWindowBits;
+
+        if ((params.serverMaxWindowBits > 0) &&
+            (params.serverMaxWindowBits < serverBits))
+        {
+            serverBits = params.serverMaxWindowBits;
+        }
+
+        if (serverBits < 9)
+        {
+            continue;
+        }
+
+        // the client limits its window only if it says so
+        int clientBits = MAX_WBITS;
+
+        if (params.clientMaxWindowBits != 0)
+        {
+            clientBits = option.clientMaxWindowBits;
+
+            if ((params.clientMaxWindowBits > 0) &&
+                (params.clientMaxWindowBits < clientBits))
+            {
+                clientBits = params.clientMaxWindowBits;
+            }
+
+            if (clientBits < 9)
+            {
+                clientBits = 9;
+            }
+        }
+
+        bool serverNoContextTakeover =
+            option.serverNoContextTakeover ||
+            params.serverNoContextTakeover;
+        bool clientNoContextTakeover =
+            option.clientNoContextTakeover ||
+            params.clientNoContextTakeover;
+
+        WsDeflatePtr deflate(new WsDeflate(
+            option,
+            serverBits, serverNoContextTakeover,
+            clientBits, clientNoContextTakeover));
+
+        if ((option.maxMemory != 0) &&
+            (getMemoryUsage() > option.maxMemory))
+        {
+            // declined
+            return nullptr;
+        }
+
+        response = "permessage-deflate";
+
+        if (serverNoContextTakeover)
+        {
+            response += "; server_no_context_takeover";
+        }
+
+        if (clientNoContextTakeover)
+        {
+            response += "; client_no_context_takeover";
+        }
+
+        if ((serverBits < MAX_WBITS) || (params.serverMaxWindowBits > 0))
+        {
+            response += "; server_max_window_bits=" +
+                std::to_string(serverBits);
+        }
+
+        if ((params.clientMaxWindowBits != 0) && (clientBits < MAX_WBITS))
+        {
+            response += "; client_max_window_bits=" +
+                std::to_string(clientBits);
+        }
+
+        return deflate;
+    }
+
+    return nullptr;
+}
+
+std::string WsDeflate::offer(const WsDeflateOption& option)
+{
+    if ((option.maxMemory != 0) &&
+        ((getMemoryUsage() +
+            getDeflateMemory(option.clientMaxWindowBits, option.memLevel) +
+            getInflateMemory(option.serverMaxWindowBits)) >
+                option.maxMemory))
+    {
+        return "";
+    }
+
+    std::string offer = "permessage-deflate";
+
+    if (option.serverNoContextTakeover)
+    {
+        offer += "; server_no_context_takeover";
+    }
+
+    if (option.clientNoContextTakeover)
+    {
+        offer += "; client_no_context_takeover";
+    }
+
+    if (option.serverMaxWindowBits < MAX_WBITS)
+    {
+        offer += "; server_max_window_bits=" +
+            std::to_string(option.serverMaxWindowBits);
+    }
+
+    // the server may limit our window
+    offer += "; client_max_window_bits";
+
+    if (option.clientMaxWindowBits < MAX_WBITS)
+    {
+        offer += "=" + std::to_string(option.clientMaxWindowBits);
+    }
+
+    return offer;
+}
+
+bool WsDeflate::confirm(
+    const std::string& response,
+    const WsDeflateOption* option,
+    WsDeflatePtr& deflate)
+{
+    deflate.reset();
+
+    std::string extensions = response;
+    String::trim(extensions);
+
+    if (extensions.empty())
+    {
+        // declined
+        return true;
+    }
+
+    auto accepted = String::split(extensions, ",");
+
+    Params params;
+
+    if ((option == nullptr) ||
+        (accepted.size() != 1) ||
+        !parseParams(accepted.front(), params))
+    {
+        // not offered
+        return false;
+    }
+
+    // must not exceed the offer
+    if ((params.serverMaxWindowBits < 0) ||
+        ((params.serverMaxWindowBits > option->serverMaxWindowBits) &&
+            (option->serverMaxWindowBits < MAX_WBITS)) ||
+        (params.clientMaxWindowBits > option->clientMaxWindowBits) ||
+        (params.clientMaxWindowBits < 0))
+    {
+        return false;
+    }
+
+    int clientBits = (option->clientMaxWindowBits < 9) ?
+        9 : option->clientMaxWindowBits;
+
+    if ((params.clientMaxWindowBits > 0) &&
+        (params.clientMaxWindowBits < clientBits))
+    {
+        clientBits = params.clientMaxWindowBits;
+    }
+
+    if (clientBits < 9)
+    {
+        // 8 is not supported by zlib
+        return false;
+    }
+
+    // zlib senders use 9 for 8
+    int serverBits = (params.serverMaxWindowBits > 8) ?
+        params.serverMaxWindowBits :
+        ((params.serverMaxWindowBits == 8) ? 9 : MAX_WBITS);
+
+    deflate.reset(new WsDeflate(
+        *option,
+        clientBits,
+        option->clientNoContextTakeover || params.clientNoContextTakeover,
+        serverBits,
+        params.serverNoContextTakeover));
+
+    return true;
+}
+
+bool WsDeflate::compress(
+    const void* data, size_t size, std::vector<char>& out)
+{
+    if (size == 0)
+    {
+        return false;
+    }
+
+    const bool persistent = isPersistent(mSendNoContextTakeover);
+    const size_t memory =
+        getDeflateMemory(mSendWindowBits, mOption.memLevel);
+
+    if (mDeflater == nullptr)
+    {
+        if (!persistent &&
+            ((getMemoryUsage() + memory) > mOption.maxMemory))
+        {
+            // over budget, sent as is
+            return false;
+        }
+
+        mDeflater.reset(new Deflater());
+
+        if (!mDeflater->init(
+            CompressionFormat::Raw, mOption.level,
+            mSendWindowBits, mOption.memLevel))
+        {
+            mDeflater.reset();
+            return false;
+        }
+
+        if (!persistent)
+        {
+            getMemoryCounter() += memory;
+        }
+    }
+
+    size_t offset = out.size();
+
+    bool result = mDeflater->deflate(data, size, out, Z_SYNC_FLUSH);
+
+    // the sync flush ends with an empty block (00 00 FF FF)
+    if (result &&
+        ((out.size() - offset) >= 4) &&
+        (std::memcmp(&out[out.size() - 4], "\x00\x00\xFF\xFF", 4) == 0))
+    {
+        out.resize(out.size() - 4);
+    }
+    else
+    {
+        out.resize(offset);
+        result = false;
+    }
+
+    if (!result || mSendNoContextTakeover)
+    {
+        if (!result || !persistent)
+        {
+            // the stream is broken or freed per message
+            mDeflater.reset();
+
+            if (!persistent)
+            {
+                getMemoryCounter() -= memory;
+            }
+        }
+        else
+        {
+            mDeflater->reset();
+        }
+    }
+
+    return result;
+}
+
+bool WsDeflate::decompress(
+    const void* data, size_t size,
+    std::vector<char>& out, size_t maxSize)
+{
+    const bool persistent = isPersistent(mReceiveNoContextTakeover);
+    const size_t memory = getInflateMemory(mReceiveWindowBits);
+
+    if (mInflater == nullptr)
+    {
+        mInflater.reset(new Inflater());
+
+        if (!mInflater->init(CompressionFormat::Raw, mReceiveWindowBits))
+        {
+            mInflater.reset();
+            return false;
+        }
+
+        if (!persistent)
+        {
+            getMemoryCounter() += memory;
+        }
+    }
+
+    size_t offset = out.size();
+
+    // the empty block removed by the sender
+    bool result =
+        mInflater->inflate(data, size, out, maxSize) &&
+        mInflater->inflate("\x00\x00\xFF\xFF", 4, out, maxSize) &&
+        ((maxSize == 0) || ((out.size() - offset) <= maxSize));
+
+    if (!result || !persistent)
+    {
+        mInflater.reset();
+
+        if (!persistent)
+        {
+            getMemoryCounter() -= memory;
+        }
+    }
+    else if (mReceiveNoContextTakeover || mInflater->isFinished())
+    {
+        mInflater->reset();
+    }
+
+    return result;
+}
+
+bool WsDeflate::parseParams(const std::string& extension, Params& params)
+{
+    auto tokens = String::split(extension, ";");
+
+    if (tokens.empty())
+    {
+        return false;
+    }
+
+    std::string name = tokens.front();
+    String::trim(name);
+
+    if (!String::iequals(name, "permessage-deflate"))
+    {
+        return false;
+    }
+
+    tokens.pop_front();
+
+    for (auto token : tokens)
+    {
+        String::trim(token);
+
+        std::string value;
+        size_t pos = token.find('=');
+
+        if (pos != std::string::npos)
+        {
+            value = token.substr(pos + 1);
+            token.resize(pos);
+
+            String::trim(token);
+            String::trim(value);
+            String::trim(value, "\"");
+        }
+
+        int bits = -1;
+
+        if (!value.empty())
+        {
+            if ((value.size() > 2) ||
+                (value.find_first_not_of("0123456789") != std::string::npos))
+            {
+                return false;
+            }
+
+            bits = std::atoi(value.c_str());
+
+            if ((bits < 8) || (bits > MAX_WBITS))
+            {
+                return false;
+            }
+        }
+
+        // each parameter appears once
+        if (token == "server_no_context_takeover")
+        {
+            if (params.serverNoContextTakeover || !value.empty())
+            {
+                return false;
+            }
+
+            params.serverNoContextTakeover = true;
+        }
+        else if (token == "client_no_context_takeover")
+        {
+            if (params.clientNoContextTakeover || !value.empty())
+            {
+                return false;
+            }
+
+            params.clientNoContextTakeover = true;
+        }
+        else if (token == "server_max_window_bits")
+        {
+            if (params.serverMaxWindowBits != 0)
+            {
+                return false;
+            }
+
+            params.serverMaxWindowBits = bits;
+        }
+        else if (token == "client_max_window_bits")
+        {
+            if (params.clientMaxWindowBits != 0)
+            {
+                return false;
+            }
+
+            params.clientMaxWindowBits = bits;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+size_t WsDeflate::getDeflateMemory(int windowBits, int memLevel)
+{
+    // zconf.h
+    return (size_t(1) << (windowBits + 2)) +
+        (size_t(1) << (memLevel + 9)) + 6 * 1024;
+}
+
+size_t WsDeflate::getInflateMemory(int windowBits)
+{
+    return (size_t(1) << windowBits) + 7 * 1024;
+}
+
+std::atomic<size_t>& WsDeflate::getMemoryCounter()
+{
+    static std::atomic<size_t> counter(0);
+    return counter;
+}
+
+SEV_NS_END
+
+#endif // SEV_SUPPORTS_ZLIB
+
+#endif // SUBEVENT_COMPRESSION_INL
@@ -9,10 +9,17 @@
 #include <iterator>
 #include <algorithm>
 #include <memory>
+#include <chrono>
+#include <functional>
 
 #include <subevent/std.hpp>
 #include <subevent/byte_io.hpp>
 #include <subevent/string_io.hpp>
+#include <subevent/compression.hpp>
+
+#ifdef SEV_OS_LINUX
+#include <fcntl.h>
+#endif
 
 SEV_NS_BEGIN
 
@@ -24,9 +31,33 @@ class HttpClient;
 
 class WsFrame;
 class WsChannel;
+class WsKeepAlive;
 
 typedef std::shared_ptr<WsFrame> WsFramePtr;
 typedef std::shared_ptr<WsChannel> WsChannelPtr;
+typedef std::shared_ptr<WsKeepAlive> WsKeepAlivePtr;
+
+// WebSocket heartbeat, see WsKeepAlive
+struct WsKeepAliveOption
+{
+    SEV_DECL WsKeepAliveOption()
+    {
+        interval = 30 * 1000;
+        timeout = 10 * 1000;
+        tick = 1000;
+    }
+
+    // msec without receiving anything before a ping is sent
+    uint32_t interval;
+
+    // msec to wait for anything after the ping
+    uint32_t timeout;
+
+    // msec between the checks, the precision of the above
+    uint32_t tick;
+};
+
+typedef std::function<void(const char*, size_t)> HttpContentHandler;
 
 //---------------------------------------------------------------------------//
 //---------------------------------------------------------------------------//
@@ -39,6 +70,8 @@ namespace HttpMethod
     static const std::string Delete = "DELETE";
     static const std::string Patch = "PATCH";
     static const std::string Head = "HEAD";
+    static const std::string Options = "OPTIONS";
+    static const std::string Trace = "TRACE";
 };
 
 namespace HttpProtocol
@@ -52,6 +85,7 @@ namespace HttpHeaderField
     static const std::string Accept = "Accept";
     static const std::string AcceptEncoding = "Accept-Encoding";
     static const std::string Connection = "Connection";
+    static const std::string ContentEncoding = "Content-Encoding";
     static const std::string ContentLength = "Content-Length";
     static const std::string ContentType = "Content-Type";
     static const std::string Host = "Host";
@@ -62,11 +96,14 @@ namespace HttpHeaderField
     static const std::string UserAgent = "User-Agent";
     static const std::string Upgrade = "Upgrade";
     static const std::string Origin = "Origin";
+    static const std::string Vary = "Vary";
 
     static const std::string SecWebSocketKey = "Sec-Websocket-Key";
     static const std::string SecWebSocketAccept = "Sec-WebSocket-Accept";
     static const std::string SecWebSocketProtocol = "Sec-WebSocket-Protocol";
     static const std::string SecWebSocketVersion = "Sec-WebSocket-Version";
+    static const std::string SecWebSocketExtensions =
+        "Sec-WebSocket-Extensions";
 }
 
 namespace HttpCookieAttr
@@ -84,10 +121,12 @@ namespace HttpStatusCode
     static const uint16_t SwitchingProtocols = 101;
 
     static const uint16_t Ok = 200;
+    static const uint16_t NoContent = 204;
 
     static const uint16_t MovedPermanently = 301;
     static const uint16_t Found = 302;
     static const uint16_t SeeOther = 303;
+    static const uint16_t NotModified = 304;
     static const uint16_t TemporaryRedirect = 307;
     static const uint16_t PermanentRedirect = 308;
 
@@ -525,6 +564,18 @@ public:
         return std::string(mBody.begin(), mBody.end());
     }
 
+    // set when the body exceeded the in-memory limit
+    // and was stored in a file instead of getBody()
+    SEV_DECL void setBodyFileName(const std::string& fileName)
+    {
+        mBodyFileName = fileName;
+    }
+
+    SEV_DECL const std::string& getBodyFileName() const
+    {
+        return mBodyFileName;
+    }
+
     SEV_DECL virtual bool isEmpty() const;
     SEV_DECL virtual void clear();
 
@@ -553,6 +604,7 @@ protected:
 private:
     HttpHeader mHeader;
     std::vector<char> mBody;
+    std::string mBodyFileName;
 };
 
 //----------------------------------------------------------------------------//
@@ -598,6 +650,9 @@ public:
         return mProtocol;
     }
 
+    // safe to send again (RFC 7231 4.2.2)
+    SEV_DECL bool isIdempotent() const;
+
     SEV_DECL bool isEmpty() const override;
     SEV_DECL void clear() override;
 
@@ -636,6 +691,28 @@ private:
     std::string mProtocol;
 };
 
+//----------------------------------------------------------------------------//
+// HttpRedirectHop
+//----------------------------------------------------------------------------//
+
+// one request of a followed redirect chain
+struct HttpRedirectHop
+{
+    HttpRedirectHop()
+        : statusCode(0), elapsed(0), reused(false)
+    {
+    }
+
+    std::string url;
+    uint16_t statusCode;
+
+    // from the start of the request to the end of the response
+    std::chrono::microseconds elapsed;
+
+    // sent on a kept-alive connection
+    bool reused;
+};
+
 //----------------------------------------------------------------------------//
 // HttpResponse
 //----------------------------------------------------------------------------//
@@ -682,6 +759,18 @@ public:
     SEV_DECL void clear();
     SEV_DECL bool isEmpty() const;
 
+    // the redirects followed to this response, which is the last hop.
+    // empty if there were none.
+    SEV_DECL void setRedirectHops(std::vector<HttpRedirectHop>&& hops)
+    {
+        mRedirectHops = std::move(hops);
+    }
+
+    SEV_DECL const std::vector<HttpRedirectHop>& getRedirectHops() const
+    {
+        return mRedirectHops;
+    }
+
 public:
     SEV_DECL void addCookie(const HttpCookie& cookie)
     {
@@ -712,6 +801,81 @@ private:
     std::string mProtocol;
     uint16_t mStatusCode;
     std::string mMessage;
+    std::vector<HttpRedirectHop> mRedirectHops;
+};
+
+//----------------------------------------------------------------------------//
+// HttpChunk
+//----------------------------------------------------------------------------//
+
+// Transfer-Encoding: chunked
+class HttpChunk
+{
+public:
+    // size must not be 0
+    SEV_DECL static std::vector<char> serialize(
+        const void* data, size_t size);
+
+    // last chunk + trailers
+    SEV_DECL static std::vector<char> serializeLast(
+        const HttpHeader& trailers);
+
+private:
+    HttpChunk() = delete;
+};
+
+//----------------------------------------------------------------------------//
+// HttpFileSink
+//----------------------------------------------------------------------------//
+
+class HttpFileSink
+{
+public:
+    SEV_DECL HttpFileSink();
+    SEV_DECL ~HttpFileSink();
+
+public:
+    // expectedSize 0: unknown
+    SEV_DECL bool open(const std::string& fileName, size_t expectedSize = 0);
+
+    // creates a new file with a unique name in the directory.
+    // never opens an existing file or follows a link (mode 0600).
+    SEV_DECL bool openTemp(
+        const std::string& directory, size_t expectedSize = 0);
+
+    SEV_DECL bool write(const char* data, size_t size);
+    SEV_DECL bool close();
+
+    // close and remove the file
+    SEV_DECL void abort();
+
+    SEV_DECL bool isOpen() const
+    {
+        return (mFile != nullptr);
+    }
+
+    SEV_DECL const std::string& getFileName() const
+    {
+        return mFileName;
+    }
+
+    SEV_DECL void setBufferSize(size_t bufferSize)
+    {
+        mBufferSize = bufferSize;
+    }
+
+private:
+    HttpFileSink(const HttpFileSink&) = delete;
+    HttpFileSink& operator=(const HttpFileSink&) = delete;
+
+    SEV_DECL bool flush();
+    SEV_DECL void attach(
+        FILE* file, const std::string& fileName, size_t expectedSize);
+
+    FILE* mFile;
+    std::string mFileName;
+    std::vector<char> mBuffer;
+    size_t mBufferSize;
 };
 
 //----------------------------------------------------------------------------//
@@ -725,6 +889,8 @@ public:
     SEV_DECL ~HttpContentReceiver();
 
 private:
+    // resumable decoder for Transfer-Encoding: chunked.
+    // the input may be split at any byte.
     class ChunkWork
     {
     public:
@@ -734,49 +900,63 @@ private:
     public:
         SEV_DECL void start()
         {
-            mRunning = true;
+            clear();
+            mState = State::Size;
         }
 
         SEV_DECL void clear()
         {
-            mRunning = false;
+            mState = State::Idle;
             mChunkSize = 0;
-            mReceiveSize = 0;
+            mDigits = 0;
+            mSizeSeen = false;
+            mTrailerSize = 0;
         }
 
-        SEV_DECL bool setChunkSize(StringReader& reader);
+        // skips the framing up to the next chunk data.
+        // dataSize: readable data bytes of the current chunk at
+        // the reader position (0 if more input is needed or done).
+        // returns false if the input is malformed.
+        SEV_DECL bool parse(ByteReader& reader, size_t& dataSize);
 
-        SEV_DECL size_t getChunkSize() const
+        // dataSize bytes have been read by the caller
+        SEV_DECL void consume(size_t dataSize)
         {
-            return mChunkSize;
-        }
+            mChunkSize -= dataSize;
 
-        SEV_DECL bool isRunning() const
-        {
-            return mRunning;
-        }
-
-        SEV_DECL size_t getRemaining() const
-        {
-            return ((mChunkSize <= mReceiveSize) ?
-                0 : (mChunkSize - mReceiveSize));
+            if (mChunkSize == 0)
+            {
+                mState = State::DataCr;
+            }
         }
 
-        SEV_DECL void updateSize(size_t size)
+        SEV_DECL bool isRunning() const
         {
-            mReceiveSize += size;
-
-            if (getRemaining() == 0)
-            {
-                mChunkSize = 0;
-                mReceiveSize = 0;
-            }
+            return ((mState != State::Idle) && (mState != State::Done));
         }
 
     private:
-        bool mRunning;
+        enum class State
+        {
+            Idle,
+            Size,
+            Extension,
+            SizeLf,
+            Data,
+            DataCr,
+            DataLf,
+            TrailerStart,
+            Trailer,
+            TrailerLf,
+            LastLf,
+            Done
+        };
+
+        State mState;
         size_t mChunkSize;
-        size_t mReceiveSize;
+        size_t mDigits;     // significant, leading zeros are not counted
+        bool mSizeSeen;
+        size_t mTrailerSize;
     };
 
 public:
@@ -787,6 +967,46 @@ public:
         mFileName = fileName;
     }
 
+    SEV_DECL const std::string& getFileName() const
+    {
+        return mFileName;
+    }
+
+    SEV_DECL void setContentHandler(const HttpContentHandler& handler)
+    {
+        mContentHandler = handler;
+    }
+
+    // 0: unlimited
+    SEV_DECL void setMaxMemorySize(
+        size_t maxMemorySize, const std::string& tempDirectory = "")
+    {
+        mMaxMemorySize = maxMemorySize;
+        mTempDirectory = tempDirectory;
+    }
+
+    SEV_DECL bool isSpilled() const
+    {
+        return mSpilled;
+    }
+
+#ifdef SEV_SUPPORTS_ZLIB
+    // decode Content-Encoding: gzip / deflate.
+    // maxDecodedSize: 0 unlimited
+    SEV_DECL void setDecompression(
+        bool decompression, size_t maxDecodedSize = 0)
+    {
+        mDecompression = decompression;
+        mMaxDecodedSize = maxDecodedSize;
+    }
+
+    // onReceive() failed on the decoded size
+    SEV_DECL bool isDecodedSizeExceeded() const
+    {
+        return mDecodedSizeExceeded;
+    }
+#endif
+
     SEV_DECL bool onReceive(StringReader& reader);
 
     SEV_DECL void startChunk()
@@ -809,13 +1029,32 @@ public:
         return (mSize <= mReceiveSize);
     }
 
+    // discard an unfinished output file
+    SEV_DECL void abort()
+    {
+        mFileSink.abort();
+    }
+
     SEV_DECL void clear()
     {
         mSize = 0;
         mReceiveSize = 0;
+        mOutputSize = 0;
         mChunkWork.clear();
+        mFileSink.abort();
         mFileName.clear();
         mData.clear();
+        mContentHandler = nullptr;
+        mMaxMemorySize = 0;
+        mTempDirectory.clear();
+        mSpilled = false;
+#ifdef SEV_SUPPORTS_ZLIB
+        mDecompression = false;
+        mMaxDecodedSize = 0;
+        mDecodedSizeExceeded = false;
+        mInflating = false;
+        mInflateBuffer.clear();
+#endif
     }
 
     SEV_DECL std::vector<char>&& getData()
@@ -823,14 +1062,49 @@ public:
         return std::move(mData);
     }
 
+    // the body has been decompressed (Content-Encoding)
+    SEV_DECL bool isDecoded() const
+    {
+#ifdef SEV_SUPPORTS_ZLIB
+        return mInflating;
+#else
+        return false;
+#endif
+    }
+
+    // bytes output so far (decoded)
+    SEV_DECL size_t getOutputSize() const
+    {
+        return mOutputSize;
+    }
+
 private:
-    SEV_DECL bool deserialize(ByteReader& reader);
+    SEV_DECL bool deserialize(const char* data, size_t size);
+    SEV_DECL bool output(const char* data, size_t size);
+    SEV_DECL bool writeFile(const char* data, size_t size);
+    SEV_DECL bool spill();
 
     size_t mSize;
     size_t mReceiveSize;
+    size_t mOutputSize;
     ChunkWork mChunkWork;
     std::string mFileName;
+    HttpFileSink mFileSink;
     std::vector<char> mData;
+
+    HttpContentHandler mContentHandler;
+    size_t mMaxMemorySize;
+    std::string mTempDirectory;
+    bool mSpilled;
+
+#ifdef SEV_SUPPORTS_ZLIB
+    bool mDecompression;
+    size_t mMaxDecodedSize;
+    bool mDecodedSizeExceeded;
+    bool mInflating;
+    InflaterPtr mInflater;
+    std::vector<char> mInflateBuffer;
+#endif
 };
 
 SEV_NS_END
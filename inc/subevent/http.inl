@@ -1,9 +1,19 @@
 #ifndef SUBEVENT_HTTP_INL
 #define SUBEVENT_HTTP_INL
 
-#include <fstream>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
 #include <algorithm>
 
+#ifdef SEV_OS_WIN
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <unistd.h>
+#endif
+
 #include <subevent/network.hpp>
 #include <subevent/http.hpp>
 
@@ -1074,6 +1084,7 @@ void HttpMessage::clear()
 {
     mHeader.clear();
     mBody.clear();
+    mBodyFileName.clear();
 }
 
 bool HttpMessage::isEmpty() const
@@ -1157,6 +1168,7 @@ HttpMessage& HttpMessage::operator=(const HttpMessage& other)
 {
     mHeader = other.mHeader;
     mBody = other.mBody;
+    mBodyFileName = other.mBodyFileName;
 
     return *this;
 }
@@ -1165,6 +1177,7 @@ HttpMessage& HttpMessage::operator=(HttpMessage&& other)
 {
     mHeader = std::move(other.mHeader);
     mBody = std::move(other.mBody);
+    mBodyFileName = std::move(other.mBodyFileName);
 
     return *this;
 }
@@ -1201,6 +1214,16 @@ void HttpRequest::clear()
     mProtocol = HttpProtocol::v1_1;
 }
 
+bool HttpRequest::isIdempotent() const
+{
+    return ((mMethod == HttpMethod::Get) ||
+        (mMethod == HttpMethod::Head) ||
+        (mMethod == HttpMethod::Put) ||
+        (mMethod == HttpMethod::Delete) ||
+        (mMethod == HttpMethod::Options) ||
+        (mMethod == HttpMethod::Trace));
+}
+
 bool HttpRequest::isEmpty() const
 {
     if (!HttpMessage::isEmpty())
@@ -1390,6 +1413,7 @@ void HttpResponse::clear()
     mProtocol = HttpProtocol::v1_1;
     mStatusCode = 0;
     mMessage.clear();
+    mRedirectHops.clear();
 }
 
 bool HttpResponse::isEmpty() const
@@ -1480,6 +1504,7 @@ HttpResponse& HttpResponse::operator=(const HttpResponse& other)
     mProtocol = other.mProtocol;
     mStatusCode = other.mStatusCode;
     mMessage = other.mMessage;
+    mRedirectHops = other.mRedirectHops;
 
     return *this;
 }
@@ -1491,6 +1516,7 @@ HttpResponse& HttpResponse::operator=(HttpResponse&& other)
     mProtocol = std::move(other.mProtocol);
     mStatusCode = other.mStatusCode;
     mMessage = std::move(other.mMessage);
+    mRedirectHops = std::move(other.mRedirectHops);
 
     other.clear();
 
@@ -1498,39 +1524,436 @@ HttpResponse& HttpResponse::operator=(HttpResponse&& other)
 }
 
 //----------------------------------------------------------------------------//
-// HttpContentReceiver::ChunkWork
+// HttpChunk
 //----------------------------------------------------------------------------//
 
-HttpContentReceiver::ChunkWork::ChunkWork()
+std::vector<char> HttpChunk::serialize(const void* data, size_t size)
 {
-    clear();
+    char sizeLine[24];
+    int length = std::snprintf(
+        sizeLine, sizeof(sizeLine), "%zx\r\n", size);
+
+    std::vector<char> chunk;
+    chunk.reserve(length + size + 2);
+
+    const char* bytes = static_cast<const char*>(data);
+
+    chunk.insert(chunk.end(), sizeLine, sizeLine + length);
+    chunk.insert(chunk.end(), bytes, bytes + size);
+    chunk.push_back('\r');
+    chunk.push_back('\n');
+
+    return chunk;
 }
 
-HttpContentReceiver::ChunkWork::~ChunkWork()
+std::vector<char> HttpChunk::serializeLast(const HttpHeader& trailers)
+{
+    std::vector<char> chunk;
+
+    StringWriter writer(chunk);
+    writer << "0\r\n";
+    trailers.serialize(writer);
+
+    // cut null
+    chunk.resize(chunk.size() - 1);
+
+    return chunk;
+}
+
+//----------------------------------------------------------------------------//
+// HttpFileSink
+//----------------------------------------------------------------------------//
+
+HttpFileSink::HttpFileSink()
+{
+    mFile = nullptr;
+    mBufferSize = 1024 * 1024;
+}
+
+HttpFileSink::~HttpFileSink()
 {
+    abort();
 }
 
-bool HttpContentReceiver::ChunkWork::setChunkSize(StringReader& reader)
+bool HttpFileSink::open(const std::string& fileName, size_t expectedSize)
 {
-    std::string chunkSizeStr;
+    abort();
+
+#ifdef SEV_OS_WIN
+    if (fopen_s(&mFile, fileName.c_str(), "wb") != 0)
+    {
+        mFile = nullptr;
+    }
+#else
+    mFile = std::fopen(fileName.c_str(), "wb");
+#endif
 
-    if (!reader.readString(chunkSizeStr, "\r\n"))
+    if (mFile == nullptr)
     {
         return false;
     }
 
-    reader.seekCur(+2);
+    attach(mFile, fileName, expectedSize);
+
+    return true;
+}
+
+bool HttpFileSink::openTemp(
+    const std::string& directory, size_t expectedSize)
+{
+    abort();
+
+    FILE* file = nullptr;
+    std::string fileName;
+
+#ifdef SEV_OS_WIN
+    for (int retry = 0; (file == nullptr) && (retry < 8); ++retry)
+    {
+        fileName = directory + "/subevent_";
+
+        for (auto b : Random::generateBytes(8))
+        {
+            char hex[3];
+            sprintf_s(hex, "%02x", b);
+            fileName += hex;
+        }
+
+        fileName += ".tmp";
+
+        int fd = -1;
+        if (_sopen_s(&fd, fileName.c_str(),
+            _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY,
+            _SH_DENYRW, _S_IREAD | _S_IWRITE) != 0)
+        {
+            if (errno == EEXIST)
+            {
+                continue;
+            }
+            return false;
+        }
+
+        file = _fdopen(fd, "wb");
+        if (file == nullptr)
+        {
+            _close(fd);
+            std::remove(fileName.c_str());
+            return false;
+        }
+    }
+#else
+    // mkstemp: O_CREAT | O_EXCL, mode 0600
+    std::vector<char> path(directory.begin(), directory.end());
+    const char* suffix = "/subevent_XXXXXX";
+    path.insert(path.end(), suffix, suffix + std::strlen(suffix) + 1);
+
+    int fd = mkstemp(&path[0]);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    fileName = &path[0];
+
+    file = fdopen(fd, "wb");
+    if (file == nullptr)
+    {
+        ::close(fd);
+        std::remove(fileName.c_str());
+        return false;
+    }
+#endif
+
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    attach(file, fileName, expectedSize);
+
+    return true;
+}
 
-    try
+void HttpFileSink::attach(
+    FILE* file, const std::string& fileName, size_t expectedSize)
+{
+    mFile = file;
+    mFileName = fileName;
+
+    // writes are already batched in mBuffer
+    std::setvbuf(mFile, nullptr, _IONBF, 0);
+
+#if defined(SEV_OS_LINUX) && defined(FALLOC_FL_KEEP_SIZE)
+    if (expectedSize > 0)
     {
-        mChunkSize = std::stoul(chunkSizeStr, nullptr, 16);
+        // reserve the blocks up front (best effort, no zero filling)
+        fallocate(fileno(mFile), FALLOC_FL_KEEP_SIZE,
+            0, static_cast<off_t>(expectedSize));
     }
-    catch (...)
+#else
+    (void)expectedSize;
+#endif
+
+    mBuffer.clear();
+    mBuffer.reserve(mBufferSize);
+}
+
+bool HttpFileSink::write(const char* data, size_t size)
+{
+    if (mFile == nullptr)
     {
         return false;
     }
 
-    mReceiveSize = 0;
+    if ((mBuffer.size() + size) > mBufferSize)
+    {
+        if (!flush())
+        {
+            return false;
+        }
+
+        if (size >= mBufferSize)
+        {
+            // large block, write through
+            return (std::fwrite(data, 1, size, mFile) == size);
+        }
+    }
+
+    mBuffer.insert(mBuffer.end(), data, data + size);
+
+    return true;
+}
+
+bool HttpFileSink::flush()
+{
+    if (mBuffer.empty())
+    {
+        return true;
+    }
+
+    size_t size = mBuffer.size();
+    bool result = (std::fwrite(&mBuffer[0], 1, size, mFile) == size);
+
+    mBuffer.clear();
+
+    return result;
+}
+
+bool HttpFileSink::close()
+{
+    if (mFile == nullptr)
+    {
+        return true;
+    }
+
+    bool result = flush();
+
+    if (std::fclose(mFile) != 0)
+    {
+        result = false;
+    }
+
+    mFile = nullptr;
+    mFileName.clear();
+    std::vector<char>().swap(mBuffer);
+
+    return result;
+}
+
+void HttpFileSink::abort()
+{
+    if (mFile == nullptr)
+    {
+        return;
+    }
+
+    std::fclose(mFile);
+    mFile = nullptr;
+
+    std::remove(mFileName.c_str());
+    mFileName.clear();
+    std::vector<char>().swap(mBuffer);
+}
+
+//----------------------------------------------------------------------------//
+// HttpContentReceiver::ChunkWork
+//----------------------------------------------------------------------------//
+
+HttpContentReceiver::ChunkWork::ChunkWork()
+{
+    clear();
+}
+
+HttpContentReceiver::ChunkWork::~ChunkWork()
+{
+}
+
+bool HttpContentReceiver::ChunkWork::parse(
+    ByteReader& reader, size_t& dataSize)
+{
+    static const size_t maxSizeDigits = sizeof(size_t) * 2;
+    static const size_t maxTrailerSize = 64 * 1024;
+
+    dataSize = 0;
+
+    const char* begin = reader.getPtr();
+    const char* end = begin + reader.getReadableSize();
+    const char* ptr = begin;
+
+    while ((ptr < end) && (mState != State::Done))
+    {
+        switch (mState)
+        {
+        case State::Size:
+        {
+            char c = *ptr;
+            size_t digit;
+
+            if ((c >= '0') && (c <= '9'))
+            {
+                digit = static_cast<size_t>(c - '0');
+            }
+            else if ((c >= 'a') && (c <= 'f'))
+            {
+                digit = static_cast<size_t>(c - 'a' + 10);
+            }
+            else if ((c >= 'A') && (c <= 'F'))
+            {
+                digit = static_cast<size_t>(c - 'A' + 10);
+            }
+            else
+            {
+                if (!mSizeSeen)
+                {
+                    // no size
+                    return false;
+                }
+
+                if (c == '\r')
+                {
+                    mState = State::SizeLf;
+                }
+                else if ((c == ';') || (c == ' ') || (c == '\t'))
+                {
+                    mState = State::Extension;
+                }
+                else
+                {
+                    return false;
+                }
+
+                ++ptr;
+                break;
+            }
+
+            mSizeSeen = true;
+
+            if (((mDigits != 0) || (digit != 0)) &&
+                (++mDigits > maxSizeDigits))
+            {
+                // too large
+                return false;
+            }
+
+            mChunkSize = (mChunkSize << 4) | digit;
+            ++ptr;
+            break;
+        }
+        case State::Extension:
+        case State::Trailer:
+        {
+            // ignored up to CR
+            const char* cr = static_cast<const char*>(
+                std::memchr(ptr, '\r', end - ptr));
+
+            size_t size = ((cr != nullptr) ? cr : end) - ptr;
+
+            if (mState == State::Trailer)
+            {
+                mTrailerSize += size;
+
+                if (mTrailerSize > maxTrailerSize)
+                {
+                    return false;
+                }
+            }
+
+            if (cr == nullptr)
+            {
+                ptr = end;
+                break;
+            }
+
+            mState = ((mState == State::Extension) ?
+                State::SizeLf : State::TrailerLf);
+            ptr = cr + 1;
+            break;
+        }
+        case State::SizeLf:
+            if (*ptr++ != '\n')
+            {
+                return false;
+            }
+
+            mDigits = 0;
+            mSizeSeen = false;
+            mState = ((mChunkSize == 0) ?
+                State::TrailerStart : State::Data);
+            break;
+        case State::Data:
+            dataSize = std::min(
+                mChunkSize, static_cast<size_t>(end - ptr));
+            reader.seekCur(static_cast<int32_t>(ptr - begin));
+            return true;
+        case State::DataCr:
+            if (*ptr++ != '\r')
+            {
+                return false;
+            }
+
+            mState = State::DataLf;
+            break;
+        case State::DataLf:
+            if (*ptr++ != '\n')
+            {
+                return false;
+            }
+
+            mState = State::Size;
+            break;
+        case State::TrailerStart:
+            if (*ptr == '\r')
+            {
+                mState = State::LastLf;
+                ++ptr;
+            }
+            else
+            {
+                mState = State::Trailer;
+            }
+            break;
+        case State::TrailerLf:
+            if (*ptr++ != '\n')
+            {
+                return false;
+            }
+
+            mState = State::TrailerStart;
+            break;
+        case State::LastLf:
+            if (*ptr++ != '\n')
+            {
+                return false;
+            }
+
+            // done
+            mState = State::Done;
+            break;
+        default:
+            return false;
+        }
+    }
+
+    reader.seekCur(static_cast<int32_t>(ptr - begin));
 
     return true;
 }
@@ -1550,6 +1973,35 @@ HttpContentReceiver::~HttpContentReceiver()
 
 bool HttpContentReceiver::init(const HttpMessage& message)
 {
+#ifdef SEV_SUPPORTS_ZLIB
+    if (mDecompression)
+    {
+        const std::string& contentEncoding =
+            message.getHeader().get(HttpHeaderField::ContentEncoding);
+
+        if (String::iequals(contentEncoding, "gzip") ||
+            String::iequals(contentEncoding, "x-gzip") ||
+            String::iequals(contentEncoding, "deflate"))
+        {
+            if (mInflater == nullptr)
+            {
+                mInflater.reset(new Inflater());
+            }
+
+            bool result = (mInflater->isInitialized() ?
+                mInflater->reset() :
+                mInflater->init(CompressionFormat::Gzip));
+
+            if (!result)
+            {
+                return false;
+            }
+
+            mInflating = true;
+        }
+    }
+#endif
+
     std::string transferEncoding =
         message.getHeader().get(
             HttpHeaderField::TransferEncoding);
@@ -1570,6 +2022,26 @@ bool HttpContentReceiver::init(const HttpMessage& message)
         }
 
         setContentLength((size_t)contentLength);
+
+        if ((mFileName.empty()) && (mContentHandler == nullptr))
+        {
+            // avoid regrowing the buffer for each received block
+            static const size_t maxReserveSize = 16 * 1024 * 1024;
+
+            size_t reserveSize = mSize;
+
+            if ((mMaxMemorySize != 0) && (reserveSize > mMaxMemorySize))
+            {
+                reserveSize = mMaxMemorySize;
+            }
+
+            if (reserveSize > maxReserveSize)
+            {
+                reserveSize = maxReserveSize;
+            }
+
+            mData.reserve(reserveSize);
+        }
     }
 
     return true;
@@ -1579,30 +2051,51 @@ bool HttpContentReceiver::onReceive(StringReader& reader)
 {
     while (!reader.isEnd())
     {
+        size_t size;
+
         if (mChunkWork.isRunning())
         {
-            if (mChunkWork.getChunkSize() == 0)
+            if (!mChunkWork.parse(reader, size))
             {
-                if (!mChunkWork.setChunkSize(reader))
-                {
-                    return false;
-                }
+                mFileSink.abort();
+                return false;
+            }
 
-                if (mChunkWork.getChunkSize() == 0)
-                {
-                    // done!!!
-                    mChunkWork.clear();
-                    break;
-                }
+            if (size == 0)
+            {
+                // need more data, or done
+                break;
+            }
+
+            mChunkWork.consume(size);
+        }
+        else
+        {
+            if (mReceiveSize >= mSize)
+            {
+                break;
             }
+
+            size = std::min(
+                reader.getReadableSize(), mSize - mReceiveSize);
+
+            mReceiveSize += size;
         }
-        else if (mReceiveSize >= mSize)
+
+        if (!deserialize(reader.getPtr(), size))
         {
-            break;
+            mFileSink.abort();
+            return false;
         }
 
-        if (!deserialize(reader))
+        reader.seekCur(static_cast<int32_t>(size));
+    }
+
+    if (mFileSink.isOpen() && isCompleted())
+    {
+        if (!mFileSink.close())
         {
+            mFileSink.abort();
             return false;
         }
     }
@@ -1610,79 +2103,85 @@ bool HttpContentReceiver::onReceive(StringReader& reader)
     return true;
 }
 
-bool HttpContentReceiver::deserialize(ByteReader& reader)
+bool HttpContentReceiver::deserialize(const char* data, size_t size)
 {
-    size_t size = reader.getReadableSize();
-
-    if (mChunkWork.isRunning())
+#ifdef SEV_SUPPORTS_ZLIB
+    if (mInflating)
     {
-        size_t chunkSize =
-            mChunkWork.getRemaining();
+        mInflateBuffer.clear();
+
+        // what is left of the limit (at least 1, 0 is unlimited)
+        size_t maxOutputSize = 0;
 
-        if (size > chunkSize)
+        if (mMaxDecodedSize != 0)
         {
-            size = chunkSize;
+            maxOutputSize = (mOutputSize < mMaxDecodedSize) ?
+                (mMaxDecodedSize - mOutputSize) : 1;
         }
 
-        mChunkWork.updateSize(size);
-    }
-    else
-    {
-        if (mSize != 0)
+        bool result = mInflater->inflate(
+            data, size, mInflateBuffer, maxOutputSize);
+
+        if ((mMaxDecodedSize != 0) &&
+            ((mOutputSize + mInflateBuffer.size()) > mMaxDecodedSize))
         {
-            size_t remaining = mSize - mReceiveSize;
+            // too large
+            mDecodedSizeExceeded = true;
+            return false;
+        }
 
-            if (size > remaining)
-            {
-                size = remaining;
-            }
+        if (!result)
+        {
+            return false;
         }
 
-        mReceiveSize += size;
-    }
+        if (mInflateBuffer.empty())
+        {
+            return true;
+        }
 
-    if (size == 0)
-    {
-        return true;
+        return output(&mInflateBuffer[0], mInflateBuffer.size());
     }
+#endif
 
-    if (!mFileName.empty())
-    {
-        // output to file
-
-        bool result = false;
+    return output(data, size);
+}
 
-        std::ofstream ofs(mFileName,
-            (std::ios::out | std::ios::app | std::ios::binary));
+bool HttpContentReceiver::output(const char* data, size_t size)
+{
+    mOutputSize += size;
 
-        if (ofs.is_open())
+    if ((mContentHandler == nullptr) &&
+        (mFileName.empty()) &&
+        (mMaxMemorySize != 0) &&
+        ((mData.size() + size) > mMaxMemorySize))
+    {
+        // too large for memory
+        if (!spill())
         {
-            ofs.write(reader.getPtr(), size);
-
-            result = !ofs.bad();
-            ofs.close();
+            return false;
         }
+    }
 
-        if (!result)
+    if (mContentHandler != nullptr)
+    {
+        // output to handler
+        mContentHandler(data, size);
+    }
+    else if (!mFileName.empty())
+    {
+        // output to file
+        if (!writeFile(data, size))
         {
-            std::remove(mFileName.c_str());
             return false;
         }
-        else
-        {
-            reader.seekCur(static_cast<int32_t>(size));
-        }
     }
     else
     {
         // output to memory buffer
-
         try
         {
-            size_t index = mData.size();
-
-            mData.resize(mData.size() + size);
-            reader.readBytes(&mData[index], size);
+            mData.insert(mData.end(), data, data + size);
         }
         catch (...)
         {
@@ -1690,12 +2189,67 @@ bool HttpContentReceiver::deserialize(ByteReader& reader)
         }
     }
 
-    if (!reader.isEnd() && mChunkWork.isRunning())
+    return true;
+}
+
+bool HttpContentReceiver::writeFile(const char* data, size_t size)
+{
+    if (!mFileSink.isOpen())
+    {
+        size_t expectedSize =
+            (mChunkWork.isRunning() ? 0 : mSize);
+
+        if (!mFileSink.open(mFileName, expectedSize))
+        {
+            return false;
+        }
+    }
+
+    if (!mFileSink.write(data, size))
     {
-        // skip CRLF
-        reader.seekCur(+2);
+        mFileSink.abort();
+        return false;
+    }
+
+    return true;
+}
+
+bool HttpContentReceiver::spill()
+{
+    std::string directory = mTempDirectory;
+
+    if (directory.empty())
+    {
+#ifdef SEV_OS_WIN
+        directory = ".";
+#else
+        const char* tmpDir = std::getenv("TMPDIR");
+        directory = ((tmpDir != nullptr) ? tmpDir : "/tmp");
+#endif
+    }
+
+    // created exclusively, the directory may be shared with others
+    size_t expectedSize =
+        (mChunkWork.isRunning() ? 0 : mSize);
+
+    if (!mFileSink.openTemp(directory, expectedSize))
+    {
+        return false;
     }
 
+    mFileName = mFileSink.getFileName();
+    mSpilled = true;
+
+    if (!mData.empty())
+    {
+        if (!writeFile(&mData[0], mData.size()))
+        {
+            return false;
+        }
+    }
+
+    std::vector<char>().swap(mData);
+
     return true;
 }
 
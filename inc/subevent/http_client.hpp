@@ -5,10 +5,14 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <chrono>
+#include <future>
 #include <functional>
+#include <unordered_set>
 
 #include <subevent/std.hpp>
 #include <subevent/string_io.hpp>
+#include <subevent/timer.hpp>
 #include <subevent/tcp.hpp>
 #include <subevent/http.hpp>
 
@@ -21,6 +25,60 @@ typedef std::shared_ptr<HttpClient> HttpClientPtr;
 
 typedef std::function<
     void(const HttpClientPtr&, int32_t)> HttpResponseHandler;
+typedef std::function<
+    void(const HttpClientPtr&)> HttpRequestBodyWriter;
+typedef std::function<
+    void(const HttpClientPtr&)> HttpClientCloseHandler;
+typedef std::function<
+    void(const HttpClientPtr&, HttpResponse&, int32_t)> HttpPipelineHandler;
+
+struct HttpResult
+{
+    HttpResult()
+        : errorCode(0)
+    {
+    }
+
+    int32_t errorCode;
+    HttpResponse response;
+};
+
+//----------------------------------------------------------------------------//
+// HttpRedirectChain
+//----------------------------------------------------------------------------//
+
+// the redirects followed for one request
+class HttpRedirectChain
+{
+public:
+    SEV_DECL HttpRedirectChain();
+
+public:
+    // starts timing the next hop
+    SEV_DECL void startHop(bool reused);
+
+    // records the redirect response of url, then points url and req
+    // to its Location. returns 0, -8801 (loop), -8802 (invalid Location),
+    // -8803 (no OpenSSL) or -8804 (more than maxRedirects).
+    SEV_DECL int32_t follow(
+        HttpUrl& url, HttpRequest& req,
+        const HttpResponse& res, uint32_t maxRedirects);
+
+    // moves the hops to the last response if any
+    SEV_DECL void finish(const HttpUrl& url, HttpResponse& res);
+
+    SEV_DECL void clear();
+
+    SEV_DECL static bool isRedirect(uint16_t statusCode);
+
+private:
+    SEV_DECL void addHop(const HttpUrl& url, uint16_t statusCode);
+
+    std::unordered_set<std::string> mVisited;
+    std::vector<HttpRedirectHop> mHops;
+    std::chrono::steady_clock::time_point mHopStart;
+    bool mHopReused;
+};
 
 //----------------------------------------------------------------------------//
 // HttpClient
@@ -46,8 +104,18 @@ public:
         SEV_DECL void clear()
         {
             allowRedirect = true;
+            maxRedirects = 20;
             timeout = 60 * 1000;
             outputFileName.clear();
+            contentHandler = nullptr;
+            maxBodyMemorySize = 0;
+            tempDirectory.clear();
+            bodyWriter = nullptr;
+            maxRetries = 1;
+#ifdef SEV_SUPPORTS_ZLIB
+            decompression = false;
+            maxDecodedSize = 64 * 1024 * 1024;
+#endif
             sockOption.clear();
 #ifdef SEV_SUPPORTS_SSL
             sslCtx.reset();
@@ -55,8 +123,40 @@ public:
         }
 
         bool allowRedirect;
+
+        // redirects followed for one request
+        uint32_t maxRedirects;
+
         std::string outputFileName;
         uint32_t timeout;
+
+        // streaming mode (the body is not stored in the response)
+        HttpContentHandler contentHandler;
+
+        // larger bodies are stored in a temporary file
+        // (HttpResponse::getBodyFileName()). 0: unlimited
+        size_t maxBodyMemorySize;
+        std::string tempDirectory;
+
+        // streaming request (Transfer-Encoding: chunked)
+        // called after the header has been sent. write the body
+        // with sendHttpRequestChunk() and finish with sendHttpRequestEnd().
+        HttpRequestBodyWriter bodyWriter;
+
+        // times an idempotent request is sent again after the
+        // connection has been lost: by pipeline(), or by request()
+        // when a kept-alive connection closes before the response
+        uint32_t maxRetries;
+
+#ifdef SEV_SUPPORTS_ZLIB
+        // sends Accept-Encoding (unless set) and
+        // decodes gzip / deflate response bodies
+        bool decompression;
+
+        // a decoded body beyond this fails with -8503. 0: unlimited
+        size_t maxDecodedSize;
+#endif
+
         SocketOption sockOption;
 #ifdef SEV_SUPPORTS_SSL
         SslContextPtr sslCtx;
@@ -69,12 +169,40 @@ public:
         const HttpResponseHandler& responseHandler,
         const RequestOption& option = RequestOption());
 
+    // synchronous, runs on HttpClientRuntime
     SEV_DECL static int32_t request(
         const std::string& url,
         const HttpRequest& req,
         HttpResponse& res,
         const RequestOption& option = RequestOption());
 
+    SEV_DECL static std::future<HttpResult> requestAsync(
+        const std::string& url,
+        const HttpRequest& req,
+        const RequestOption& option = RequestOption());
+
+    // queues the request on this keep-alive connection. requests are
+    // written back-to-back and the responses are matched in order.
+    // the url must have the origin of the queued requests.
+    // option.timeout applies to each request, redirects are not
+    // followed and bodyWriter is not supported.
+    SEV_DECL bool pipeline(
+        const std::string& url,
+        const HttpRequest& req,
+        const HttpPipelineHandler& pipelineHandler,
+        const RequestOption& option = RequestOption());
+
+    SEV_DECL size_t getPipelineSize() const
+    {
+        return mPipeline.size();
+    }
+
+    SEV_DECL int32_t sendHttpRequestChunk(
+        const void* data, size_t size);
+
+    SEV_DECL int32_t sendHttpRequestEnd(
+        const HttpHeader& trailers = HttpHeader());
+
 public:
 
     // WebSocket
@@ -89,6 +217,20 @@ public:
 
     SEV_DECL WsChannelPtr upgradeToWebSocket();
 
+#ifdef SEV_SUPPORTS_ZLIB
+    // requestWsHandshake() offers permessage-deflate
+    SEV_DECL void enableWsDeflate(
+        const WsDeflateOption& option = WsDeflateOption())
+    {
+        mWsDeflateOption = std::make_shared<WsDeflateOption>(option);
+    }
+
+    SEV_DECL void disableWsDeflate()
+    {
+        mWsDeflateOption.reset();
+    }
+#endif
+
 public:
     SEV_DECL const HttpUrl& getUrl() const
     {
@@ -110,6 +252,14 @@ public:
         return mResponse;
     }
 
+    // called when the kept-alive connection is closed by the peer
+    // while no request is running
+    SEV_DECL void setIdleCloseHandler(
+        const HttpClientCloseHandler& idleCloseHandler)
+    {
+        mIdleCloseHandler = idleCloseHandler;
+    }
+
     SEV_DECL const HttpResponse& getResponse() const
     {
         return mResponse;
@@ -118,10 +268,28 @@ public:
 private:
     SEV_DECL HttpClient(NetWorker* netWorker);
 
+    struct PipelineItem
+    {
+        HttpUrl url;
+        HttpRequest request;
+        HttpPipelineHandler handler;
+        RequestOption option;
+        std::chrono::steady_clock::time_point expires;
+        bool sent;
+        uint32_t retries;
+    };
+
     SEV_DECL void start();
+    SEV_DECL void resetContentReceiver();
+    SEV_DECL int32_t getReceiveError() const;
+    SEV_DECL bool retryRequest();
     SEV_DECL void sendHttpRequest();
+    SEV_DECL static void serializeRequest(
+        HttpRequest& req, const HttpUrl& url,
+        const RequestOption& option, std::vector<char>& data);
     SEV_DECL bool isResponseCompleted() const;
     SEV_DECL bool onHttpResponse(StringReader& reader);
+    SEV_DECL void setResponseBody();
     SEV_DECL int32_t redirect();
 
     SEV_DECL void onTcpConnect(const TcpClientPtr& client, int32_t errorCode);
@@ -130,6 +298,15 @@ private:
     SEV_DECL void onTcpClose(const TcpChannelPtr& channel);
     SEV_DECL void onResponse(int32_t errorCode);
 
+    SEV_DECL void connectPipeline();
+    SEV_DECL void sendPipeline();
+    SEV_DECL void restartPipeline();
+    SEV_DECL void completePipeline(int32_t errorCode);
+    SEV_DECL void failPipeline(PipelineItem& item, int32_t errorCode);
+    SEV_DECL void onPipelineReceive(std::vector<char>&& data);
+    SEV_DECL void onPipelineTimer();
+    SEV_DECL void startPipelineTimer();
+
     SEV_DECL Socket* createSocket(
         const IpEndPoint& peerEndPoint, int32_t& errorCode) override;
 
@@ -140,8 +317,13 @@ private:
 private:
     bool mRunning;
 
+    // the request went out on a kept-alive connection
+    bool mReused;
+    uint32_t mRetries;
+
     HttpUrl mUrl;
     HttpResponseHandler mResponseHandler;
+    HttpClientCloseHandler mIdleCloseHandler;
     RequestOption mOption;
 
     HttpRequest mRequest;
@@ -149,10 +331,19 @@ private:
 
     HttpContentReceiver mContentReceiver;
     std::vector<char> mResponseTempBuffer;
-    std::list<std::string> mRedirectHashes;
+    HttpRedirectChain mRedirectChain;
+
+    std::list<PipelineItem> mPipeline;
+    bool mPipelineConnecting;
+    Timer mPipelineTimer;
+    std::chrono::steady_clock::time_point mPipelineExpires;
 
     WsChannelPtr mWsChannel;
 
+#ifdef SEV_SUPPORTS_ZLIB
+    WsDeflateOptionPtr mWsDeflateOption;
+#endif
+
 #ifdef SEV_SUPPORTS_SSL
     SslContextPtr mSslContext;
 #endif
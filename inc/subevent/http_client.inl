@@ -7,12 +7,135 @@
 #include <iterator>
 
 #include <subevent/http_client.hpp>
+#include <subevent/http_client_runtime.hpp>
 #include <subevent/network.hpp>
 #include <subevent/http.hpp>
 #include <subevent/ssl_socket.hpp>
 
 SEV_NS_BEGIN
 
+//----------------------------------------------------------------------------//
+// HttpRedirectChain
+//----------------------------------------------------------------------------//
+
+HttpRedirectChain::HttpRedirectChain()
+{
+    mHopReused = false;
+}
+
+void HttpRedirectChain::startHop(bool reused)
+{
+    mHopStart = std::chrono::steady_clock::now();
+    mHopReused = reused;
+}
+
+int32_t HttpRedirectChain::follow(
+    HttpUrl& url, HttpRequest& req,
+    const HttpResponse& res, uint32_t maxRedirects)
+{
+    if (mHops.size() >= maxRedirects)
+    {
+        return -8804;
+    }
+
+    std::string visited =
+        url.getScheme() +
+        url.getHost() +
+        std::to_string(url.getPort()) +
+        url.getPath();
+
+    if (!mVisited.insert(std::move(visited)).second)
+    {
+        // loop
+        return -8801;
+    }
+
+    addHop(url, res.getStatusCode());
+
+    const std::string& location =
+        res.getHeader().get(HttpHeaderField::Location);
+
+    HttpUrl next;
+
+    if ((location.size() >= 2) &&
+        (location[0] == '/') && (location[1] != '/'))
+    {
+        // relative to the origin
+        if (!next.parse(url.composeOrigin() + location))
+        {
+            return -8802;
+        }
+    }
+    else if (!next.parse(location) || next.getHost().empty())
+    {
+        return -8802;
+    }
+
+#ifndef SEV_SUPPORTS_SSL
+    if (next.isSecureScheme())
+    {
+        std::cerr <<
+            "[Subevent Error] OpenSSL is not installed." << std::endl;
+        return -8803;
+    }
+#endif
+
+    if (res.getStatusCode() == HttpStatusCode::SeeOther)
+    {
+        req.setMethod(HttpMethod::Get);
+        req.getBody().clear();
+        req.getHeader().remove(HttpHeaderField::ContentLength);
+    }
+
+    req.setPath("");
+    req.getHeader().remove(HttpHeaderField::Host);
+
+    url = std::move(next);
+
+    return 0;
+}
+
+void HttpRedirectChain::finish(const HttpUrl& url, HttpResponse& res)
+{
+    if (mHops.empty())
+    {
+        return;
+    }
+
+    addHop(url, res.getStatusCode());
+
+    res.setRedirectHops(std::move(mHops));
+    mHops.clear();
+}
+
+void HttpRedirectChain::clear()
+{
+    mVisited.clear();
+    mHops.clear();
+    mHopReused = false;
+}
+
+bool HttpRedirectChain::isRedirect(uint16_t statusCode)
+{
+    return ((statusCode == HttpStatusCode::MovedPermanently) ||
+            (statusCode == HttpStatusCode::Found) ||
+            (statusCode == HttpStatusCode::SeeOther) ||
+            (statusCode == HttpStatusCode::TemporaryRedirect) ||
+            (statusCode == HttpStatusCode::PermanentRedirect));
+}
+
+void HttpRedirectChain::addHop(const HttpUrl& url, uint16_t statusCode)
+{
+    HttpRedirectHop hop;
+    hop.url = url.compose();
+    hop.statusCode = statusCode;
+    hop.elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - mHopStart);
+    hop.reused = mHopReused;
+
+    mHops.push_back(std::move(hop));
+}
+
 //----------------------------------------------------------------------------//
 // HttpClient
 //----------------------------------------------------------------------------//
@@ -21,6 +144,9 @@ HttpClient::HttpClient(NetWorker* netWorker)
     : TcpClient(netWorker)
 {
     mRunning = false;
+    mReused = false;
+    mRetries = 0;
+    mPipelineConnecting = false;
 }
 
 HttpClient::~HttpClient()
@@ -32,17 +158,17 @@ bool HttpClient::request(
     const HttpResponseHandler& responseHandler,
     const RequestOption& option)
 {
-    if (mRunning)
+    if (mRunning || !mPipeline.empty())
     {
         return false;
     }
 
-    mUrl.clear();
     mResponse.clear();
     mContentReceiver.clear();
     mResponseTempBuffer.clear();
     mOption.clear();
-    mRedirectHashes.clear();
+    mRedirectChain.clear();
+    mRetries = 0;
 
 #ifdef SEV_SUPPORTS_SSL
     mSslContext.reset();
@@ -57,6 +183,7 @@ bool HttpClient::request(
 
     if (!httpUrl.parse(url))
     {
+        mUrl.clear();
         return false;
     }
 
@@ -69,6 +196,7 @@ bool HttpClient::request(
     }
 #endif
 
+    // keep the connection to the same origin
     if ((httpUrl.getScheme() != mUrl.getScheme()) ||
         (httpUrl.getHost() != mUrl.getHost()) ||
         (httpUrl.getPort() != mUrl.getPort()))
@@ -79,7 +207,7 @@ bool HttpClient::request(
     mUrl = std::move(httpUrl);
     mResponseHandler = responseHandler;
     mOption = option;
-    mContentReceiver.setFileName(mOption.outputFileName);
+    resetContentReceiver();
 
     start();
 
@@ -92,69 +220,148 @@ int32_t HttpClient::request(
     HttpResponse& res,
     const RequestOption& option)
 {
-    if (req.getMethod().empty())
+    res.clear();
+
+    std::future<HttpResult> future = requestAsync(url, req, option);
+
+    HttpResult result;
+
+    try
     {
-        return -8601;
+        result = future.get();
+    }
+    catch (...)
+    {
+        // the runtime has been stopped
+        return -8604;
     }
 
-    int32_t result = -1;
+    res = std::move(result.response);
 
-    NetThread thread;
-    HttpClientPtr http = newInstance(&thread);
+    return result.errorCode;
+}
+
+std::future<HttpResult> HttpClient::requestAsync(
+    const std::string& url,
+    const HttpRequest& req,
+    const RequestOption& option)
+{
+    int32_t errorCode = 0;
+    HttpUrl httpUrl;
 
-    if (!http->mUrl.parse(url))
+    if (req.getMethod().empty())
     {
-        return -8602;
+        errorCode = -8601;
+    }
+    else if (!httpUrl.parse(url))
+    {
+        errorCode = -8602;
     }
-
 #ifndef SEV_SUPPORTS_SSL
-    if (http->mUrl.isSecureScheme())
+    else if (httpUrl.isSecureScheme())
     {
         std::cerr <<
             "[Subevent Error] OpenSSL is not installed." << std::endl;
-        return -8603;
+        errorCode = -8603;
     }
 #endif
 
-    if (!thread.start())
+    if (errorCode != 0)
     {
-        return -8604;
+        std::promise<HttpResult> promise;
+
+        HttpResult result;
+        result.errorCode = errorCode;
+        promise.set_value(std::move(result));
+
+        return promise.get_future();
     }
 
-    res.clear();
+    return HttpClientRuntime::getInstance().request(url, req, option);
+}
 
-    Semaphore sem;
+bool HttpClient::pipeline(
+    const std::string& url,
+    const HttpRequest& req,
+    const HttpPipelineHandler& pipelineHandler,
+    const RequestOption& option)
+{
+    if (mRunning ||
+        req.getMethod().empty() ||
+        (option.bodyWriter != nullptr))
+    {
+        return false;
+    }
+
+    HttpUrl httpUrl;
 
-    http->mRequest = req;
-    http->mOption = option;
-    http->mContentReceiver.setFileName(option.outputFileName);
-    http->mResponseHandler =
-        [&, http](const HttpClientPtr&, int32_t errorCode) {
+    if (!httpUrl.parse(url))
+    {
+        return false;
+    }
 
-        // response
-        result = errorCode;
-        res = std::move(http->mResponse);
+#ifndef SEV_SUPPORTS_SSL
+    if (httpUrl.isSecureScheme())
+    {
+        std::cerr <<
+            "[Subevent Error] OpenSSL is not installed." << std::endl;
+        return false;
+    }
+#endif
 
-        sem.post();
-    };
+    if (mPipeline.empty())
+    {
+        // keep the connection to the same origin
+        if (httpUrl.composeOrigin() != mUrl.composeOrigin())
+        {
+            close();
+        }
 
-    // start
-    thread.post([http]() {
-        http->start();
-    });
+        mUrl = httpUrl;
+    }
+    else if (httpUrl.composeOrigin() != mUrl.composeOrigin())
+    {
+        return false;
+    }
+
+    PipelineItem item;
+    item.url = std::move(httpUrl);
+    item.request = req;
+    item.handler = pipelineHandler;
+    item.option = option;
+    item.sent = false;
+    item.retries = 0;
 
-    // wait
-    if (sem.wait(option.timeout) == WaitResult::Timeout)
+    if (option.timeout != 0)
+    {
+        item.expires = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(option.timeout);
+    }
+    else
     {
-        result = -8604;
+        item.expires = std::chrono::steady_clock::time_point::max();
     }
 
-    thread.stop();
-    thread.wait();
+    bool earliest = (!mPipelineTimer.isRunning() ||
+        (item.expires < mPipelineExpires));
+
+    mPipeline.push_back(std::move(item));
+
+    if (!isClosed())
+    {
+        sendPipeline();
+    }
+    else if (!mPipelineConnecting)
+    {
+        connectPipeline();
+    }
 
-    http->mResponseHandler = nullptr;
+    if (earliest)
+    {
+        startPipelineTimer();
+    }
 
-    return result;
+    return true;
 }
 
 void HttpClient::start()
@@ -163,6 +370,9 @@ void HttpClient::start()
 
     getSocketOption() = mOption.sockOption;
 
+    mReused = !isClosed();
+    mRedirectChain.startHop(mReused);
+
     if (isClosed())
     {
         // connect
@@ -181,6 +391,32 @@ void HttpClient::start()
     }
 }
 
+void HttpClient::resetContentReceiver()
+{
+    mContentReceiver.clear();
+    mContentReceiver.setFileName(mOption.outputFileName);
+    mContentReceiver.setContentHandler(mOption.contentHandler);
+    mContentReceiver.setMaxMemorySize(
+        mOption.maxBodyMemorySize, mOption.tempDirectory);
+#ifdef SEV_SUPPORTS_ZLIB
+    mContentReceiver.setDecompression(
+        mOption.decompression, mOption.maxDecodedSize);
+#endif
+}
+
+int32_t HttpClient::getReceiveError() const
+{
+#ifdef SEV_SUPPORTS_ZLIB
+    if (mContentReceiver.isDecodedSizeExceeded())
+    {
+        // decoded body too large
+        return -8503;
+    }
+#endif
+
+    return -8502;
+}
+
 bool HttpClient::isResponseCompleted() const
 {
     if (mResponse.isEmpty())
@@ -202,49 +438,103 @@ bool HttpClient::isResponseCompleted() const
 }
 
 void HttpClient::sendHttpRequest()
+{
+    std::vector<char> requestData;
+
+    serializeRequest(mRequest, mUrl, mOption, requestData);
+
+    // send
+    int32_t result = send(
+        std::move(requestData),
+        SEV_BIND_2(this, HttpClient::onTcpSend));
+    if (result < 0)
+    {
+        // internal error
+        onResponse(result);
+        return;
+    }
+
+    if (mOption.bodyWriter != nullptr)
+    {
+        mOption.bodyWriter(
+            std::dynamic_pointer_cast<HttpClient>(shared_from_this()));
+    }
+}
+
+void HttpClient::serializeRequest(
+    HttpRequest& req, const HttpUrl& url,
+    const RequestOption& option, std::vector<char>& data)
 {
     // path
-    mRequest.setPath(mUrl.composePath());
+    req.setPath(url.composePath());
 
     // Host
-    if (!mRequest.getHeader().has(HttpHeaderField::Host))
+    if (!req.getHeader().has(HttpHeaderField::Host))
     {
-        mRequest.getHeader().add(
-            HttpHeaderField::Host, mUrl.getHost());
+        req.getHeader().add(
+            HttpHeaderField::Host, url.getHost());
     }
 
-    // Content-Length
-    if (!mRequest.getBody().empty())
+#ifdef SEV_SUPPORTS_ZLIB
+    // Accept-Encoding
+    if (option.decompression &&
+        !req.getHeader().has(HttpHeaderField::AcceptEncoding))
     {
-        mRequest.getHeader().setContentLength(
-            mRequest.getBody().size());
+        req.getHeader().add(
+            HttpHeaderField::AcceptEncoding, "gzip, deflate");
     }
+#endif
 
-    std::vector<char> requestData;
+    bool chunked = (option.bodyWriter != nullptr);
+
+    if (chunked)
+    {
+        // Transfer-Encoding
+        req.getHeader().remove(HttpHeaderField::ContentLength);
+        req.getHeader().set(
+            HttpHeaderField::TransferEncoding, "chunked");
+    }
+    else if (!req.getBody().empty())
+    {
+        // Content-Length
+        req.getHeader().setContentLength(
+            req.getBody().size());
+    }
 
     // serialize
-    StringWriter writer(requestData);
-    mRequest.serializeMessage(writer);
+    StringWriter writer(data);
+    req.serializeMessage(writer);
 
-    if (!mRequest.getBody().empty())
+    if (!chunked && !req.getBody().empty())
     {
-        mRequest.serializeBody(writer);
+        req.serializeBody(writer);
     }
     else
     {
         // cut null
-        requestData.resize(requestData.size() - 1);
+        data.resize(data.size() - 1);
     }
+}
 
-    // send
-    int32_t result = send(
-        std::move(requestData),
-        SEV_BIND_2(this, HttpClient::onTcpSend));
-    if (result < 0)
+int32_t HttpClient::sendHttpRequestChunk(
+    const void* data, size_t size)
+{
+    if (size == 0)
     {
-        // internal error
-        onResponse(result);
+        // a zero size chunk ends the body
+        return 0;
     }
+
+    return send(
+        HttpChunk::serialize(data, size),
+        SEV_BIND_2(this, HttpClient::onTcpSend));
+}
+
+int32_t HttpClient::sendHttpRequestEnd(const HttpHeader& trailers)
+{
+    return send(
+        HttpChunk::serializeLast(trailers),
+        SEV_BIND_2(this, HttpClient::onTcpSend));
 }
 
 Socket* HttpClient::createSocket(
@@ -259,11 +549,13 @@ Socket* HttpClient::createSocket(
 
         if (mSslContext == nullptr)
         {
-            mSslContext =
-                SslContext::newInstance(SSLv23_client_method());
+            mSslContext = SslContext::getDefaultClientContext();
         }
 
-        socket = new SecureSocket(mSslContext);
+        SecureSocket* secureSocket = new SecureSocket(mSslContext);
+        secureSocket->setSessionKey(mUrl.composeOrigin());
+
+        socket = secureSocket;
     }
     else
     {
@@ -294,62 +586,45 @@ Socket* HttpClient::createSocket(
 
 int32_t HttpClient::redirect()
 {
-    std::string redirctHash =
-        mUrl.getScheme() +
-        mUrl.getHost() +
-        std::to_string(mUrl.getPort()) +
-        mUrl.getPath();
+    std::string origin = mUrl.composeOrigin();
 
-    if (std::find(
-        mRedirectHashes.begin(),
-        mRedirectHashes.end(),
-        redirctHash) != mRedirectHashes.end())
-    {
-        // loop
-        return -8801;
-    }
+    const std::string& connection =
+        mResponse.getHeader().get(HttpHeaderField::Connection);
 
-    mRedirectHashes.push_back(redirctHash);
+    bool keepAlive = !isClosed() &&
+        ((mResponse.getProtocol() == HttpProtocol::v1_0) ?
+            String::iequals(connection, "keep-alive") :
+            !String::iequals(connection, "close"));
 
-    const std::string& location =
-        mResponse.getHeader().get(HttpHeaderField::Location);
+    int32_t errorCode = mRedirectChain.follow(
+        mUrl, mRequest, mResponse, mOption.maxRedirects);
 
-    if (!mUrl.parse(location))
+    if (errorCode != 0)
     {
-        return -8802;
+        return errorCode;
     }
 
-#ifndef SEV_SUPPORTS_SSL
-    if (mUrl.isSecureScheme())
+    mResponse.clear();
+    mResponseTempBuffer.clear();
+
+    if (mContentReceiver.isSpilled())
     {
-        std::cerr <<
-            "[Suvevent Error] OpenSSL is not installed." << std::endl;
-        return -8803;
+        std::remove(mContentReceiver.getFileName().c_str());
     }
-#endif
 
-    uint16_t statusCode = mResponse.getStatusCode();
-
-    if (statusCode == HttpStatusCode::SeeOther)
+    if (!mOption.outputFileName.empty())
     {
-        mRequest.setMethod(HttpMethod::Get);
-        mRequest.getBody().clear();
+        std::remove(mOption.outputFileName.c_str());
     }
 
-    mRequest.setPath("");
-    mRequest.getHeader().remove(HttpHeaderField::Host);
-
-    mResponse.clear();
-    mContentReceiver.clear();
-    mResponseTempBuffer.clear();
+    resetContentReceiver();
 
-    if (!mOption.outputFileName.empty())
+    if (!keepAlive || (mUrl.composeOrigin() != origin))
     {
-        std::remove(mOption.outputFileName.c_str());
-        mContentReceiver.setFileName(mOption.outputFileName);
+        close();
     }
 
-    close();
+    // on the same connection if it is kept alive
     start();
 
     return 0;
@@ -359,28 +634,34 @@ void HttpClient::onResponse(int32_t errorCode)
 {
     if (errorCode != 0)
     {
+        mContentReceiver.abort();
         close();
     }
-    else if ((errorCode == 0) && mOption.allowRedirect)
+    else if ((errorCode == 0) && mOption.allowRedirect &&
+        HttpRedirectChain::isRedirect(mResponse.getStatusCode()))
     {
-        uint16_t statusCode = mResponse.getStatusCode();
+        // redirect
+        errorCode = redirect();
 
-        if ((statusCode == HttpStatusCode::MovedPermanently) ||
-            (statusCode == HttpStatusCode::Found) ||
-            (statusCode == HttpStatusCode::SeeOther) ||
-            (statusCode == HttpStatusCode::TemporaryRedirect) ||
-            (statusCode == HttpStatusCode::PermanentRedirect))
+        if (errorCode == 0)
         {
-            // redirect
-            errorCode = redirect();
-
-            if (errorCode == 0)
-            {
-                return;
-            }
+            return;
         }
     }
 
+    if (errorCode == 0)
+    {
+        mRedirectChain.finish(mUrl, mResponse);
+    }
+
+    if ((errorCode == 0) &&
+        String::iequals(mResponse.getHeader().get(
+            HttpHeaderField::Connection), "close"))
+    {
+        // not reusable
+        close();
+    }
+
     mRunning = false;
 
     if (mResponseHandler != nullptr)
@@ -398,6 +679,27 @@ void HttpClient::onResponse(int32_t errorCode)
 void HttpClient::onTcpConnect(
     const TcpClientPtr& /* client */, int32_t errorCode)
 {
+    if (mPipelineConnecting)
+    {
+        mPipelineConnecting = false;
+
+        if (errorCode != 0)
+        {
+            // connect error
+            while (!mPipeline.empty())
+            {
+                failPipeline(mPipeline.front(), errorCode);
+                mPipeline.pop_front();
+            }
+
+            mPipelineTimer.cancel();
+            return;
+        }
+
+        sendPipeline();
+        return;
+    }
+
     if (errorCode != 0)
     {
         // connect error
@@ -412,7 +714,16 @@ void HttpClient::onTcpConnect(
 void HttpClient::onTcpSend(
     const TcpChannelPtr& /* channel */, int32_t errorCode)
 {
-    if (errorCode != 0)
+    if (errorCode == 0)
+    {
+        return;
+    }
+
+    if (!mPipeline.empty())
+    {
+        restartPipeline();
+    }
+    else
     {
         onResponse(errorCode);
     }
@@ -422,6 +733,12 @@ void HttpClient::onTcpReceive(const TcpChannelPtr& channel)
 {
     auto response = channel->receiveAll();
 
+    if (!mPipeline.empty())
+    {
+        onPipelineReceive(std::move(response));
+        return;
+    }
+
     if (isResponseCompleted() || response.empty())
     {
         return;
@@ -447,12 +764,56 @@ void HttpClient::onTcpReceive(const TcpChannelPtr& channel)
 
 void HttpClient::onTcpClose(const TcpChannelPtr& /* channel */)
 {
-    if (!isResponseCompleted())
+    if (!mPipeline.empty())
     {
-        onResponse(-1);
+        restartPipeline();
+    }
+    else if (mRunning && !isResponseCompleted())
+    {
+        if (!retryRequest())
+        {
+            onResponse(-1);
+        }
+    }
+    else if (!mRunning && (mIdleCloseHandler != nullptr))
+    {
+        mIdleCloseHandler(
+            std::dynamic_pointer_cast<HttpClient>(shared_from_this()));
     }
 }
 
+bool HttpClient::retryRequest()
+{
+    // the server may have closed the kept-alive connection
+    // before the request got there, nothing has been received
+    if (!mReused ||
+        !mResponse.isEmpty() ||
+        !mResponseTempBuffer.empty() ||
+        !mRequest.isIdempotent() ||
+        (mOption.bodyWriter != nullptr) ||
+        (mRetries >= mOption.maxRetries))
+    {
+        return false;
+    }
+
+    ++mRetries;
+    resetContentReceiver();
+
+    HttpClientPtr self(
+        std::dynamic_pointer_cast<HttpClient>(shared_from_this()));
+
+    // reconnect outside of the socket event
+    mNetWorker->postTask([self]() {
+
+        if (self->mRunning && self->isClosed())
+        {
+            self->start();
+        }
+    });
+
+    return true;
+}
+
 bool HttpClient::onHttpResponse(StringReader& reader)
 {
     // header
@@ -484,13 +845,13 @@ bool HttpClient::onHttpResponse(StringReader& reader)
     // body
     if (!mContentReceiver.onReceive(reader))
     {
-        onResponse(-8502);
+        onResponse(getReceiveError());
         return true;
     }
 
     if (isResponseCompleted())
     {
-        mResponse.setBody(mContentReceiver.getData());
+        setResponseBody();
 
         // success
         onResponse(0);
@@ -499,6 +860,357 @@ bool HttpClient::onHttpResponse(StringReader& reader)
     return true;
 }
 
+void HttpClient::setResponseBody()
+{
+    if (mContentReceiver.isDecoded())
+    {
+        // the header describes the body as it is returned
+        HttpHeader& header = mResponse.getHeader();
+
+        header.remove(HttpHeaderField::ContentEncoding);
+
+        if (header.has(HttpHeaderField::ContentLength))
+        {
+            header.setContentLength(mContentReceiver.getOutputSize());
+        }
+    }
+
+    if (mContentReceiver.isSpilled())
+    {
+        mResponse.setBodyFileName(
+            mContentReceiver.getFileName());
+    }
+    else
+    {
+        mResponse.setBody(mContentReceiver.getData());
+    }
+}
+
+void HttpClient::connectPipeline()
+{
+    mPipelineConnecting = true;
+
+    // the first request decides the connection options
+    mOption = mPipeline.front().option;
+    getSocketOption() = mOption.sockOption;
+
+#ifdef SEV_SUPPORTS_SSL
+    mSslContext.reset();
+#endif
+
+    connect(mUrl.getHost(), mUrl.getPort(),
+        SEV_BIND_2(this, HttpClient::onTcpConnect));
+
+    setReceiveHandler(
+        SEV_BIND_1(this, HttpClient::onTcpReceive));
+    setCloseHandler(
+        SEV_BIND_1(this, HttpClient::onTcpClose));
+}
+
+void HttpClient::sendPipeline()
+{
+    std::vector<char> requestData;
+
+    // written back-to-back
+    for (auto& item : mPipeline)
+    {
+        if (item.sent)
+        {
+            continue;
+        }
+
+        std::vector<char> data;
+        serializeRequest(item.request, item.url, item.option, data);
+
+        requestData.insert(requestData.end(), data.begin(), data.end());
+
+        item.sent = true;
+    }
+
+    if (requestData.empty())
+    {
+        return;
+    }
+
+    int32_t result = send(
+        std::move(requestData),
+        SEV_BIND_2(this, HttpClient::onTcpSend));
+    if (result < 0)
+    {
+        restartPipeline();
+    }
+}
+
+void HttpClient::restartPipeline()
+{
+    mContentReceiver.abort();
+    mResponse.clear();
+    mResponseTempBuffer.clear();
+
+    close();
+
+    for (auto it = mPipeline.begin(); it != mPipeline.end();)
+    {
+        if (!it->sent)
+        {
+            ++it;
+        }
+        else if (it->request.isIdempotent() &&
+            (it->retries < it->option.maxRetries))
+        {
+            // send again
+            ++it->retries;
+            it->sent = false;
+            ++it;
+        }
+        else
+        {
+            // may have been processed by the server
+            failPipeline(*it, -8504);
+            it = mPipeline.erase(it);
+        }
+    }
+
+    if (mPipeline.empty())
+    {
+        mPipelineTimer.cancel();
+        return;
+    }
+
+    HttpClientPtr self(
+        std::dynamic_pointer_cast<HttpClient>(shared_from_this()));
+
+    // reconnect outside of the socket event
+    mNetWorker->postTask([self]() {
+
+        if (self->isClosed() &&
+            !self->mPipelineConnecting &&
+            !self->mPipeline.empty())
+        {
+            self->connectPipeline();
+        }
+    });
+}
+
+void HttpClient::completePipeline(int32_t errorCode)
+{
+    PipelineItem item = std::move(mPipeline.front());
+    mPipeline.pop_front();
+
+    if (errorCode == 0)
+    {
+        setResponseBody();
+    }
+    else
+    {
+        mContentReceiver.abort();
+        mResponse.clear();
+    }
+
+    if (item.handler != nullptr)
+    {
+        HttpClientPtr self(
+            std::dynamic_pointer_cast<HttpClient>(shared_from_this()));
+        HttpPipelineHandler handler = item.handler;
+        std::shared_ptr<HttpResponse> response(
+            new HttpResponse(std::move(mResponse)));
+
+        mNetWorker->postTask([self, handler, response, errorCode]() {
+            handler(self, *response, errorCode);
+        });
+    }
+
+    mResponse.clear();
+}
+
+void HttpClient::failPipeline(PipelineItem& item, int32_t errorCode)
+{
+    if (item.handler == nullptr)
+    {
+        return;
+    }
+
+    HttpClientPtr self(
+        std::dynamic_pointer_cast<HttpClient>(shared_from_this()));
+    HttpPipelineHandler handler = item.handler;
+
+    mNetWorker->postTask([self, handler, errorCode]() {
+        HttpResponse response;
+        handler(self, response, errorCode);
+    });
+}
+
+void HttpClient::onPipelineReceive(std::vector<char>&& data)
+{
+    if (data.empty())
+    {
+        return;
+    }
+
+    if (!mResponseTempBuffer.empty())
+    {
+        mResponseTempBuffer.insert(
+            mResponseTempBuffer.end(), data.begin(), data.end());
+
+        data = std::move(mResponseTempBuffer);
+        mResponseTempBuffer.clear();
+    }
+
+    StringReader reader(data);
+
+    while (!mPipeline.empty() && !reader.isEnd())
+    {
+        PipelineItem& item = mPipeline.front();
+
+        if (!item.sent)
+        {
+            // unexpected data
+            break;
+        }
+
+        // header
+        if (mResponse.isEmpty())
+        {
+            size_t cur = reader.getCur();
+
+            try
+            {
+                if (!mResponse.deserializeMessage(reader))
+                {
+                    // not completed
+                    mResponse.clear();
+                    mResponseTempBuffer.assign(
+                        data.begin() + cur, data.end());
+                    return;
+                }
+
+                if ((mResponse.getStatusCode() >= 100) &&
+                    (mResponse.getStatusCode() < 200))
+                {
+                    // informational
+                    mResponse.clear();
+                    continue;
+                }
+
+                mOption = item.option;
+                resetContentReceiver();
+
+                if (!mContentReceiver.init(mResponse))
+                {
+                    completePipeline(-8500);
+                    restartPipeline();
+                    return;
+                }
+            }
+            catch (...)
+            {
+                // invalid data
+                completePipeline(-8501);
+                restartPipeline();
+                return;
+            }
+        }
+
+        // body
+        if (item.request.getMethod() != HttpMethod::Head)
+        {
+            if (!mContentReceiver.onReceive(reader))
+            {
+                completePipeline(getReceiveError());
+                restartPipeline();
+                return;
+            }
+
+            if (!mContentReceiver.isCompleted())
+            {
+                break;
+            }
+        }
+
+        bool closing = String::iequals(mResponse.getHeader().get(
+            HttpHeaderField::Connection), "close");
+
+        // success
+        completePipeline(0);
+
+        if (closing)
+        {
+            // the rest is sent on a new connection
+            restartPipeline();
+            return;
+        }
+    }
+}
+
+void HttpClient::onPipelineTimer()
+{
+    auto now = std::chrono::steady_clock::now();
+    bool broken = false;
+
+    for (auto it = mPipeline.begin(); it != mPipeline.end();)
+    {
+        if (it->expires <= now)
+        {
+            if (it->sent)
+            {
+                // the responses can no longer be matched
+                broken = true;
+            }
+
+            failPipeline(*it, -8503);
+            it = mPipeline.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    if (broken)
+    {
+        restartPipeline();
+    }
+    else
+    {
+        startPipelineTimer();
+    }
+}
+
+void HttpClient::startPipelineTimer()
+{
+    mPipelineTimer.cancel();
+
+    auto expires = std::chrono::steady_clock::time_point::max();
+
+    for (const auto& item : mPipeline)
+    {
+        if (item.expires < expires)
+        {
+            expires = item.expires;
+        }
+    }
+
+    if (expires == std::chrono::steady_clock::time_point::max())
+    {
+        return;
+    }
+
+    mPipelineExpires = expires;
+
+    auto now = std::chrono::steady_clock::now();
+    uint32_t msec = 0;
+
+    if (expires > now)
+    {
+        msec = static_cast<uint32_t>(std::chrono::duration_cast<
+            std::chrono::milliseconds>(expires - now).count()) + 1;
+    }
+
+    mPipelineTimer.start(msec, false, [this](Timer*) {
+        onPipelineTimer();
+    });
+}
+
 bool HttpClient::requestWsHandshake(
     const std::string& url,
     const std::string& protocols,
@@ -533,6 +1245,21 @@ bool HttpClient::requestWsHandshake(
     httpRequest.getHeader().set(
         HttpHeaderField::SecWebSocketKey, b64);
 
+#ifdef SEV_SUPPORTS_ZLIB
+    httpRequest.getHeader().remove(HttpHeaderField::SecWebSocketExtensions);
+
+    if (mWsDeflateOption != nullptr)
+    {
+        std::string offer = WsDeflate::offer(*mWsDeflateOption);
+
+        if (!offer.empty())
+        {
+            httpRequest.getHeader().set(
+                HttpHeaderField::SecWebSocketExtensions, offer);
+        }
+    }
+#endif
+
     return request(url, responseHandler, option);
 }
 
@@ -559,6 +1286,29 @@ bool HttpClient::verifyWsHandshakeResponse() const
         return false;
     }
 
+#ifdef SEV_SUPPORTS_ZLIB
+    WsDeflatePtr deflate;
+
+    if (!WsDeflate::confirm(
+        getResponse().getHeader().get(
+            HttpHeaderField::SecWebSocketExtensions),
+        getRequest().getHeader().has(
+            HttpHeaderField::SecWebSocketExtensions) ?
+                mWsDeflateOption.get() : nullptr,
+        deflate))
+    {
+        // extension not offered
+        return false;
+    }
+#else
+    if (!getResponse().getHeader().get(
+        HttpHeaderField::SecWebSocketExtensions).empty())
+    {
+        // extension not offered
+        return false;
+    }
+#endif
+
     return true;
 }
 
@@ -571,6 +1321,17 @@ WsChannelPtr HttpClient::upgradeToWebSocket()
 
     mWsChannel = WsChannel::newInstance(shared_from_this(), true);
 
+#ifdef SEV_SUPPORTS_ZLIB
+    if (getRequest().getHeader().has(
+        HttpHeaderField::SecWebSocketExtensions))
+    {
+        WsDeflate::confirm(
+            getResponse().getHeader().get(
+                HttpHeaderField::SecWebSocketExtensions),
+            mWsDeflateOption.get(), mWsChannel->mDeflate);
+    }
+#endif
+
     return mWsChannel;
 }
 
@@ -0,0 +1,161 @@
+#ifndef SUBEVENT_HTTP_CLIENT_POOL_HPP
+#define SUBEVENT_HTTP_CLIENT_POOL_HPP
+
+#include <map>
+#include <list>
+#include <string>
+#include <memory>
+#include <chrono>
+
+#include <subevent/std.hpp>
+#include <subevent/timer.hpp>
+#include <subevent/http.hpp>
+#include <subevent/http_client.hpp>
+
+SEV_NS_BEGIN
+
+class HttpClientPool;
+
+typedef std::shared_ptr<HttpClientPool> HttpClientPoolPtr;
+
+//----------------------------------------------------------------------------//
+// HttpClientPool
+//----------------------------------------------------------------------------//
+
+// keep-alive connections grouped by origin (scheme://host:port).
+// belongs to one NetWorker, use one pool per worker thread.
+class HttpClientPool : public std::enable_shared_from_this<HttpClientPool>
+{
+public:
+    struct Option
+    {
+        SEV_DECL Option()
+        {
+            clear();
+        }
+
+        SEV_DECL void clear()
+        {
+            maxConnectionsPerOrigin = 6;
+            maxQueueSize = 0;
+            idleTimeout = 30 * 1000;
+        }
+
+        size_t maxConnectionsPerOrigin;
+
+        // requests waiting for a connection per origin. 0: unlimited
+        size_t maxQueueSize;
+
+        // msec
+        uint32_t idleTimeout;
+    };
+
+    SEV_DECL static HttpClientPoolPtr newInstance(
+        NetWorker* netWorker, const Option& option = Option())
+    {
+        return HttpClientPoolPtr(new HttpClientPool(netWorker, option));
+    }
+
+    SEV_DECL ~HttpClientPool();
+
+public:
+    // the request is queued if the origin has no free connection.
+    // the handler is called with the pooled client, which must not
+    // be kept after the handler returns.
+    // redirects are followed on connections of the pool, the handler
+    // is called with nullptr and -8703 if the next hop is not accepted.
+    SEV_DECL bool request(
+        const std::string& url,
+        const HttpRequest& request,
+        const HttpResponseHandler& responseHandler,
+        const HttpClient::RequestOption& option =
+            HttpClient::RequestOption());
+
+    // closes the idle connections and cancels the queued requests
+    SEV_DECL void close();
+
+public:
+    SEV_DECL size_t getIdleCount(const std::string& origin) const;
+    SEV_DECL size_t getActiveCount(const std::string& origin) const;
+    SEV_DECL size_t getQueueSize(const std::string& origin) const;
+
+    SEV_DECL const Option& getOption() const
+    {
+        return mOption;
+    }
+
+private:
+    SEV_DECL HttpClientPool(NetWorker* netWorker, const Option& option);
+
+    // a request whose redirects the pool follows, so that each hop
+    // gets a connection of its own origin
+    struct Redirect
+    {
+        HttpClient::RequestOption option;
+        HttpRedirectChain chain;
+    };
+
+    typedef std::shared_ptr<Redirect> RedirectPtr;
+
+    struct PendingRequest
+    {
+        std::string url;
+        HttpRequest request;
+        HttpResponseHandler responseHandler;
+        HttpClient::RequestOption option;
+        RedirectPtr redirect;
+    };
+
+    struct IdleClient
+    {
+        HttpClientPtr client;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    struct Origin
+    {
+        Origin()
+            : active(0)
+        {
+        }
+
+        std::list<IdleClient> idle;
+        size_t active;
+        std::list<PendingRequest> queue;
+    };
+
+    SEV_DECL bool submit(PendingRequest& pending);
+    SEV_DECL HttpClientPtr acquire(Origin& origin);
+    SEV_DECL bool dispatch(
+        const std::string& key,
+        const HttpClientPtr& client,
+        PendingRequest& pending);
+    SEV_DECL void dispatchQueue(
+        const std::string& key, HttpClientPtr client);
+    SEV_DECL void onResponse(
+        const std::string& key,
+        const HttpClientPtr& client,
+        int32_t errorCode);
+    SEV_DECL int32_t followRedirect(
+        const std::string& key,
+        const HttpClientPtr& client,
+        const RedirectPtr& redirect,
+        const HttpResponseHandler& responseHandler);
+    SEV_DECL void onIdleClose(
+        const std::string& key, const HttpClientPtr& client);
+    SEV_DECL void onIdleTimer();
+    SEV_DECL void removeIfUnused(const std::string& key);
+
+    HttpClientPool() = delete;
+    HttpClientPool(const HttpClientPool&) = delete;
+    HttpClientPool& operator=(const HttpClientPool&) = delete;
+
+    NetWorker* mNetWorker;
+    Option mOption;
+    std::map<std::string, Origin> mOrigins;
+    Timer mIdleTimer;
+};
+
+SEV_NS_END
+
+#endif // SUBEVENT_HTTP_CLIENT_POOL_HPP
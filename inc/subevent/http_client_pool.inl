@@ -0,0 +1,501 @@
+#ifndef SUBEVENT_HTTP_CLIENT_POOL_INL
+#define SUBEVENT_HTTP_CLIENT_POOL_INL
+
+#include <cassert>
+
+#include <subevent/http_client_pool.hpp>
+#include <subevent/network.hpp>
+
+SEV_NS_BEGIN
+
+//----------------------------------------------------------------------------//
+// HttpClientPool
+//----------------------------------------------------------------------------//
+
+HttpClientPool::HttpClientPool(NetWorker* netWorker, const Option& option)
+    : mNetWorker(netWorker), mOption(option)
+{
+    if (mOption.maxConnectionsPerOrigin == 0)
+    {
+        mOption.maxConnectionsPerOrigin = 1;
+    }
+}
+
+HttpClientPool::~HttpClientPool()
+{
+    for (auto& origin : mOrigins)
+    {
+        for (auto& idle : origin.second.idle)
+        {
+            idle.client->setIdleCloseHandler(nullptr);
+            idle.client->close();
+        }
+    }
+}
+
+bool HttpClientPool::request(
+    const std::string& url,
+    const HttpRequest& request,
+    const HttpResponseHandler& responseHandler,
+    const HttpClient::RequestOption& option)
+{
+    assert(NetWorker::getCurrent() == mNetWorker);
+
+    if (request.getMethod().empty())
+    {
+        return false;
+    }
+
+    PendingRequest pending;
+    pending.url = url;
+    pending.request = request;
+    pending.responseHandler = responseHandler;
+    pending.option = option;
+
+    return submit(pending);
+}
+
+void HttpClientPool::close()
+{
+    assert(NetWorker::getCurrent() == mNetWorker);
+
+    std::list<PendingRequest> canceled;
+
+    for (auto& origin : mOrigins)
+    {
+        for (auto& idle : origin.second.idle)
+        {
+            idle.client->setIdleCloseHandler(nullptr);
+            idle.client->close();
+        }
+
+        origin.second.idle.clear();
+
+        canceled.splice(canceled.end(), origin.second.queue);
+    }
+
+    for (auto it = mOrigins.begin(); it != mOrigins.end();)
+    {
+        if (it->second.active == 0)
+        {
+            it = mOrigins.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    mIdleTimer.cancel();
+
+    for (auto& pending : canceled)
+    {
+        if (pending.responseHandler != nullptr)
+        {
+            pending.responseHandler(nullptr, -8702);
+        }
+    }
+}
+
+size_t HttpClientPool::getIdleCount(const std::string& origin) const
+{
+    auto it = mOrigins.find(origin);
+    return ((it != mOrigins.end()) ? it->second.idle.size() : 0);
+}
+
+size_t HttpClientPool::getActiveCount(const std::string& origin) const
+{
+    auto it = mOrigins.find(origin);
+    return ((it != mOrigins.end()) ? it->second.active : 0);
+}
+
+size_t HttpClientPool::getQueueSize(const std::string& origin) const
+{
+    auto it = mOrigins.find(origin);
+    return ((it != mOrigins.end()) ? it->second.queue.size() : 0);
+}
+
+bool HttpClientPool::submit(PendingRequest& pending)
+{
+    HttpUrl httpUrl;
+
+    if (!httpUrl.parse(pending.url))
+    {
+        return false;
+    }
+
+    std::string key = httpUrl.composeOrigin();
+    Origin& origin = mOrigins[key];
+
+    HttpClientPtr client = acquire(origin);
+
+    if (client == nullptr)
+    {
+        if ((origin.idle.size() + origin.active) >=
+            mOption.maxConnectionsPerOrigin)
+        {
+            if ((mOption.maxQueueSize != 0) &&
+                (origin.queue.size() >= mOption.maxQueueSize))
+            {
+                // saturated
+                return false;
+            }
+
+            origin.queue.push_back(std::move(pending));
+
+            return true;
+        }
+
+        client = HttpClient::newInstance(mNetWorker);
+    }
+
+    if (!dispatch(key, client, pending))
+    {
+        client->close();
+        removeIfUnused(key);
+        return false;
+    }
+
+    return true;
+}
+
+HttpClientPtr HttpClientPool::acquire(Origin& origin)
+{
+    while (!origin.idle.empty())
+    {
+        // most recently used first
+        HttpClientPtr client = std::move(origin.idle.back().client);
+        origin.idle.pop_back();
+
+        if (!client->isClosed())
+        {
+            return client;
+        }
+
+        client->setIdleCloseHandler(nullptr);
+    }
+
+    return nullptr;
+}
+
+bool HttpClientPool::dispatch(
+    const std::string& key,
+    const HttpClientPtr& client,
+    PendingRequest& pending)
+{
+    std::weak_ptr<HttpClientPool> weakPool(shared_from_this());
+    HttpResponseHandler responseHandler = pending.responseHandler;
+    RedirectPtr redirect = std::move(pending.redirect);
+
+    if ((redirect == nullptr) && pending.option.allowRedirect)
+    {
+        redirect = std::make_shared<Redirect>();
+        redirect->option = pending.option;
+    }
+
+    if (redirect != nullptr)
+    {
+        // followed here instead of by the client
+        pending.option.allowRedirect = false;
+        redirect->chain.startHop(!client->isClosed());
+    }
+
+    client->getRequest() = std::move(pending.request);
+
+    bool result = client->request(pending.url,
+        [weakPool, key, responseHandler, redirect](
+            const HttpClientPtr& client, int32_t errorCode) {
+
+        HttpClientPoolPtr pool = weakPool.lock();
+
+        if ((redirect != nullptr) && (errorCode == 0))
+        {
+            if ((pool != nullptr) && HttpRedirectChain::isRedirect(
+                client->getResponse().getStatusCode()))
+            {
+                errorCode = pool->followRedirect(
+                    key, client, redirect, responseHandler);
+
+                if (errorCode == 0)
+                {
+                    // the next hop has the handler
+                    return;
+                }
+            }
+            else
+            {
+                redirect->chain.finish(
+                    client->getUrl(), client->getResponse());
+            }
+        }
+
+        if (responseHandler != nullptr)
+        {
+            responseHandler(client, errorCode);
+        }
+
+        if (pool != nullptr)
+        {
+            pool->onResponse(key, client, errorCode);
+        }
+        else
+        {
+            client->setIdleCloseHandler(nullptr);
+        }
+
+    }, pending.option);
+
+    if (!result)
+    {
+        return false;
+    }
+
+    client->setIdleCloseHandler(
+        [weakPool, key](const HttpClientPtr& client) {
+
+        HttpClientPoolPtr pool = weakPool.lock();
+
+        if (pool != nullptr)
+        {
+            pool->onIdleClose(key, client);
+        }
+    });
+
+    ++mOrigins[key].active;
+
+    return true;
+}
+
+void HttpClientPool::dispatchQueue(
+    const std::string& key, HttpClientPtr client)
+{
+    for (;;)
+    {
+        auto it = mOrigins.find(key);
+        if (it == mOrigins.end())
+        {
+            return;
+        }
+
+        Origin& origin = it->second;
+
+        if (origin.queue.empty())
+        {
+            break;
+        }
+
+        if (client == nullptr)
+        {
+            client = acquire(origin);
+        }
+
+        if (client == nullptr)
+        {
+            if ((origin.idle.size() + origin.active) >=
+                mOption.maxConnectionsPerOrigin)
+            {
+                break;
+            }
+
+            client = HttpClient::newInstance(mNetWorker);
+        }
+
+        PendingRequest pending = std::move(origin.queue.front());
+        origin.queue.pop_front();
+
+        if (!dispatch(key, client, pending))
+        {
+            client->close();
+
+            if (pending.responseHandler != nullptr)
+            {
+                pending.responseHandler(client, -8701);
+            }
+        }
+
+        client = nullptr;
+    }
+
+    if (client != nullptr)
+    {
+        // keep alive
+        IdleClient idle;
+        idle.client = client;
+        idle.since = std::chrono::steady_clock::now();
+
+        mOrigins[key].idle.push_back(std::move(idle));
+
+        if (!mIdleTimer.isRunning() && (mOption.idleTimeout != 0))
+        {
+            uint32_t interval = mOption.idleTimeout / 4;
+
+            mIdleTimer.start(((interval > 100) ? interval : 100), true,
+                [this](Timer*) {
+                    onIdleTimer();
+                });
+        }
+    }
+}
+
+void HttpClientPool::onResponse(
+    const std::string& key,
+    const HttpClientPtr& client,
+    int32_t errorCode)
+{
+    auto it = mOrigins.find(key);
+    if (it == mOrigins.end())
+    {
+        client->setIdleCloseHandler(nullptr);
+        client->close();
+        return;
+    }
+
+    if (it->second.active > 0)
+    {
+        --it->second.active;
+    }
+
+    HttpClientPtr reusable = client;
+
+    if ((errorCode != 0) ||
+        client->isClosed() ||
+        (client->getUrl().composeOrigin() != key))
+    {
+        // broken or redirected to another origin
+        client->setIdleCloseHandler(nullptr);
+        client->close();
+        reusable = nullptr;
+    }
+
+    dispatchQueue(key, reusable);
+    removeIfUnused(key);
+}
+
+int32_t HttpClientPool::followRedirect(
+    const std::string& key,
+    const HttpClientPtr& client,
+    const RedirectPtr& redirect,
+    const HttpResponseHandler& responseHandler)
+{
+    HttpUrl url = client->getUrl();
+
+    PendingRequest pending;
+    pending.request = client->getRequest();
+
+    int32_t errorCode = redirect->chain.follow(
+        url, pending.request, client->getResponse(),
+        redirect->option.maxRedirects);
+
+    if (errorCode != 0)
+    {
+        return errorCode;
+    }
+
+    pending.url = url.compose();
+    pending.responseHandler = responseHandler;
+    pending.option = redirect->option;
+    pending.redirect = redirect;
+
+    // the connection goes back to its origin first,
+    // the next hop may be on the same one
+    onResponse(key, client, 0);
+
+    if (!submit(pending) && (responseHandler != nullptr))
+    {
+        responseHandler(nullptr, -8703);
+    }
+
+    return 0;
+}
+
+void HttpClientPool::onIdleClose(
+    const std::string& key, const HttpClientPtr& client)
+{
+    client->setIdleCloseHandler(nullptr);
+
+    auto it = mOrigins.find(key);
+    if (it == mOrigins.end())
+    {
+        return;
+    }
+
+    it->second.idle.remove_if([&client](const IdleClient& idle) {
+        return (idle.client == client);
+    });
+
+    removeIfUnused(key);
+}
+
+void HttpClientPool::onIdleTimer()
+{
+    auto now = std::chrono::steady_clock::now();
+    auto timeout = std::chrono::milliseconds(mOption.idleTimeout);
+
+    std::list<HttpClientPtr> expired;
+
+    for (auto it = mOrigins.begin(); it != mOrigins.end();)
+    {
+        auto& idleList = it->second.idle;
+
+        // oldest first
+        while (!idleList.empty() &&
+            ((now - idleList.front().since) >= timeout))
+        {
+            expired.push_back(std::move(idleList.front().client));
+            idleList.pop_front();
+        }
+
+        if (it->second.idle.empty() &&
+            it->second.queue.empty() &&
+            (it->second.active == 0))
+        {
+            it = mOrigins.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    for (auto& client : expired)
+    {
+        client->setIdleCloseHandler(nullptr);
+        client->close();
+    }
+
+    bool hasIdle = false;
+
+    for (const auto& origin : mOrigins)
+    {
+        if (!origin.second.idle.empty())
+        {
+            hasIdle = true;
+            break;
+        }
+    }
+
+    if (!hasIdle)
+    {
+        mIdleTimer.cancel();
+    }
+}
+
+void HttpClientPool::removeIfUnused(const std::string& key)
+{
+    auto it = mOrigins.find(key);
+    if (it == mOrigins.end())
+    {
+        return;
+    }
+
+    if (it->second.idle.empty() &&
+        it->second.queue.empty() &&
+        (it->second.active == 0))
+    {
+        mOrigins.erase(it);
+    }
+}
+
+SEV_NS_END
+
+#endif // SUBEVENT_HTTP_CLIENT_POOL_INL
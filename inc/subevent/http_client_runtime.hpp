@@ -0,0 +1,98 @@
+#ifndef SUBEVENT_HTTP_CLIENT_RUNTIME_HPP
+#define SUBEVENT_HTTP_CLIENT_RUNTIME_HPP
+
+#include <map>
+#include <list>
+#include <mutex>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <subevent/std.hpp>
+#include <subevent/network.hpp>
+#include <subevent/http.hpp>
+#include <subevent/http_client.hpp>
+
+SEV_NS_BEGIN
+
+//----------------------------------------------------------------------------//
+// HttpClientRuntime
+//----------------------------------------------------------------------------//
+
+// background threads for the synchronous HttpClient::request().
+// started on first use and shared by the whole process.
+// kept-alive connections are reused per origin on each thread.
+class HttpClientRuntime
+{
+public:
+    SEV_DECL static HttpClientRuntime& getInstance();
+
+    SEV_DECL ~HttpClientRuntime();
+
+public:
+    // option.timeout covers the whole request (0: no timeout).
+    // must not be waited for on one of the runtime threads.
+    SEV_DECL std::future<HttpResult> request(
+        const std::string& url,
+        const HttpRequest& req,
+        const HttpClient::RequestOption& option);
+
+    // takes effect if called before the first request
+    SEV_DECL void setThreadCount(size_t count);
+
+    // idle connections kept per origin and thread
+    SEV_DECL void setMaxIdlePerOrigin(size_t count);
+
+    SEV_DECL size_t getThreadCount() const;
+
+private:
+    SEV_DECL HttpClientRuntime();
+
+    struct Worker
+    {
+        NetThread thread;
+        std::map<std::string, std::list<HttpClientPtr>> idle;
+    };
+
+    struct Call
+    {
+        Call()
+            : done(false), timer(nullptr)
+        {
+        }
+
+        std::promise<HttpResult> promise;
+        bool done;
+        Timer* timer;
+    };
+
+    typedef std::shared_ptr<Call> CallPtr;
+
+    SEV_DECL bool startThreads();
+    SEV_DECL void start(
+        Worker* worker,
+        const CallPtr& call,
+        const std::string& url,
+        const HttpRequest& req,
+        const HttpClient::RequestOption& option);
+    SEV_DECL void release(
+        Worker* worker, const HttpClientPtr& client);
+
+    SEV_DECL static void complete(
+        const CallPtr& call, int32_t errorCode, HttpResponse&& res);
+
+    HttpClientRuntime(const HttpClientRuntime&) = delete;
+    HttpClientRuntime& operator=(const HttpClientRuntime&) = delete;
+
+    mutable std::mutex mMutex;
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    std::atomic<size_t> mNext;
+    size_t mThreadCount;
+    std::atomic<size_t> mMaxIdlePerOrigin;
+};
+
+SEV_NS_END
+
+#endif // SUBEVENT_HTTP_CLIENT_RUNTIME_HPP
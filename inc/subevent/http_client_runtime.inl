@@ -0,0 +1,244 @@
+#ifndef SUBEVENT_HTTP_CLIENT_RUNTIME_INL
+#define SUBEVENT_HTTP_CLIENT_RUNTIME_INL
+
+#include <subevent/http_client_runtime.hpp>
+#include <subevent/timer.hpp>
+
+SEV_NS_BEGIN
+
+//----------------------------------------------------------------------------//
+// HttpClientRuntime
+//----------------------------------------------------------------------------//
+
+HttpClientRuntime& HttpClientRuntime::getInstance()
+{
+    static HttpClientRuntime runtime;
+    return runtime;
+}
+
+HttpClientRuntime::HttpClientRuntime()
+    : mNext(0), mMaxIdlePerOrigin(4)
+{
+    mThreadCount = 2;
+}
+
+HttpClientRuntime::~HttpClientRuntime()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    for (auto& worker : mWorkers)
+    {
+        Worker* target = worker.get();
+
+        bool result = worker->thread.post([target]() {
+
+            // closes the kept-alive connections
+            target->idle.clear();
+
+            target->thread.stop();
+        });
+
+        if (!result)
+        {
+            worker->thread.stop();
+        }
+
+        worker->thread.wait();
+    }
+
+    mWorkers.clear();
+}
+
+std::future<HttpResult> HttpClientRuntime::request(
+    const std::string& url,
+    const HttpRequest& req,
+    const HttpClient::RequestOption& option)
+{
+    CallPtr call = std::make_shared<Call>();
+    std::future<HttpResult> future = call->promise.get_future();
+
+    Worker* worker = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        if (mWorkers.empty() && !startThreads())
+        {
+            complete(call, -8604, HttpResponse());
+            return future;
+        }
+
+        worker = mWorkers[mNext++ % mWorkers.size()].get();
+    }
+
+    bool result = worker->thread.post(
+        [this, worker, call, url, req, option]() {
+        start(worker, call, url, req, option);
+    });
+
+    if (!result)
+    {
+        complete(call, -8604, HttpResponse());
+    }
+
+    return future;
+}
+
+void HttpClientRuntime::setThreadCount(size_t count)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mThreadCount = ((count > 0) ? count : 1);
+}
+
+void HttpClientRuntime::setMaxIdlePerOrigin(size_t count)
+{
+    mMaxIdlePerOrigin = count;
+}
+
+size_t HttpClientRuntime::getThreadCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return (mWorkers.empty() ? mThreadCount : mWorkers.size());
+}
+
+bool HttpClientRuntime::startThreads()
+{
+    for (size_t index = 0; index < mThreadCount; ++index)
+    {
+        std::unique_ptr<Worker> worker(new Worker());
+
+        worker->thread.setName(
+            "HttpClientRuntime" + std::to_string(index));
+
+        if (!worker->thread.start())
+        {
+            break;
+        }
+
+        mWorkers.push_back(std::move(worker));
+    }
+
+    return !mWorkers.empty();
+}
+
+void HttpClientRuntime::start(
+    Worker* worker,
+    const CallPtr& call,
+    const std::string& url,
+    const HttpRequest& req,
+    const HttpClient::RequestOption& option)
+{
+    HttpUrl httpUrl;
+
+    if (!httpUrl.parse(url))
+    {
+        complete(call, -8602, HttpResponse());
+        return;
+    }
+
+    std::string origin = httpUrl.composeOrigin();
+    HttpClientPtr client;
+
+    // kept-alive connection
+    auto& idleList = worker->idle[origin];
+
+    while (!idleList.empty())
+    {
+        client = std::move(idleList.back());
+        idleList.pop_back();
+
+        if (!client->isClosed())
+        {
+            break;
+        }
+
+        client = nullptr;
+    }
+
+    if (client == nullptr)
+    {
+        client = HttpClient::newInstance(&worker->thread);
+    }
+
+    client->getRequest() = req;
+
+    bool result = client->request(url,
+        [this, worker, call](const HttpClientPtr& client, int32_t errorCode) {
+
+        if (errorCode == 0)
+        {
+            release(worker, client);
+        }
+
+        if (call->done)
+        {
+            // timed out
+            return;
+        }
+
+        complete(call, errorCode, std::move(client->getResponse()));
+    }, option);
+
+    if (!result)
+    {
+        complete(call, -8602, HttpResponse());
+        return;
+    }
+
+    if (option.timeout != 0)
+    {
+        call->timer = new Timer();
+        call->timer->start(option.timeout, false, [call, client](Timer*) {
+
+            if (call->done)
+            {
+                return;
+            }
+
+            // a connect in flight holds the client too
+            client->cancelConnect();
+            client->close();
+
+            complete(call, -8604, HttpResponse());
+        });
+    }
+}
+
+void HttpClientRuntime::release(
+    Worker* worker, const HttpClientPtr& client)
+{
+    if (client->isClosed())
+    {
+        return;
+    }
+
+    auto& idleList = worker->idle[client->getUrl().composeOrigin()];
+
+    if (idleList.size() >= mMaxIdlePerOrigin)
+    {
+        client->close();
+        return;
+    }
+
+    idleList.push_back(client);
+}
+
+void HttpClientRuntime::complete(
+    const CallPtr& call, int32_t errorCode, HttpResponse&& res)
+{
+    call->done = true;
+
+    // the timer handler keeps the client
+    delete call->timer;
+    call->timer = nullptr;
+
+    HttpResult result;
+    result.errorCode = errorCode;
+    result.response = std::move(res);
+
+    call->promise.set_value(std::move(result));
+}
+
+SEV_NS_END
+
+#endif // SUBEVENT_HTTP_CLIENT_RUNTIME_INL
@@ -2,6 +2,7 @@
 #define SUBEVENT_HTTP_SERVER_HPP
 
 #include <map>
+#include <list>
 #include <string>
 #include <memory>
 #include <functional>
@@ -10,6 +11,7 @@
 #include <subevent/tcp.hpp>
 #include <subevent/http.hpp>
 #include <subevent/ssl_socket.hpp>
+#include <subevent/compression.hpp>
 
 SEV_NS_BEGIN
 
@@ -24,6 +26,8 @@ typedef std::shared_ptr<HttpServer> HttpServerPtr;
 
 typedef std::function<
     void(const HttpChannelPtr&)> HttpRequestHandler;
+typedef std::function<
+    void(const HttpChannelPtr&, const char*, size_t)> HttpBodyHandler;
 
 //----------------------------------------------------------------------------//
 // HttpHandlerMap
@@ -74,6 +78,85 @@ private:
     HttpRequestHandler mDefaultHandler;
 };
 
+#ifdef SEV_SUPPORTS_ZLIB
+
+//----------------------------------------------------------------------------//
+// HttpCompressor
+//----------------------------------------------------------------------------//
+
+struct HttpCompressionOption
+{
+    SEV_DECL HttpCompressionOption()
+    {
+        clear();
+    }
+
+    SEV_DECL void clear()
+    {
+        minSize = 1024;
+        level = Z_DEFAULT_COMPRESSION;
+        mimeTypes = {
+            "text/*",
+            "application/json",
+            "application/javascript",
+            "application/xml",
+            "image/svg+xml"
+        };
+    }
+
+    // smaller bodies are sent as is
+    size_t minSize;
+    int level;
+
+    // Content-Type allowlist ("type/*" matches the whole type)
+    std::list<std::string> mimeTypes;
+};
+
+class HttpCompressor;
+
+typedef std::shared_ptr<HttpCompressor> HttpCompressorPtr;
+
+// response compression negotiated from Accept-Encoding.
+// owns a deflate stream pool, so use one instance per thread.
+class HttpCompressor
+{
+public:
+    SEV_DECL static HttpCompressorPtr newInstance(
+        const HttpCompressionOption& option = HttpCompressionOption())
+    {
+        return std::make_shared<HttpCompressor>(option);
+    }
+
+    SEV_DECL explicit HttpCompressor(const HttpCompressionOption& option);
+    SEV_DECL ~HttpCompressor();
+
+public:
+    // compresses the response body if the request accepts it.
+    // returns false if the response is left as is.
+    SEV_DECL bool compress(
+        const HttpRequest& request, HttpResponse& response);
+
+    SEV_DECL const HttpCompressionOption& getOption() const
+    {
+        return mOption;
+    }
+
+public:
+    SEV_DECL static bool negotiate(
+        const std::string& acceptEncoding, CompressionFormat& format);
+
+private:
+    SEV_DECL bool isCompressible(const std::string& contentType) const;
+
+    HttpCompressor(const HttpCompressor&) = delete;
+    HttpCompressor& operator=(const HttpCompressor&) = delete;
+
+    HttpCompressionOption mOption;
+    DeflaterPool mPool;
+};
+
+#endif // SEV_SUPPORTS_ZLIB
+
 //----------------------------------------------------------------------------//
 // HttpChannel
 //----------------------------------------------------------------------------//
@@ -93,6 +176,29 @@ public:
         const std::string& body = "",
         const TcpSendHandler& sendHandler = nullptr);
 
+    // the body is sent from the file through the send queue,
+    // by sendfile() on plain and kernel TLS sockets.
+    SEV_DECL int32_t sendHttpResponseFile(
+        HttpResponse& response,
+        const std::string& fileName,
+        const TcpSendHandler& sendHandler = nullptr);
+
+    // streaming response (Transfer-Encoding: chunked)
+    // the header is sent at once, the body follows chunk by chunk.
+    // all parts go through the send queue, see getSendQueueSize().
+
+    SEV_DECL int32_t sendHttpResponseHeader(
+        HttpResponse& response,
+        const TcpSendHandler& sendHandler = nullptr);
+
+    SEV_DECL int32_t sendHttpResponseChunk(
+        const void* data, size_t size,
+        const TcpSendHandler& sendHandler = nullptr);
+
+    SEV_DECL int32_t sendHttpResponseEnd(
+        const HttpHeader& trailers = HttpHeader(),
+        const TcpSendHandler& sendHandler = nullptr);
+
     SEV_DECL HttpRequest& getRequest()
     {
         return mRequest;
@@ -117,6 +223,55 @@ public:
         mRequestHandler = requestHandler;
     }
 
+    // called when the request header has been received,
+    // before the body. the body handler may be set here.
+    SEV_DECL void setRequestHeaderHandler(
+        const HttpRequestHandler& requestHeaderHandler)
+    {
+        mRequestHeaderHandler = requestHeaderHandler;
+    }
+
+    // streaming mode
+    // the body is passed to the handler as it arrives
+    // instead of being stored in the request.
+    // use pauseReceive()/resumeReceive() for flow control.
+    SEV_DECL void setBodyHandler(
+        const HttpBodyHandler& bodyHandler)
+    {
+        mBodyHandler = bodyHandler;
+    }
+
+    // bodies larger than maxMemorySize are stored in a temporary
+    // file (HttpRequest::getBodyFileName()), which is removed
+    // after the request handler returns. 0: unlimited
+    SEV_DECL void setMaxBodyMemorySize(
+        size_t maxMemorySize, const std::string& tempDirectory = "")
+    {
+        mMaxBodyMemorySize = maxMemorySize;
+        mTempDirectory = tempDirectory;
+    }
+
+    // upgradeToWebSocket() adds the channel to it while the owner
+    // (the server or the worker) keeps it
+    SEV_DECL void setWsKeepAlive(const WsKeepAlivePtr& keepAlive)
+    {
+        mWsKeepAlive = keepAlive;
+    }
+
+#ifdef SEV_SUPPORTS_ZLIB
+    // sendHttpResponse() compresses the body when acceptable
+    SEV_DECL void setCompressor(const HttpCompressorPtr& compressor)
+    {
+        mCompressor = compressor;
+    }
+
+    // sendWsHandshakeResponse() accepts permessage-deflate
+    SEV_DECL void setWsDeflateOption(const WsDeflateOptionPtr& option)
+    {
+        mWsDeflateOption = option;
+    }
+#endif
+
 protected:
     SEV_DECL void onTcpReceive(
         const TcpChannelPtr& channel);
@@ -126,6 +281,8 @@ protected:
 private:
     SEV_DECL HttpChannel(Socket* socket);
 
+    SEV_DECL int32_t sendQueued(
+        std::vector<char>&& data, const TcpSendHandler& sendHandler);
     SEV_DECL bool isRequestCompleted() const;
     SEV_DECL bool onHttpRequest(StringReader& reader);
     SEV_DECL void onRequestCompleted();
@@ -138,7 +295,18 @@ private:
     HttpContentReceiver mContentReceiver;
     std::vector<char> mRequestTempBuffer;
     HttpRequestHandler mRequestHandler;
+    HttpRequestHandler mRequestHeaderHandler;
+    HttpBodyHandler mBodyHandler;
+    size_t mMaxBodyMemorySize;
+    std::string mTempDirectory;
     WsChannelPtr mWsChannel;
+    std::weak_ptr<WsKeepAlive> mWsKeepAlive;
+
+#ifdef SEV_SUPPORTS_ZLIB
+    HttpCompressorPtr mCompressor;
+    WsDeflateOptionPtr mWsDeflateOption;
+    WsDeflatePtr mWsDeflate;
+#endif
 
     friend class HttpServer;
 };
@@ -180,6 +348,48 @@ public:
     SEV_DECL void setDefaultRequestHandler(
         const HttpRequestHandler& handler);
 
+    SEV_DECL void setRequestHeaderHandler(
+        const HttpRequestHandler& handler)
+    {
+        mRequestHeaderHandler = handler;
+    }
+
+    // ping/pong heartbeat for the upgraded WebSocket channels,
+    // the ones upgraded before disabling are not checked anymore.
+    SEV_DECL void enableWsKeepAlive(
+        const WsKeepAliveOption& option = WsKeepAliveOption());
+
+    SEV_DECL void disableWsKeepAlive()
+    {
+        mWsKeepAlive.reset();
+    }
+
+#ifdef SEV_SUPPORTS_ZLIB
+    // response compression for the accepted channels
+    SEV_DECL void enableCompression(
+        const HttpCompressionOption& option = HttpCompressionOption())
+    {
+        mCompressor = HttpCompressor::newInstance(option);
+    }
+
+    SEV_DECL void disableCompression()
+    {
+        mCompressor.reset();
+    }
+
+    // permessage-deflate for the WebSocket handshakes
+    SEV_DECL void enableWsDeflate(
+        const WsDeflateOption& option = WsDeflateOption())
+    {
+        mWsDeflateOption = std::make_shared<WsDeflateOption>(option);
+    }
+
+    SEV_DECL void disableWsDeflate()
+    {
+        mWsDeflateOption.reset();
+    }
+#endif
+
 public:
     SEV_DECL static void defaultHandler(
         const HttpChannelPtr& httpChannel);
@@ -202,6 +412,13 @@ private:
     TcpAcceptHandler mAcceptHandler;
     TcpCloseHandler mCloseHandler;
     HttpHandlerMap mHandlerMap;
+    HttpRequestHandler mRequestHeaderHandler;
+    WsKeepAlivePtr mWsKeepAlive;
+
+#ifdef SEV_SUPPORTS_ZLIB
+    HttpCompressorPtr mCompressor;
+    WsDeflateOptionPtr mWsDeflateOption;
+#endif
 
 #ifdef SEV_SUPPORTS_SSL
     SslContextPtr mSslContext;
@@ -1,6 +1,8 @@
 #ifndef SUBEVENT_HTTP_SERVER_INL
 #define SUBEVENT_HTTP_SERVER_INL
 
+#include <cstdio>
+#include <cstdlib>
 #include <vector>
 #include <subevent/http_server.hpp>
 #include <subevent/ws.hpp>
@@ -134,6 +136,194 @@ void HttpHandlerMap::onRequest(const HttpChannelPtr& httpChannel)
     }
 }
 
+#ifdef SEV_SUPPORTS_ZLIB
+
+//----------------------------------------------------------------------------//
+// HttpCompressor
+//----------------------------------------------------------------------------//
+
+HttpCompressor::HttpCompressor(const HttpCompressionOption& option)
+    : mOption(option), mPool(option.level)
+{
+}
+
+HttpCompressor::~HttpCompressor()
+{
+}
+
+bool HttpCompressor::compress(
+    const HttpRequest& request, HttpResponse& response)
+{
+    std::vector<char>& body = response.getBody();
+
+    if ((body.empty()) || (body.size() < mOption.minSize))
+    {
+        return false;
+    }
+
+    uint16_t statusCode = response.getStatusCode();
+
+    if ((statusCode < 200) ||
+        (statusCode == HttpStatusCode::NoContent) ||
+        (statusCode == HttpStatusCode::NotModified))
+    {
+        return false;
+    }
+
+    HttpHeader& header = response.getHeader();
+
+    if (header.has(HttpHeaderField::ContentEncoding) ||
+        !isCompressible(header.get(HttpHeaderField::ContentType)))
+    {
+        return false;
+    }
+
+    CompressionFormat format;
+
+    if (!negotiate(
+        request.getHeader().get(HttpHeaderField::AcceptEncoding), format))
+    {
+        return false;
+    }
+
+    DeflaterPtr deflater = mPool.acquire(format);
+
+    if (deflater == nullptr)
+    {
+        return false;
+    }
+
+    std::vector<char> compressed;
+    compressed.reserve(body.size() / 2);
+
+    bool result = deflater->deflate(
+        &body[0], body.size(), compressed, Z_FINISH);
+
+    mPool.release(std::move(deflater));
+
+    if (!result || (compressed.size() >= body.size()))
+    {
+        return false;
+    }
+
+    body = std::move(compressed);
+
+    header.set(HttpHeaderField::ContentEncoding,
+        ((format == CompressionFormat::Gzip) ? "gzip" : "deflate"));
+
+    if (!header.has(HttpHeaderField::Vary))
+    {
+        header.add(HttpHeaderField::Vary, HttpHeaderField::AcceptEncoding);
+    }
+
+    return true;
+}
+
+bool HttpCompressor::negotiate(
+    const std::string& acceptEncoding, CompressionFormat& format)
+{
+    // quality values, -1: not listed
+    double gzip = -1.0;
+    double deflate = -1.0;
+    double any = -1.0;
+
+    for (auto& coding : String::split(acceptEncoding, ","))
+    {
+        std::string name = coding;
+        double quality = 1.0;
+
+        size_t pos = coding.find(';');
+
+        if (pos != std::string::npos)
+        {
+            name = coding.substr(0, pos);
+
+            std::string param = coding.substr(pos + 1);
+            String::trim(param);
+
+            if ((param.size() > 2) &&
+                ((param[0] == 'q') || (param[0] == 'Q')) &&
+                (param[1] == '='))
+            {
+                quality = std::atof(param.c_str() + 2);
+            }
+        }
+
+        String::trim(name);
+
+        if (String::iequals(name, "gzip") ||
+            String::iequals(name, "x-gzip"))
+        {
+            gzip = quality;
+        }
+        else if (String::iequals(name, "deflate"))
+        {
+            deflate = quality;
+        }
+        else if (name == "*")
+        {
+            any = quality;
+        }
+    }
+
+    if (gzip < 0.0)
+    {
+        gzip = any;
+    }
+
+    if (deflate < 0.0)
+    {
+        deflate = any;
+    }
+
+    if ((gzip <= 0.0) && (deflate <= 0.0))
+    {
+        return false;
+    }
+
+    format = ((gzip >= deflate) ?
+        CompressionFormat::Gzip : CompressionFormat::Zlib);
+
+    return true;
+}
+
+bool HttpCompressor::isCompressible(const std::string& contentType) const
+{
+    std::string mimeType = contentType.substr(0, contentType.find(';'));
+    String::trim(mimeType);
+
+    if (mimeType.empty())
+    {
+        return false;
+    }
+
+    for (const auto& allowed : mOption.mimeTypes)
+    {
+        size_t size = allowed.size();
+
+        if ((size >= 2) &&
+            (allowed.compare(size - 2, 2, "/*") == 0))
+        {
+            // type/*
+            if ((mimeType.size() > (size - 1)) &&
+                String::iequals(
+                    mimeType.substr(0, size - 1),
+                    allowed.substr(0, size - 1)))
+            {
+                return true;
+            }
+        }
+        else if (String::iequals(mimeType, allowed))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif // SEV_SUPPORTS_ZLIB
+
 //----------------------------------------------------------------------------//
 // HttpChannel
 //----------------------------------------------------------------------------//
@@ -141,6 +331,8 @@ void HttpHandlerMap::onRequest(const HttpChannelPtr& httpChannel)
 HttpChannel::HttpChannel(Socket* socket)
     : TcpChannel(socket)
 {
+    mMaxBodyMemorySize = 0;
+
     setReceiveHandler(SEV_BIND_1(this, HttpChannel::onTcpReceive));
 }
 
@@ -189,6 +381,12 @@ void HttpChannel::onTcpReceive(const TcpChannelPtr& channel)
 
 bool HttpChannel::onHttpRequest(StringReader& reader)
 {
+    if (isRequestCompleted())
+    {
+        // next request on the kept-alive connection
+        mRequest.clear();
+    }
+
     // header
     if (mRequest.isEmpty())
     {
@@ -200,7 +398,48 @@ bool HttpChannel::onHttpRequest(StringReader& reader)
                 mRequest.clear();
                 return false;
             }
+        }
+        catch (...)
+        {
+            // invalid data
+            close();
+            return true;
+        }
+
+        if (mRequestHeaderHandler != nullptr)
+        {
+            HttpChannelPtr self(std::dynamic_pointer_cast<
+                HttpChannel>(shared_from_this()));
+
+            mRequestHeaderHandler(self);
+
+            if (isClosed())
+            {
+                return true;
+            }
+        }
+
+        mContentReceiver.clear();
+        mContentReceiver.setMaxMemorySize(
+            mMaxBodyMemorySize, mTempDirectory);
+
+        if (mBodyHandler != nullptr)
+        {
+            HttpChannel* self = this;
+            HttpBodyHandler bodyHandler = mBodyHandler;
+
+            mContentReceiver.setContentHandler(
+                [self, bodyHandler](const char* data, size_t size) {
+
+                HttpChannelPtr channel(std::dynamic_pointer_cast<
+                    HttpChannel>(self->shared_from_this()));
+
+                bodyHandler(channel, data, size);
+            });
+        }
 
+        try
+        {
             if (!mContentReceiver.init(mRequest))
             {
                 // too much data
@@ -223,9 +462,24 @@ bool HttpChannel::onHttpRequest(StringReader& reader)
         return true;
     }
 
+    if (isClosed())
+    {
+        return true;
+    }
+
     if (isRequestCompleted())
     {
-        mRequest.setBody(mContentReceiver.getData());
+        if (mContentReceiver.isSpilled())
+        {
+            mRequest.setBodyFileName(
+                mContentReceiver.getFileName());
+        }
+        else
+        {
+            mRequest.setBody(mContentReceiver.getData());
+        }
+
+        mContentReceiver.clear();
 
         onRequestCompleted();
     }
@@ -253,6 +507,13 @@ int32_t HttpChannel::sendHttpResponse(
 {
     std::vector<char> responseData;
 
+#ifdef SEV_SUPPORTS_ZLIB
+    if (mCompressor != nullptr)
+    {
+        mCompressor->compress(mRequest, response);
+    }
+#endif
+
     // Content-Length
     response.getHeader().setContentLength(
         response.getBody().size());
@@ -292,6 +553,98 @@ int32_t HttpChannel::sendHttpResponse(
     return sendHttpResponse(res, sendHandler);
 }
 
+int32_t HttpChannel::sendHttpResponseFile(
+    HttpResponse& response,
+    const std::string& fileName,
+    const TcpSendHandler& sendHandler)
+{
+    std::shared_ptr<std::FILE> file = File::open(fileName, "rb");
+
+    if (file == nullptr)
+    {
+        return -5261;
+    }
+
+    int64_t size = File::getSize(file.get());
+
+    if (size < 0)
+    {
+        return -5261;
+    }
+
+    std::vector<char> responseData;
+
+    response.getBody().clear();
+    response.getHeader().remove(HttpHeaderField::TransferEncoding);
+    response.getHeader().setContentLength(static_cast<size_t>(size));
+
+    // serialize
+    StringWriter writer(responseData);
+    response.serializeMessage(writer);
+
+    // cut null
+    responseData.resize(responseData.size() - 1);
+
+    int32_t result = sendQueued(std::move(responseData), nullptr);
+
+    if (result < 0)
+    {
+        return result;
+    }
+
+    return sendFile(file, 0, static_cast<uint64_t>(size),
+        ((sendHandler != nullptr) ?
+            sendHandler : SEV_BIND_2(this, HttpChannel::onTcpSend)));
+}
+
+int32_t HttpChannel::sendHttpResponseHeader(
+    HttpResponse& response, const TcpSendHandler& sendHandler)
+{
+    std::vector<char> responseData;
+
+    response.getHeader().remove(HttpHeaderField::ContentLength);
+    response.getHeader().set(
+        HttpHeaderField::TransferEncoding, "chunked");
+
+    // serialize
+    StringWriter writer(responseData);
+    response.serializeMessage(writer);
+
+    // cut null
+    responseData.resize(responseData.size() - 1);
+
+    return sendQueued(std::move(responseData), sendHandler);
+}
+
+int32_t HttpChannel::sendHttpResponseChunk(
+    const void* data, size_t size, const TcpSendHandler& sendHandler)
+{
+    if (size == 0)
+    {
+        // a zero size chunk ends the body
+        return 0;
+    }
+
+    return sendQueued(
+        HttpChunk::serialize(data, size), sendHandler);
+}
+
+int32_t HttpChannel::sendHttpResponseEnd(
+    const HttpHeader& trailers, const TcpSendHandler& sendHandler)
+{
+    return sendQueued(
+        HttpChunk::serializeLast(trailers), sendHandler);
+}
+
+int32_t HttpChannel::sendQueued(
+    std::vector<char>&& data, const TcpSendHandler& sendHandler)
+{
+    // a null handler would send synchronously and bypass the queue
+    return send(std::move(data),
+        ((sendHandler != nullptr) ?
+            sendHandler : SEV_BIND_2(this, HttpChannel::onTcpSend)));
+}
+
 void HttpChannel::onTcpSend(
     const TcpChannelPtr& /* channel */, int32_t /* errorCode */)
 {
@@ -299,6 +652,9 @@ void HttpChannel::onTcpSend(
 
 void HttpChannel::onRequestCompleted()
 {
+    // temporary file of a large body
+    std::string bodyFileName = mRequest.getBodyFileName();
+
     if (mRequestHandler != nullptr)
     {
         HttpChannelPtr self(
@@ -306,6 +662,11 @@ void HttpChannel::onRequestCompleted()
 
         mRequestHandler(self);
     }
+
+    if (!bodyFileName.empty())
+    {
+        std::remove(bodyFileName.c_str());
+    }
 }
 
 int32_t HttpChannel::sendWsHandshakeResponse(
@@ -333,6 +694,31 @@ int32_t HttpChannel::sendWsHandshakeResponse(
     httpResponse.getHeader().set(
         HttpHeaderField::SecWebSocketProtocol, protocol);
 
+#ifdef SEV_SUPPORTS_ZLIB
+    if (mWsDeflateOption != nullptr)
+    {
+        // offers may be split into several header lines
+        std::string offers;
+
+        for (const auto& value : getRequest().getHeader().find(
+            HttpHeaderField::SecWebSocketExtensions))
+        {
+            offers += (offers.empty() ? "" : ",") + value;
+        }
+
+        std::string extensions;
+
+        mWsDeflate = WsDeflate::accept(
+            offers, *mWsDeflateOption, extensions);
+
+        if (mWsDeflate != nullptr)
+        {
+            httpResponse.getHeader().set(
+                HttpHeaderField::SecWebSocketExtensions, extensions);
+        }
+    }
+#endif
+
     int32_t result =
         sendHttpResponse(httpResponse, handler);
 
@@ -348,6 +734,17 @@ WsChannelPtr HttpChannel::upgradeToWebSocket()
 
     mWsChannel = WsChannel::newInstance(shared_from_this(), false);
 
+#ifdef SEV_SUPPORTS_ZLIB
+    mWsChannel->mDeflate = std::move(mWsDeflate);
+#endif
+
+    WsKeepAlivePtr keepAlive = mWsKeepAlive.lock();
+
+    if (keepAlive != nullptr)
+    {
+        keepAlive->add(mWsChannel);
+    }
+
     return mWsChannel;
 }
 
@@ -444,6 +841,13 @@ bool HttpServer::open(
 
             httpChannel->setRequestHandler(
                 SEV_BIND_1(this, HttpServer::onRequest));
+            httpChannel->setRequestHeaderHandler(
+                mRequestHeaderHandler);
+            httpChannel->setWsKeepAlive(mWsKeepAlive);
+#ifdef SEV_SUPPORTS_ZLIB
+            httpChannel->setCompressor(mCompressor);
+            httpChannel->setWsDeflateOption(mWsDeflateOption);
+#endif
         };
     }
 
@@ -453,6 +857,11 @@ bool HttpServer::open(
     return result;
 }
 
+void HttpServer::enableWsKeepAlive(const WsKeepAliveOption& option)
+{
+    mWsKeepAlive = WsKeepAlive::newInstance(option);
+}
+
 void HttpServer::onRequest(const HttpChannelPtr& httpChannel)
 {
     mHandlerMap.onRequest(httpChannel);
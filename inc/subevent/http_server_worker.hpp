@@ -25,6 +25,41 @@ protected:
         const std::string& path,
         const HttpRequestHandler& handler);
 
+    // ping/pong heartbeat, one timer for the worker
+    SEV_DECL void enableWsKeepAlive(
+        const WsKeepAliveOption& option = WsKeepAliveOption());
+
+    SEV_DECL void disableWsKeepAlive()
+    {
+        mWsKeepAlive.reset();
+    }
+
+#ifdef SEV_SUPPORTS_ZLIB
+    // response compression, the stream pool is per worker
+    SEV_DECL void enableCompression(
+        const HttpCompressionOption& option = HttpCompressionOption())
+    {
+        mCompressor = HttpCompressor::newInstance(option);
+    }
+
+    SEV_DECL void disableCompression()
+    {
+        mCompressor.reset();
+    }
+
+    // permessage-deflate for the WebSocket handshakes
+    SEV_DECL void enableWsDeflate(
+        const WsDeflateOption& option = WsDeflateOption())
+    {
+        mWsDeflateOption = std::make_shared<WsDeflateOption>(option);
+    }
+
+    SEV_DECL void disableWsDeflate()
+    {
+        mWsDeflateOption.reset();
+    }
+#endif
+
     // default handler
     SEV_DECL virtual void onHttpRequest(
         const HttpChannelPtr& httpChannel);
@@ -39,6 +74,12 @@ private:
     HttpChannelWorker() = delete;
 
     HttpHandlerMap mHandlerMap;
+    WsKeepAlivePtr mWsKeepAlive;
+
+#ifdef SEV_SUPPORTS_ZLIB
+    HttpCompressorPtr mCompressor;
+    WsDeflateOptionPtr mWsDeflateOption;
+#endif
 };
 
 //---------------------------------------------------------------------------//
@@ -3,6 +3,7 @@
 
 #include <memory>
 #include <subevent/http_server_worker.hpp>
+#include <subevent/ws.hpp>
 
 SEV_NS_BEGIN
 
@@ -34,6 +35,11 @@ HttpChannelWorker::HttpChannelWorker(Thread* thread)
 
             httpChannel->setRequestHandler(
                 SEV_BIND_1(this, HttpChannelWorker::onRequest));
+            httpChannel->setWsKeepAlive(mWsKeepAlive);
+#ifdef SEV_SUPPORTS_ZLIB
+            httpChannel->setCompressor(mCompressor);
+            httpChannel->setWsDeflateOption(mWsDeflateOption);
+#endif
 
             onAccept(newChannel);
         }
@@ -44,6 +50,12 @@ HttpChannelWorker::~HttpChannelWorker()
 {
 }
 
+void HttpChannelWorker::enableWsKeepAlive(
+    const WsKeepAliveOption& option)
+{
+    mWsKeepAlive = WsKeepAlive::newInstance(option);
+}
+
 void HttpChannelWorker::setRequestHandler(
     const std::string& path,
     const HttpRequestHandler& handler)
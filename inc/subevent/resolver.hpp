@@ -0,0 +1,135 @@
+#ifndef SUBEVENT_RESOLVER_HPP
+#define SUBEVENT_RESOLVER_HPP
+
+#include <map>
+#include <set>
+#include <list>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+
+#include <subevent/std.hpp>
+#include <subevent/thread.hpp>
+#include <subevent/socket.hpp>
+
+SEV_NS_BEGIN
+
+typedef std::function<
+    void(const std::list<IpEndPoint>&)> ResolveHandler;
+
+// looks a name up on a resolver thread (the port is not used)
+typedef std::function<
+    std::list<IpEndPoint>(const std::string& node,
+        const AddressFamily& family, const Socket::Type& type)>
+    ResolveLookupHandler;
+
+//----------------------------------------------------------------------------//
+// Resolver
+//----------------------------------------------------------------------------//
+
+// resolves host names on its own threads so that getaddrinfo never
+// blocks an event loop. the results are shared by all threads and
+// cached, lookups that failed are cached for a shorter time.
+// the instance is never destroyed, a thread blocked in getaddrinfo
+// does not hold up the process exit.
+class Resolver
+{
+public:
+    typedef uint64_t RequestId;
+
+    SEV_DECL static Resolver& getInstance();
+
+public:
+    // the handler is called on the calling thread.
+    // an empty list means the name could not be resolved.
+    // returns 0 if the result could not be delivered.
+    // the result is dropped if the thread has been deleted.
+    SEV_DECL RequestId resolve(
+        const std::string& node, uint16_t port,
+        const AddressFamily& family, const Socket::Type& type,
+        const ResolveHandler& handler);
+
+    // must be called on the thread that requested it
+    SEV_DECL void cancel(RequestId id);
+
+    SEV_DECL void clearCache();
+
+    // getaddrinfo does not report the record ttl,
+    // so positive results are kept for this time.
+    // msec
+    SEV_DECL void setCacheTtl(uint32_t msec);
+    SEV_DECL void setNegativeCacheTtl(uint32_t msec);
+
+    SEV_DECL void setMaxCacheSize(size_t size);
+    SEV_DECL void setMaxThreads(size_t count);
+
+    // replaces getaddrinfo (a stub name service for tests).
+    // nullptr: getaddrinfo
+    SEV_DECL void setLookupHandler(const ResolveLookupHandler& handler);
+
+private:
+    SEV_DECL Resolver();
+    SEV_DECL ~Resolver();
+
+    struct Waiter
+    {
+        RequestId id;
+        ThreadRefPtr thread;
+        uint16_t port;
+        ResolveHandler handler;
+    };
+
+    struct Entry
+    {
+        Entry()
+            : resolving(false)
+        {
+        }
+
+        bool resolving;
+        std::list<IpEndPoint> endPoints;
+        std::chrono::steady_clock::time_point expires;
+        std::list<Waiter> waiters;
+    };
+
+    struct Query
+    {
+        std::string key;
+        std::string node;
+        AddressFamily family;
+        Socket::Type type;
+    };
+
+    SEV_DECL void run();
+    SEV_DECL void complete(
+        const std::string& key, std::list<IpEndPoint>&& endPoints);
+    SEV_DECL void trimCache();
+
+    SEV_DECL static std::list<IpEndPoint> withPort(
+        const std::list<IpEndPoint>& endPoints, uint16_t port);
+
+    Resolver(const Resolver&) = delete;
+    Resolver& operator=(const Resolver&) = delete;
+
+    std::mutex mMutex;
+    std::condition_variable mCondition;
+    std::list<Query> mQueries;
+    std::map<std::string, Entry> mEntries;
+    std::set<RequestId> mDelivering;
+    size_t mThreads;
+    size_t mIdleThreads;
+    ResolveLookupHandler mLookupHandler;
+
+    RequestId mNextId;
+    uint32_t mCacheTtl;
+    uint32_t mNegativeCacheTtl;
+    size_t mMaxCacheSize;
+    size_t mMaxThreads;
+};
+
+SEV_NS_END
+
+#endif // SUBEVENT_RESOLVER_HPP
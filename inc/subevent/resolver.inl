@@ -0,0 +1,340 @@
+#ifndef SUBEVENT_RESOLVER_INL
+#define SUBEVENT_RESOLVER_INL
+
+#include <cassert>
+
+#include <subevent/resolver.hpp>
+
+SEV_NS_BEGIN
+
+//----------------------------------------------------------------------------//
+// Resolver
+//----------------------------------------------------------------------------//
+
+Resolver& Resolver::getInstance()
+{
+    // never destroyed, see the class comment
+    static Resolver* resolver = new Resolver();
+    return *resolver;
+}
+
+Resolver::Resolver()
+{
+    mThreads = 0;
+    mIdleThreads = 0;
+    mNextId = 0;
+    mCacheTtl = 60 * 1000;
+    mNegativeCacheTtl = 5 * 1000;
+    mMaxCacheSize = 1024;
+    mMaxThreads = 4;
+}
+
+Resolver::~Resolver()
+{
+}
+
+Resolver::RequestId Resolver::resolve(
+    const std::string& node, uint16_t port,
+    const AddressFamily& family, const Socket::Type& type,
+    const ResolveHandler& handler)
+{
+    Thread* thread = Thread::getCurrent();
+
+    if ((thread == nullptr) || (handler == nullptr))
+    {
+        assert(false);
+        return 0;
+    }
+
+    std::string key = node + "/" +
+        std::to_string(static_cast<int32_t>(family)) + "/" +
+        std::to_string(static_cast<int32_t>(type));
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    RequestId id = ++mNextId;
+
+    Entry& entry = mEntries[key];
+
+    if (!entry.resolving &&
+        (entry.expires > std::chrono::steady_clock::now()))
+    {
+        // cached
+        std::list<IpEndPoint> endPoints = withPort(entry.endPoints, port);
+
+        mDelivering.insert(id);
+
+        bool result = thread->getRef()->post(
+            [this, id, endPoints, handler]() {
+
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+
+                if (mDelivering.erase(id) == 0)
+                {
+                    // canceled
+                    return;
+                }
+            }
+
+            handler(endPoints);
+        });
+
+        if (!result)
+        {
+            mDelivering.erase(id);
+            return 0;
+        }
+
+        return id;
+    }
+
+    Waiter waiter;
+    waiter.id = id;
+    waiter.thread = thread->getRef();
+    waiter.port = port;
+    waiter.handler = handler;
+
+    entry.waiters.push_back(std::move(waiter));
+
+    if (entry.resolving)
+    {
+        // joins the lookup in flight
+        return id;
+    }
+
+    entry.resolving = true;
+
+    Query query;
+    query.key = key;
+    query.node = node;
+    query.family = family;
+    query.type = type;
+
+    mQueries.push_back(std::move(query));
+
+    if ((mIdleThreads == 0) && (mThreads < mMaxThreads))
+    {
+        std::thread(&Resolver::run, this).detach();
+        ++mThreads;
+    }
+    else
+    {
+        mCondition.notify_one();
+    }
+
+    return id;
+}
+
+void Resolver::cancel(RequestId id)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mDelivering.erase(id) != 0)
+    {
+        return;
+    }
+
+    for (auto& entry : mEntries)
+    {
+        auto& waiters = entry.second.waiters;
+
+        for (auto it = waiters.begin(); it != waiters.end(); ++it)
+        {
+            if (it->id == id)
+            {
+                waiters.erase(it);
+                return;
+            }
+        }
+    }
+}
+
+void Resolver::clearCache()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    for (auto it = mEntries.begin(); it != mEntries.end();)
+    {
+        if (!it->second.resolving)
+        {
+            it = mEntries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void Resolver::setCacheTtl(uint32_t msec)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCacheTtl = msec;
+}
+
+void Resolver::setNegativeCacheTtl(uint32_t msec)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mNegativeCacheTtl = msec;
+}
+
+void Resolver::setMaxCacheSize(size_t size)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mMaxCacheSize = size;
+}
+
+void Resolver::setMaxThreads(size_t count)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mMaxThreads = ((count > 0) ? count : 1);
+}
+
+void Resolver::setLookupHandler(const ResolveLookupHandler& handler)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mLookupHandler = handler;
+}
+
+void Resolver::run()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    for (;;)
+    {
+        while (mQueries.empty())
+        {
+            ++mIdleThreads;
+            mCondition.wait(lock);
+            --mIdleThreads;
+        }
+
+        Query query = std::move(mQueries.front());
+        mQueries.pop_front();
+
+        ResolveLookupHandler lookupHandler = mLookupHandler;
+
+        lock.unlock();
+
+        // port is applied per request
+        std::list<IpEndPoint> endPoints = (lookupHandler != nullptr) ?
+            lookupHandler(query.node, query.family, query.type) :
+            IpEndPoint::resolveName(
+                query.node, 0, query.family, query.type);
+
+        lock.lock();
+
+        complete(query.key, std::move(endPoints));
+    }
+}
+
+void Resolver::complete(
+    const std::string& key, std::list<IpEndPoint>&& endPoints)
+{
+    auto it = mEntries.find(key);
+    if (it == mEntries.end())
+    {
+        return;
+    }
+
+    Entry& entry = it->second;
+
+    uint32_t ttl = (endPoints.empty() ? mNegativeCacheTtl : mCacheTtl);
+
+    entry.resolving = false;
+    entry.endPoints = std::move(endPoints);
+    entry.expires = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(ttl);
+
+    for (auto& waiter : entry.waiters)
+    {
+        std::list<IpEndPoint> result = withPort(entry.endPoints, waiter.port);
+        RequestId id = waiter.id;
+        ResolveHandler handler = std::move(waiter.handler);
+
+        mDelivering.insert(id);
+
+        // fails if the thread has been deleted meanwhile
+        bool posted = waiter.thread->post([this, id, result, handler]() {
+
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+
+                if (mDelivering.erase(id) == 0)
+                {
+                    // canceled
+                    return;
+                }
+            }
+
+            handler(result);
+        });
+
+        if (!posted)
+        {
+            mDelivering.erase(id);
+        }
+    }
+
+    entry.waiters.clear();
+
+    if (ttl == 0)
+    {
+        mEntries.erase(it);
+    }
+
+    trimCache();
+}
+
+void Resolver::trimCache()
+{
+    if (mEntries.size() <= mMaxCacheSize)
+    {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+
+    for (auto it = mEntries.begin(); it != mEntries.end();)
+    {
+        if (!it->second.resolving && (it->second.expires <= now))
+        {
+            it = mEntries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    for (auto it = mEntries.begin();
+        (it != mEntries.end()) && (mEntries.size() > mMaxCacheSize);)
+    {
+        if (!it->second.resolving)
+        {
+            it = mEntries.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+std::list<IpEndPoint> Resolver::withPort(
+    const std::list<IpEndPoint>& endPoints, uint16_t port)
+{
+    std::list<IpEndPoint> results(endPoints);
+
+    for (auto& endPoint : results)
+    {
+        endPoint.setPort(port);
+    }
+
+    return results;
+}
+
+SEV_NS_END
+
+#endif // SUBEVENT_RESOLVER_INL
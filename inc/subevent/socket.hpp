@@ -157,6 +157,15 @@ public:
         void* buff, uint32_t size, int32_t flags = 0);
     SEV_DECL virtual void close();
 
+    // sends up to size bytes of an open file from offset.
+    // returns the bytes sent or -1.
+    SEV_DECL virtual int32_t sendFile(
+        int fileHandle, uint64_t offset, uint32_t size);
+
+    // writes out what send() has buffered.
+    // returns false if some is left (see isBlockingError()).
+    SEV_DECL virtual bool flush();
+
 public:
     SEV_DECL bool getLocalEndPoint(IpEndPoint& localEndPoint) const;
     SEV_DECL bool getPeerEndPoint(IpEndPoint& peerEndPoint) const;
@@ -179,14 +188,26 @@ public:
         return mErrorCode;
     }
 
-    SEV_DECL bool isBlockingError() const;
+    SEV_DECL virtual bool isBlockingError() const;
 
 public:
     SEV_DECL virtual bool onAccept();
     SEV_DECL virtual bool onConnect();
+
+    // called on each socket event until isHandshaking() returns false.
+    // returns false on error.
+    SEV_DECL virtual bool handshake();
+    SEV_DECL virtual bool isHandshaking() const;
+
+    // the selector reported the socket readable, or closed by the peer
+    SEV_DECL virtual void onReadable(bool peerClosed);
     SEV_DECL static int getLastError();
 
 protected:
+    // reads up to size bytes at offset, returns the bytes read or -1
+    SEV_DECL static int32_t readFile(
+        int fileHandle, uint64_t offset, void* buff, uint32_t size);
+
     Socket(const Socket&) = delete;
     Socket& operator=(const Socket&) = delete;
 
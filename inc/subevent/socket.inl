@@ -6,6 +6,7 @@
 #include <subevent/socket.hpp>
 
 #ifdef SEV_OS_WIN
+#include <io.h>
 #else
 #include <unistd.h>
 #include <netdb.h>
@@ -13,6 +14,10 @@
 #include <arpa/inet.h>
 #endif
 
+#ifdef SEV_OS_LINUX
+#include <sys/sendfile.h>
+#endif
+
 SEV_NS_BEGIN
 
 //---------------------------------------------------------------------------//
@@ -33,12 +38,18 @@ SocketOption::SocketOption(Socket* socket)
 
 SocketOption::SocketOption(const SocketOption& other)
 {
+    mSocket = nullptr;
+    mStore = nullptr;
+
     operator=(other);
 }
 
 SocketOption::SocketOption(SocketOption&& other)
 {
-    operator=(other);
+    mSocket = nullptr;
+    mStore = nullptr;
+
+    operator=(std::move(other));
 }
 
 SocketOption::~SocketOption()
@@ -644,6 +655,57 @@ int32_t Socket::send(const void* data, uint32_t size, int32_t flags)
     return result;
 }
 
+int32_t Socket::sendFile(
+    int fileHandle, uint64_t offset, uint32_t size)
+{
+#ifdef SEV_OS_LINUX
+    off_t fileOffset = static_cast<off_t>(offset);
+
+    // zero copy
+    int32_t result = static_cast<int32_t>(
+        ::sendfile(getHandle(), fileHandle, &fileOffset, size));
+
+    mErrorCode = Socket::getLastError();
+
+    return result;
+#else
+    char buff[65536];
+
+    int32_t result = readFile(fileHandle, offset, buff,
+        ((size < sizeof(buff)) ? size : sizeof(buff)));
+
+    if (result <= 0)
+    {
+        mErrorCode = 0;
+        return -1;
+    }
+
+    return send(buff, static_cast<uint32_t>(result), SendFlags);
+#endif
+}
+
+bool Socket::flush()
+{
+    // unbuffered
+    return true;
+}
+
+int32_t Socket::readFile(
+    int fileHandle, uint64_t offset, void* buff, uint32_t size)
+{
+#ifdef SEV_OS_WIN
+    if (_lseeki64(fileHandle, static_cast<__int64>(offset), SEEK_SET) < 0)
+    {
+        return -1;
+    }
+
+    return _read(fileHandle, buff, size);
+#else
+    return static_cast<int32_t>(
+        ::pread(fileHandle, buff, size, static_cast<off_t>(offset)));
+#endif
+}
+
 int32_t Socket::receive(void* buff, uint32_t size, int32_t flags)
 {
     int32_t result = static_cast<int32_t>(
@@ -768,6 +830,20 @@ bool Socket::onConnect()
     return true;
 }
 
+bool Socket::handshake()
+{
+    return true;
+}
+
+bool Socket::isHandshaking() const
+{
+    return false;
+}
+
+void Socket::onReadable(bool /* peerClosed */)
+{
+}
+
 int Socket::getLastError()
 {
 #ifdef SEV_OS_WIN
@@ -2,7 +2,10 @@
 #define SUBEVENT_SOCKET_CONTROLLER_HPP
 
 #include <map>
+#include <set>
 #include <list>
+#include <cstdio>
+#include <memory>
 #include <vector>
 
 #include <subevent/std.hpp>
@@ -26,6 +29,16 @@ public:
     SEV_DECL SocketController();
     SEV_DECL ~SocketController() override;
 
+    // msec between parallel connection attempts (RFC 8305)
+    static const uint32_t TcpConnectAttemptDelay = 250;
+
+    // msec for the handshake (TLS) of a registered channel
+    static const uint32_t TcpHandshakeTimeout = 10 * 1000;
+
+    // a small send behind the queue joins the last queued
+    // buffer while that is smaller than this
+    static const size_t TcpSendCoalesceSize = 64 * 1024;
+
 public:
     SEV_DECL WaitResult wait(uint32_t msec, Event*& event) override;
     SEV_DECL void wakeup() override;
@@ -48,7 +61,18 @@ public:
     SEV_DECL bool requestTcpSend(
         const TcpChannelPtr& tcpChannel,
         std::vector<char>&& data);
+    SEV_DECL bool requestTcpSend(
+        const TcpChannelPtr& tcpChannel,
+        const std::shared_ptr<const std::vector<char>>& data);
+    SEV_DECL bool appendTcpSend(
+        const TcpChannelPtr& tcpChannel,
+        const void* data, size_t size);
+    SEV_DECL bool requestTcpSendFile(
+        const TcpChannelPtr& tcpChannel,
+        const std::shared_ptr<std::FILE>& file,
+        uint64_t offset, uint64_t size);
     SEV_DECL bool cancelTcpSend(const TcpChannelPtr& tcpChannel);
+    SEV_DECL size_t getTcpSendQueueSize(Socket::Handle sockHandle) const;
 
     SEV_DECL void requestTcpChannelClose(const TcpChannelPtr& tcpChannel);
 
@@ -83,6 +107,7 @@ private:
     {
         return mTcpServers.empty() &&
             mTcpClients.empty() &&
+            mTcpConnects.empty() &&
             mTcpChannels.empty() &&
             mUdpReceivers.empty();
     }
@@ -95,15 +120,25 @@ private:
         TcpServerPtr tcpServer;
     };
 
+    // one connection attempt
     struct TcpClientItem
     {
         SocketSelector::RegKey key;
         TcpClientPtr tcpClient;
         Socket* socket;
+    };
+
+    // attempts are started one by one at TcpConnectAttemptDelay
+    // intervals and run in parallel, the first one connected wins.
+    struct TcpConnectItem
+    {
+        TcpClientPtr tcpClient;
 
         std::list<IpEndPoint> endPointList;
+        std::list<Socket::Handle> attempts;
         uint32_t msecTimeout;
         Timer* cancelTimer;
+        Timer* attemptTimer;
 
         int32_t lastErrorCode;
     };
@@ -116,14 +151,30 @@ private:
 
         bool sendBlocked;
 
+        // receive and send wait until the handshake is done
+        bool handshaking;
+        Timer* handshakeTimer;
+
         struct SendData
         {
             std::vector<char> buff;
             size_t index;
+
+            // sent instead of buff if set,
+            // shared with the other channels
+            std::shared_ptr<const std::vector<char>> shared;
+
+            // sent instead of buff if set
+            std::shared_ptr<std::FILE> file;
+            uint64_t fileOffset;
+            uint64_t fileEnd;
         };
 
         std::list<SendData> sendBuffer;
         Timer* closeTimer;
+
+        // closing, the shutdown waits for the buffered records
+        bool shutdownPending;
     };
 
     struct UdpReceiverItem
@@ -133,14 +184,29 @@ private:
 
     };
 
-    SEV_DECL bool tryTcpConnect(TcpClientItem& item);
+    SEV_DECL void tryTcpConnect(TcpClient* tcpClient);
+    SEV_DECL void endTcpConnect(
+        TcpClient* tcpClient, Socket* socket, int32_t errorCode);
+    SEV_DECL static std::list<IpEndPoint> interleaveEndPoints(
+        const std::list<IpEndPoint>& endPointList);
+    SEV_DECL void tryTcpHandshake(Socket::Handle sockHandle);
+    SEV_DECL void endTcpHandshake(
+        Socket::Handle sockHandle, int32_t errorCode);
     SEV_DECL void tryTcpSend(TcpChannelItem& item);
+    SEV_DECL void flushTcpChannels();
+    SEV_DECL static bool tryTcpSendFile(
+        Socket* socket, TcpChannelItem::SendData& sendData,
+        int32_t& errorCode);
     SEV_DECL void startTcpChannelCloseTimer(TcpChannelItem& item);
 
     std::map<Socket::Handle, TcpServerItem> mTcpServers;
     std::map<Socket::Handle, TcpClientItem> mTcpClients;
+    std::map<TcpClient*, TcpConnectItem> mTcpConnects;
     std::map<Socket::Handle, TcpChannelItem> mTcpChannels;
     std::map<Socket::Handle, UdpReceiverItem> mUdpReceivers;
+
+    // channels to flush before the next wait
+    std::set<Socket::Handle> mTcpFlushes;
 };
 
 SEV_NS_END
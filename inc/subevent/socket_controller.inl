@@ -7,6 +7,7 @@
 #include <subevent/socket_controller.hpp>
 #include <subevent/thread.hpp>
 #include <subevent/timer.hpp>
+#include <subevent/utility.hpp>
 #include <subevent/tcp.hpp>
 #include <subevent/udp.hpp>
 
@@ -28,6 +29,11 @@ WaitResult SocketController::wait(uint32_t msec, Event*& event)
 {
     SocketSelector::SocketEvents sockEvents;
 
+    if (!mTcpFlushes.empty())
+    {
+        flushTcpChannels();
+    }
+
     WaitResult result = mSelector.wait(msec, sockEvents);
 
     switch (result)
@@ -107,6 +113,7 @@ void SocketController::onExit()
 
                     delete item.socket;
                     delete item.closeTimer;
+                    delete item.handshakeTimer;
                 }
                 mTcpChannels.clear();
                 finished = true;
@@ -141,10 +148,18 @@ void SocketController::closeAllItems()
         mSelector.unregisterSocket(item.key);
 
         delete item.socket;
-        delete item.cancelTimer;
     }
     mTcpClients.clear();
 
+    for (auto& pair : mTcpConnects)
+    {
+        TcpConnectItem& item = pair.second;
+
+        delete item.cancelTimer;
+        delete item.attemptTimer;
+    }
+    mTcpConnects.clear();
+
     // TcpChannel
     for (auto& pair : mTcpChannels)
     {
@@ -159,6 +174,10 @@ void SocketController::closeAllItems()
             item.tcpChannel->mSocket = nullptr;
             item.tcpChannel = nullptr;
             item.sendBuffer.clear();
+
+            item.handshaking = false;
+            delete item.handshakeTimer;
+            item.handshakeTimer = nullptr;
         }
     }
 
@@ -172,66 +191,217 @@ void SocketController::closeAllItems()
     mUdpReceivers.clear();
 }
 
-bool SocketController::tryTcpConnect(TcpClientItem& item)
+void SocketController::tryTcpConnect(TcpClient* tcpClient)
 {
+    auto it = mTcpConnects.find(tcpClient);
+    if (it == mTcpConnects.end())
+    {
+        return;
+    }
+
+    TcpConnectItem& item = it->second;
+
+    item.attemptTimer->cancel();
+
     while (!item.endPointList.empty())
     {
-        IpEndPoint& peerEndPoint = item.endPointList.front();
+        IpEndPoint peerEndPoint = item.endPointList.front();
+        item.endPointList.pop_front();
 
         int32_t errorCode;
         Socket* socket =
             item.tcpClient->createSocket(peerEndPoint, errorCode);
         if (socket == nullptr)
         {
-            item.tcpClient->onConnect(nullptr, errorCode);
-            return true;
+            item.lastErrorCode = errorCode;
+            continue;
         }
 
         Socket::Handle sockHandle = socket->getHandle();
 
+        TcpClientItem clientItem;
+        clientItem.tcpClient = item.tcpClient;
+        clientItem.socket = socket;
+
         if (!mSelector.registerSocket(
-            sockHandle, SocketSelector::Connect, item.key))
+            sockHandle, SocketSelector::Connect, clientItem.key))
         {
-            item.tcpClient->onConnect(nullptr, -5103);
+            item.lastErrorCode = -5103;
             delete socket;
-            return true;
+            continue;
         }
 
         // connect
         bool result = socket->connect(peerEndPoint);
 
-        item.endPointList.pop_front();
-
         if (result)
         {
             // success
-            item.socket = socket;
-            mTcpClients[sockHandle] = item;
-            onSelectTcpConnect(sockHandle, 0);
+            mSelector.unregisterSocket(clientItem.key);
+            endTcpConnect(tcpClient, socket, 0);
 
-            return false;
+            return;
         }
         else if (socket->isBlockingError())
         {
             // blocking
-            item.socket = socket;
-            mTcpClients[sockHandle] = item;
+            mTcpClients[sockHandle] = clientItem;
+            item.attempts.push_back(sockHandle);
 
-            return false;
+            if (!item.endPointList.empty())
+            {
+                // next attempt unless this one finishes first
+                item.attemptTimer->start(
+                    TcpConnectAttemptDelay, false, [this, tcpClient](Timer*) {
+                    tryTcpConnect(tcpClient);
+                });
+            }
+
+            return;
         }
         else
         {
             // error
             item.lastErrorCode = socket->getErrorCode();
 
-            mSelector.unregisterSocket(item.key);
+            mSelector.unregisterSocket(clientItem.key);
             delete socket;
         }
     }
 
-    item.tcpClient->onConnect(nullptr, item.lastErrorCode);
+    if (item.attempts.empty())
+    {
+        endTcpConnect(tcpClient, nullptr, item.lastErrorCode);
+    }
+}
+
+void SocketController::endTcpConnect(
+    TcpClient* tcpClient, Socket* socket, int32_t errorCode)
+{
+    auto it = mTcpConnects.find(tcpClient);
+    if (it == mTcpConnects.end())
+    {
+        delete socket;
+        return;
+    }
 
-    return true;
+    TcpClientPtr client = it->second.tcpClient;
+
+    // the losers are canceled
+    cancelTcpConnect(client);
+
+    client->onConnect(socket, errorCode);
+}
+
+std::list<IpEndPoint> SocketController::interleaveEndPoints(
+    const std::list<IpEndPoint>& endPointList)
+{
+    if (endPointList.empty())
+    {
+        return endPointList;
+    }
+
+    // the family of the first address first, then alternately
+    bool firstIpv6 = endPointList.front().isIpv6();
+
+    std::list<IpEndPoint> first;
+    std::list<IpEndPoint> second;
+
+    for (const auto& endPoint : endPointList)
+    {
+        if (endPoint.isIpv6() == firstIpv6)
+        {
+            first.push_back(endPoint);
+        }
+        else
+        {
+            second.push_back(endPoint);
+        }
+    }
+
+    std::list<IpEndPoint> results;
+
+    while (!first.empty() || !second.empty())
+    {
+        if (!first.empty())
+        {
+            results.push_back(std::move(first.front()));
+            first.pop_front();
+        }
+
+        if (!second.empty())
+        {
+            results.push_back(std::move(second.front()));
+            second.pop_front();
+        }
+    }
+
+    return results;
+}
+
+void SocketController::tryTcpHandshake(Socket::Handle sockHandle)
+{
+    auto it = mTcpChannels.find(sockHandle);
+    if (it == mTcpChannels.end())
+    {
+        return;
+    }
+
+    TcpChannelItem& item = it->second;
+
+    if (!item.handshaking || (item.tcpChannel == nullptr))
+    {
+        return;
+    }
+
+    Socket* socket = item.tcpChannel->mSocket;
+
+    if (!socket->handshake())
+    {
+        // error
+        endTcpHandshake(sockHandle, -5121);
+    }
+    else if (!socket->isHandshaking())
+    {
+        // success
+        endTcpHandshake(sockHandle, 0);
+    }
+}
+
+void SocketController::endTcpHandshake(
+    Socket::Handle sockHandle, int32_t errorCode)
+{
+    auto it = mTcpChannels.find(sockHandle);
+    if (it == mTcpChannels.end())
+    {
+        return;
+    }
+
+    TcpChannelItem& item = it->second;
+    TcpChannelPtr tcpChannel = item.tcpChannel;
+
+    item.handshaking = false;
+    delete item.handshakeTimer;
+    item.handshakeTimer = nullptr;
+
+    if (errorCode != 0)
+    {
+        mSelector.unregisterSocket(item.key);
+        mTcpChannels.erase(it);
+
+        tcpChannel->onHandshake(errorCode);
+
+        return;
+    }
+
+    tcpChannel->onHandshake(0);
+
+    // sent while handshaking
+    item.sendBlocked = false;
+    tryTcpSend(item);
+
+    // data that came with the last flight raises no more events
+    tcpChannel->onReceive();
 }
 
 void SocketController::tryTcpSend(TcpChannelItem& item)
@@ -241,19 +411,40 @@ void SocketController::tryTcpSend(TcpChannelItem& item)
         TcpChannelItem::SendData& sendData =
             item.sendBuffer.front();
 
-        size_t size = sendData.buff.size() - sendData.index;
         Socket* socket = item.tcpChannel->mSocket;
 
+        if (sendData.file != nullptr)
+        {
+            int32_t errorCode = 0;
+
+            if (!tryTcpSendFile(socket, sendData, errorCode))
+            {
+                // blocking
+                item.sendBlocked = true;
+                break;
+            }
+
+            item.tcpChannel->onSend(errorCode);
+            item.sendBuffer.pop_front();
+
+            continue;
+        }
+
+        const std::vector<char>& buff = (sendData.shared != nullptr) ?
+            *sendData.shared : sendData.buff;
+
+        size_t size = buff.size() - sendData.index;
+
         // send
         int32_t result = socket->send(
-            &sendData.buff[sendData.index],
+            &buff[sendData.index],
             static_cast<uint32_t>(size), Socket::SendFlags);
 
         if (result >= 0)
         {
             sendData.index += static_cast<size_t>(result);
 
-            if (sendData.index == sendData.buff.size())
+            if (sendData.index == buff.size())
             {
                 // success
                 item.tcpChannel->onSend(0);
@@ -281,6 +472,86 @@ void SocketController::tryTcpSend(TcpChannelItem& item)
 
         item.sendBuffer.pop_front();
     }
+
+    if (item.tcpChannel != nullptr)
+    {
+        // what the socket has buffered (TLS records) is
+        // written in one go before the next wait
+        mTcpFlushes.insert(item.tcpChannel->mSocket->getHandle());
+    }
+}
+
+void SocketController::flushTcpChannels()
+{
+    std::set<Socket::Handle> flushes;
+    flushes.swap(mTcpFlushes);
+
+    for (Socket::Handle sockHandle : flushes)
+    {
+        auto it = mTcpChannels.find(sockHandle);
+        if (it == mTcpChannels.end())
+        {
+            continue;
+        }
+
+        TcpChannelItem& item = it->second;
+
+        if (item.tcpChannel == nullptr)
+        {
+            continue;
+        }
+
+        Socket* socket = item.tcpChannel->mSocket;
+
+        if (!socket->flush() && socket->isBlockingError())
+        {
+            // retried on the send event
+            item.sendBlocked = true;
+        }
+    }
+}
+
+bool SocketController::tryTcpSendFile(
+    Socket* socket, TcpChannelItem::SendData& sendData,
+    int32_t& errorCode)
+{
+    int fileHandle = File::getHandle(sendData.file.get());
+
+    while (sendData.fileOffset < sendData.fileEnd)
+    {
+        uint64_t size = sendData.fileEnd - sendData.fileOffset;
+
+        if (size > INT32_MAX)
+        {
+            size = INT32_MAX;
+        }
+
+        int32_t result = socket->sendFile(
+            fileHandle, sendData.fileOffset, static_cast<uint32_t>(size));
+
+        if (result > 0)
+        {
+            sendData.fileOffset += static_cast<uint64_t>(result);
+        }
+        else if ((result < 0) && socket->isBlockingError())
+        {
+            // blocking
+            return false;
+        }
+        else
+        {
+            // error, or the file was truncated
+            errorCode = ((result < 0) ?
+                socket->getErrorCode() : -5262);
+
+            return true;
+        }
+    }
+
+    // success
+    errorCode = 0;
+
+    return true;
 }
 
 void SocketController::startTcpChannelCloseTimer(TcpChannelItem& item)
@@ -386,33 +657,34 @@ bool SocketController::onSelectTcpConnect(
     }
 
     TcpClientItem item = it->second;
+    TcpClient* tcpClient = item.tcpClient.get();
 
     mTcpClients.erase(it);
     mSelector.unregisterSocket(item.key);
 
-    if (errorCode == 0)
+    auto connectIt = mTcpConnects.find(tcpClient);
+    if (connectIt == mTcpConnects.end())
     {
-        // success
+        delete item.socket;
+        return true;
+    }
 
-        delete item.cancelTimer;
-        item.cancelTimer = nullptr;
+    connectIt->second.attempts.remove(sockHandle);
 
-        item.tcpClient->onConnect(item.socket, 0);
+    if (errorCode == 0)
+    {
+        // success
+        endTcpConnect(tcpClient, item.socket, 0);
     }
     else
     {
-        item.lastErrorCode = errorCode;
+        connectIt->second.lastErrorCode = errorCode;
 
         // error
         delete item.socket;
-        item.socket = nullptr;
 
-        // next
-        if (tryTcpConnect(item))
-        {
-            delete item.cancelTimer;
-            item.cancelTimer = nullptr;
-        }
+        // next, without waiting for the attempt delay
+        tryTcpConnect(tcpClient);
     }
 
     return true;
@@ -430,6 +702,15 @@ bool SocketController::onSelectTcpReceive(
     TcpChannelItem& item = it->second;
 
     if (item.tcpChannel != nullptr)
+    {
+        item.tcpChannel->mSocket->onReadable(false);
+    }
+
+    if (item.handshaking)
+    {
+        tryTcpHandshake(sockHandle);
+    }
+    else if (item.tcpChannel != nullptr)
     {
         item.tcpChannel->onReceive();
     }
@@ -447,6 +728,26 @@ bool SocketController::onSelectTcpSend(
     }
 
     TcpChannelItem& item = it->second;
+
+    if (item.handshaking)
+    {
+        tryTcpHandshake(sockHandle);
+        return true;
+    }
+
+    if (item.tcpChannel == nullptr)
+    {
+        // closing
+        if (item.shutdownPending &&
+            (item.socket->flush() || !item.socket->isBlockingError()))
+        {
+            item.socket->shutdown(Socket::ShutdownSend);
+            item.shutdownPending = false;
+        }
+
+        return true;
+    }
+
     item.sendBlocked = false;
 
     tryTcpSend(item);
@@ -463,19 +764,44 @@ bool SocketController::onSelectTcpClose(
         return false;
     }
 
-    TcpChannelItem& item = it->second;
-    TcpChannelPtr tcpChannel = item.tcpChannel;
+    if (it->second.tcpChannel != nullptr)
+    {
+        it->second.tcpChannel->mSocket->onReadable(true);
+    }
 
-    while (!item.sendBuffer.empty())
+    if (it->second.handshaking)
     {
-        if (tcpChannel != nullptr)
+        // what has arrived may still complete it
+        tryTcpHandshake(sockHandle);
+
+        it = mTcpChannels.find(sockHandle);
+        if (it == mTcpChannels.end())
         {
-            tcpChannel->onSend(-5211);
+            return true;
+        }
+
+        if (it->second.handshaking)
+        {
+            endTcpHandshake(sockHandle, -5121);
+            return true;
         }
+    }
 
+    TcpChannelItem& item = it->second;
+
+    while (!item.sendBuffer.empty())
+    {
         item.sendBuffer.pop_front();
+
+        if (item.tcpChannel != nullptr)
+        {
+            item.tcpChannel->onSend(-5211);
+        }
     }
 
+    // the send handler may have closed the channel
+    TcpChannelPtr tcpChannel = item.tcpChannel;
+
     if (tcpChannel != nullptr)
     {
         char eof[1];
@@ -501,6 +827,7 @@ bool SocketController::onSelectTcpClose(
         delete item.closeTimer;
     }
 
+    delete item.handshakeTimer;
     mTcpChannels.erase(it);
 
     return true;
@@ -580,7 +907,10 @@ bool SocketController::registerTcpChannel(const TcpChannelPtr& tcpChannel)
     item.tcpChannel = tcpChannel;
     item.socket = nullptr;
     item.closeTimer = nullptr;
+    item.shutdownPending = false;
     item.sendBlocked = true;
+    item.handshaking = false;
+    item.handshakeTimer = nullptr;
 
     if (!mSelector.registerSocket(sockHandle,
         (SocketSelector::Close |
@@ -592,6 +922,19 @@ bool SocketController::registerTcpChannel(const TcpChannelPtr& tcpChannel)
         return false;
     }
 
+    if (tcpChannel->mSocket->isHandshaking())
+    {
+        // started by the first socket event,
+        // which is reported as soon as it is registered
+        item.handshaking = true;
+
+        item.handshakeTimer = new Timer();
+        item.handshakeTimer->start(
+            TcpHandshakeTimeout, false, [this, sockHandle](Timer*) {
+            endTcpHandshake(sockHandle, -5123);
+        });
+    }
+
     return true;
 }
 
@@ -609,6 +952,8 @@ void SocketController::unregisterTcpChannel(const TcpChannelPtr& tcpChannel)
     TcpChannelItem& item = it->second;
 
     mSelector.unregisterSocket(item.key);
+
+    delete item.handshakeTimer;
     mTcpChannels.erase(it);
 }
 
@@ -621,11 +966,20 @@ void SocketController::requestTcpConnect(
     const std::list<IpEndPoint>& endPointList,
     uint32_t msecTimeout)
 {
-    TcpClientItem item;
+    TcpClient* key = tcpClient.get();
+
+    if (mTcpConnects.find(key) != mTcpConnects.end())
+    {
+        assert(false);
+        return;
+    }
+
+    TcpConnectItem& item = mTcpConnects[key];
     item.tcpClient = tcpClient;
-    item.endPointList = endPointList;
+    item.endPointList = interleaveEndPoints(endPointList);
     item.msecTimeout = msecTimeout;
     item.lastErrorCode = -5100;
+    item.attemptTimer = new Timer();
 
     item.cancelTimer = new Timer();
     item.cancelTimer->start(
@@ -637,32 +991,37 @@ void SocketController::requestTcpConnect(
         }
     });
 
-    if (tryTcpConnect(item))
-    {
-        delete item.cancelTimer;
-    }
+    tryTcpConnect(key);
 }
 
 bool SocketController::cancelTcpConnect(const TcpClientPtr& tcpClient)
 {
-    for (auto& pair : mTcpClients)
+    auto it = mTcpConnects.find(tcpClient.get());
+    if (it == mTcpConnects.end())
     {
-        TcpClientItem& item = pair.second;
-
-        if (item.tcpClient == tcpClient)
-        {
-            mSelector.unregisterSocket(item.key);
+        return false;
+    }
 
-            delete item.socket;
-            delete item.cancelTimer;
+    TcpConnectItem& item = it->second;
 
-            mTcpClients.erase(pair.first);
+    for (Socket::Handle sockHandle : item.attempts)
+    {
+        auto clientIt = mTcpClients.find(sockHandle);
+        if (clientIt != mTcpClients.end())
+        {
+            mSelector.unregisterSocket(clientIt->second.key);
+            delete clientIt->second.socket;
 
-            return true;
+            mTcpClients.erase(clientIt);
         }
     }
 
-    return false;
+    delete item.cancelTimer;
+    delete item.attemptTimer;
+
+    mTcpConnects.erase(it);
+
+    return true;
 }
 
 bool SocketController::requestTcpSend(
@@ -683,6 +1042,106 @@ bool SocketController::requestTcpSend(
     TcpChannelItem::SendData sendData;
     sendData.buff = std::move(data);
     sendData.index = 0;
+    sendData.fileOffset = 0;
+    sendData.fileEnd = 0;
+    item.sendBuffer.push_back(std::move(sendData));
+
+    if (!item.sendBlocked)
+    {
+        tryTcpSend(item);
+    }
+
+    return true;
+}
+
+bool SocketController::requestTcpSend(
+    const TcpChannelPtr& tcpChannel,
+    const std::shared_ptr<const std::vector<char>>& data)
+{
+    Socket::Handle sockHandle =
+        tcpChannel->mSocket->getHandle();
+
+    auto it = mTcpChannels.find(sockHandle);
+    if (it == mTcpChannels.end())
+    {
+        return false;
+    }
+
+    TcpChannelItem& item = it->second;
+
+    TcpChannelItem::SendData sendData;
+    sendData.shared = data;
+    sendData.index = 0;
+    sendData.fileOffset = 0;
+    sendData.fileEnd = 0;
+    item.sendBuffer.push_back(std::move(sendData));
+
+    if (!item.sendBlocked)
+    {
+        tryTcpSend(item);
+    }
+
+    return true;
+}
+
+bool SocketController::appendTcpSend(
+    const TcpChannelPtr& tcpChannel,
+    const void* data, size_t size)
+{
+    Socket::Handle sockHandle =
+        tcpChannel->mSocket->getHandle();
+
+    auto it = mTcpChannels.find(sockHandle);
+    if (it == mTcpChannels.end())
+    {
+        return false;
+    }
+
+    TcpChannelItem& item = it->second;
+
+    if (item.sendBuffer.empty())
+    {
+        return false;
+    }
+
+    // the handler of the last buffer is called
+    // when the appended data is written too
+    TcpChannelItem::SendData& sendData = item.sendBuffer.back();
+
+    if ((sendData.file != nullptr) ||
+        (sendData.shared != nullptr) ||
+        (sendData.buff.size() + size > TcpSendCoalesceSize))
+    {
+        return false;
+    }
+
+    const char* bytes = reinterpret_cast<const char*>(data);
+    sendData.buff.insert(sendData.buff.end(), bytes, bytes + size);
+
+    return true;
+}
+
+bool SocketController::requestTcpSendFile(
+    const TcpChannelPtr& tcpChannel,
+    const std::shared_ptr<std::FILE>& file,
+    uint64_t offset, uint64_t size)
+{
+    Socket::Handle sockHandle =
+        tcpChannel->mSocket->getHandle();
+
+    auto it = mTcpChannels.find(sockHandle);
+    if (it == mTcpChannels.end())
+    {
+        return false;
+    }
+
+    TcpChannelItem& item = it->second;
+
+    TcpChannelItem::SendData sendData;
+    sendData.index = 0;
+    sendData.file = file;
+    sendData.fileOffset = offset;
+    sendData.fileEnd = offset + size;
     item.sendBuffer.push_back(std::move(sendData));
 
     if (!item.sendBlocked)
@@ -716,6 +1175,37 @@ bool SocketController::cancelTcpSend(const TcpChannelPtr& tcpChannel)
     return true;
 }
 
+size_t SocketController::getTcpSendQueueSize(
+    Socket::Handle sockHandle) const
+{
+    auto it = mTcpChannels.find(sockHandle);
+    if (it == mTcpChannels.end())
+    {
+        return 0;
+    }
+
+    size_t size = 0;
+
+    for (const auto& sendData : it->second.sendBuffer)
+    {
+        if (sendData.file != nullptr)
+        {
+            size += static_cast<size_t>(
+                sendData.fileEnd - sendData.fileOffset);
+        }
+        else if (sendData.shared != nullptr)
+        {
+            size += (sendData.shared->size() - sendData.index);
+        }
+        else
+        {
+            size += (sendData.buff.size() - sendData.index);
+        }
+    }
+
+    return size;
+}
+
 void SocketController::requestTcpChannelClose(const TcpChannelPtr& tcpChannel)
 {
     Socket::Handle sockHandle =
@@ -728,15 +1218,29 @@ void SocketController::requestTcpChannelClose(const TcpChannelPtr& tcpChannel)
     }
 
     TcpChannelItem& item = it->second;
+    Socket* socket = item.tcpChannel->mSocket;
+
+    // shutdown, after what the socket has buffered (TLS records).
+    // if blocking, the send event retries until the close timer.
+    if (socket->flush() || !socket->isBlockingError())
+    {
+        socket->shutdown(Socket::ShutdownSend);
+    }
+    else
+    {
+        item.shutdownPending = true;
+    }
 
-    // shutdown
-    item.tcpChannel->mSocket->shutdown(Socket::ShutdownSend);
     startTcpChannelCloseTimer(item);
 
     item.socket = item.tcpChannel->mSocket;
     item.tcpChannel->mSocket = nullptr;
     item.tcpChannel = nullptr;
     item.sendBuffer.clear();
+
+    item.handshaking = false;
+    delete item.handshakeTimer;
+    item.handshakeTimer = nullptr;
 }
 
 void SocketController::onTcpReceiveEof(const TcpChannelPtr& tcpChannel)
@@ -756,6 +1260,7 @@ void SocketController::onTcpReceiveEof(const TcpChannelPtr& tcpChannel)
 
     item.tcpChannel->onClose();
 
+    delete item.handshakeTimer;
     mTcpChannels.erase(it);
 }
 
@@ -3,7 +3,13 @@
 
 #ifdef SEV_SUPPORTS_SSL
 
+#include <map>
+#include <list>
+#include <mutex>
+#include <string>
 #include <memory>
+#include <chrono>
+#include <vector>
 
 #include <openssl/ssl.h>
 
@@ -13,6 +19,7 @@
 SEV_NS_BEGIN
 
 class SslContext;
+class SecureSocket;
 
 typedef std::shared_ptr<SslContext> SslContextPtr;
 
@@ -51,18 +58,91 @@ public:
         int mode, int(*verify_callback)(int, X509_STORE_CTX*));
     SEV_DECL void setVerifyDepth(int depth);
 
+    // kernel TLS after the handshake, where the kernel supports
+    // the cipher. otherwise the socket stays in user space.
+    // returns false if OpenSSL is built without it.
+    SEV_DECL bool setKtls(bool on);
+
+public:
+
+    // client session cache (keyed by origin)
+
+    // 0: disabled
+    SEV_DECL void setSessionCacheSize(size_t size);
+
+    SEV_DECL size_t getSessionCount() const;
+
+    // returns a new reference or nullptr
+    SEV_DECL SSL_SESSION* getSession(const std::string& key);
+
+    SEV_DECL void putSession(const std::string& key, SSL_SESSION* session);
+    SEV_DECL void removeSession(const std::string& key);
+    SEV_DECL void clearSessions();
+
+public:
+
+    // server session tickets
+
+    // tickets are encrypted with a key that is replaced every
+    // interval. tickets of the previous (keyCount - 1) keys are
+    // still accepted and renewed.
+    SEV_DECL bool setTicketKeyRotation(
+        uint32_t secInterval, size_t keyCount = 2);
+
+    SEV_DECL void rotateTicketKey();
+
 public:
     SEV_DECL SSL_CTX* getHandle() const
     {
         return mHandle;
     }
 
+    // shared by clients that do not specify a context,
+    // so that their sessions can be resumed
+    SEV_DECL static SslContextPtr getDefaultClientContext();
+
     SEV_DECL SslContext(const SSL_METHOD* method);
 
 private:
+    struct TicketKey
+    {
+        unsigned char name[16];
+        unsigned char aesKey[32];
+        unsigned char hmacKey[32];
+        std::chrono::steady_clock::time_point created;
+    };
+
+    SEV_DECL void enableClientSessionCache();
+    SEV_DECL bool generateTicketKey();
+
+    SEV_DECL static int onNewSession(SSL* ssl, SSL_SESSION* session);
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+    SEV_DECL static int onTicketKey(
+        SSL* ssl, unsigned char* keyName, unsigned char* iv,
+        EVP_CIPHER_CTX* cipherCtx, EVP_MAC_CTX* macCtx, int enc);
+#else
+    SEV_DECL static int onTicketKey(
+        SSL* ssl, unsigned char* keyName, unsigned char* iv,
+        EVP_CIPHER_CTX* cipherCtx, HMAC_CTX* macCtx, int enc);
+#endif
+
     SslContext() = delete;
+    SslContext(const SslContext&) = delete;
+    SslContext& operator=(const SslContext&) = delete;
 
     SSL_CTX* mHandle;
+
+    mutable std::mutex mMutex;
+    std::map<std::string, SSL_SESSION*> mSessions;
+    std::list<std::string> mSessionOrder;
+    size_t mMaxSessions;
+    bool mClientCacheEnabled;
+
+    std::list<TicketKey> mTicketKeys;
+    uint32_t mTicketKeyInterval;
+    size_t mTicketKeyCount;
+
+    friend class SecureSocket;
 };
 
 //---------------------------------------------------------------------------//
@@ -86,15 +166,69 @@ public:
 
     SEV_DECL void close() override;
 
+    // records are written to the socket in one batch
+    SEV_DECL bool flush() override;
+
+    // SSL_sendfile() with kernel TLS, SSL_write() otherwise
+    SEV_DECL int32_t sendFile(
+        int fileHandle, uint64_t offset, uint32_t size) override;
+
+    SEV_DECL bool isBlockingError() const override;
+
+    // kernel TLS in use (SslContext::setKtls())
+    SEV_DECL bool isKtlsSend() const;
+    SEV_DECL bool isKtlsReceive() const;
+
+    // client session cache key, usually the origin
+    SEV_DECL void setSessionKey(const std::string& key)
+    {
+        mSessionKey = key;
+    }
+
+    SEV_DECL const std::string& getSessionKey() const
+    {
+        return mSessionKey;
+    }
+
+    SEV_DECL bool isSessionReused() const;
+
 public:
     SEV_DECL bool onAccept() override;
     SEV_DECL bool onConnect() override;
 
+    SEV_DECL bool handshake() override;
+    SEV_DECL bool isHandshaking() const override;
+
+    SEV_DECL void onReadable(bool peerClosed) override;
+
+    // bytes of records buffered until flush()
+    static const size_t MaxWriteBuffer = 64 * 1024;
+
+    // bytes read from the socket at once
+    static const size_t ReadSize = 64 * 1024;
+
 private:
     SecureSocket() = delete;
 
+    SEV_DECL bool createSsl();
+    SEV_DECL int32_t fill();
+    SEV_DECL size_t getWritePending() const;
+
     SSL* mSsl;
     SslContextPtr mSslCtx;
+    std::string mSessionKey;
+
+    // memory BIOs owned by mSsl, nullptr with kernel TLS
+    BIO* mReadBio;
+    BIO* mWriteBio;
+
+    // records the socket did not take
+    std::vector<char> mWriteBuffer;
+
+    // nothing more to read until the next event
+    bool mReadDrained;
+    bool mReadEof;
+    bool mPeerClosed;
 };
 
 //---------------------------------------------------------------------------//
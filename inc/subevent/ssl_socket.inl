@@ -3,7 +3,14 @@
 
 #ifdef SEV_SUPPORTS_SSL
 
+#include <ctime>
+#include <cstring>
+
 #include <openssl/err.h>
+#include <openssl/rand.h>
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+#include <openssl/core_names.h>
+#endif
 
 #include <subevent/ssl_socket.hpp>
 
@@ -18,13 +25,33 @@ SslContext::SslContext(const SSL_METHOD* method)
     OpenSsl::init();
 
     mHandle = SSL_CTX_new(method);
+
+    mMaxSessions = 128;
+    mClientCacheEnabled = false;
+    mTicketKeyInterval = 0;
+    mTicketKeyCount = 0;
+
+    if (mHandle != nullptr)
+    {
+        SSL_CTX_set_app_data(mHandle, this);
+    }
 }
 
 SslContext::~SslContext()
 {
+    clearSessions();
+
     SSL_CTX_free(mHandle);
 }
 
+SslContextPtr SslContext::getDefaultClientContext()
+{
+    static SslContextPtr sslCtx =
+        SslContext::newInstance(SSLv23_client_method());
+
+    return sslCtx;
+}
+
 unsigned long SslContext::setOptions(long options)
 {
     return SSL_CTX_set_options(mHandle, options);
@@ -100,6 +127,354 @@ void SslContext::setVerifyDepth(int depth)
     SSL_CTX_set_verify_depth(mHandle, depth);
 }
 
+bool SslContext::setKtls(bool on)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    if (on)
+    {
+        SSL_CTX_set_options(mHandle, SSL_OP_ENABLE_KTLS);
+    }
+    else
+    {
+        SSL_CTX_clear_options(mHandle, SSL_OP_ENABLE_KTLS);
+    }
+
+    return true;
+#else
+    return !on;
+#endif
+}
+
+void SslContext::setSessionCacheSize(size_t size)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mMaxSessions = size;
+
+    while (mSessions.size() > mMaxSessions)
+    {
+        auto it = mSessions.find(mSessionOrder.front());
+
+        SSL_SESSION_free(it->second);
+        mSessions.erase(it);
+        mSessionOrder.pop_front();
+    }
+}
+
+size_t SslContext::getSessionCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mSessions.size();
+}
+
+SSL_SESSION* SslContext::getSession(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto it = mSessions.find(key);
+    if (it == mSessions.end())
+    {
+        return nullptr;
+    }
+
+    SSL_SESSION* session = it->second;
+
+    long expires = static_cast<long>(SSL_SESSION_get_time(session)) +
+        static_cast<long>(SSL_SESSION_get_timeout(session));
+
+    if (!SSL_SESSION_is_resumable(session) ||
+        (expires <= static_cast<long>(std::time(nullptr))))
+    {
+        // expired
+        SSL_SESSION_free(session);
+        mSessions.erase(it);
+        mSessionOrder.remove(key);
+
+        return nullptr;
+    }
+
+    SSL_SESSION_up_ref(session);
+
+    return session;
+}
+
+void SslContext::putSession(const std::string& key, SSL_SESSION* session)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mMaxSessions == 0)
+    {
+        return;
+    }
+
+    SSL_SESSION_up_ref(session);
+
+    auto it = mSessions.find(key);
+    if (it != mSessions.end())
+    {
+        // newer ticket
+        SSL_SESSION_free(it->second);
+        it->second = session;
+
+        return;
+    }
+
+    if (mSessions.size() >= mMaxSessions)
+    {
+        // oldest first
+        auto oldest = mSessions.find(mSessionOrder.front());
+
+        SSL_SESSION_free(oldest->second);
+        mSessions.erase(oldest);
+        mSessionOrder.pop_front();
+    }
+
+    mSessions[key] = session;
+    mSessionOrder.push_back(key);
+}
+
+void SslContext::removeSession(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto it = mSessions.find(key);
+    if (it == mSessions.end())
+    {
+        return;
+    }
+
+    SSL_SESSION_free(it->second);
+    mSessions.erase(it);
+    mSessionOrder.remove(key);
+}
+
+void SslContext::clearSessions()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    for (auto& pair : mSessions)
+    {
+        SSL_SESSION_free(pair.second);
+    }
+
+    mSessions.clear();
+    mSessionOrder.clear();
+}
+
+void SslContext::enableClientSessionCache()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mClientCacheEnabled)
+    {
+        return;
+    }
+
+    // sessions are kept in mSessions, not in the OpenSSL cache
+    SSL_CTX_set_session_cache_mode(mHandle,
+        SSL_CTX_get_session_cache_mode(mHandle) |
+        SSL_SESS_CACHE_CLIENT |
+        SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(mHandle, SslContext::onNewSession);
+
+    mClientCacheEnabled = true;
+}
+
+int SslContext::onNewSession(SSL* ssl, SSL_SESSION* session)
+{
+    SecureSocket* socket =
+        static_cast<SecureSocket*>(SSL_get_app_data(ssl));
+    SslContext* sslCtx = static_cast<SslContext*>(
+        SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+
+    if ((socket == nullptr) ||
+        (sslCtx == nullptr) ||
+        socket->getSessionKey().empty())
+    {
+        return 0;
+    }
+
+    sslCtx->putSession(socket->getSessionKey(), session);
+
+    // a reference is taken by putSession()
+    return 0;
+}
+
+bool SslContext::setTicketKeyRotation(
+    uint32_t secInterval, size_t keyCount)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mTicketKeyInterval = secInterval;
+    mTicketKeyCount = ((keyCount > 0) ? keyCount : 1);
+
+    mTicketKeys.clear();
+
+    if (!generateTicketKey())
+    {
+        return false;
+    }
+
+    static const unsigned char sessionIdContext[] = "subevent";
+
+    SSL_CTX_set_session_id_context(
+        mHandle, sessionIdContext, sizeof(sessionIdContext) - 1);
+
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(mHandle, SslContext::onTicketKey);
+#else
+    SSL_CTX_set_tlsext_ticket_key_cb(mHandle, SslContext::onTicketKey);
+#endif
+
+    return true;
+}
+
+void SslContext::rotateTicketKey()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (!mTicketKeys.empty())
+    {
+        generateTicketKey();
+    }
+}
+
+bool SslContext::generateTicketKey()
+{
+    TicketKey key;
+
+    if ((RAND_bytes(key.name, sizeof(key.name)) != 1) ||
+        (RAND_bytes(key.aesKey, sizeof(key.aesKey)) != 1) ||
+        (RAND_bytes(key.hmacKey, sizeof(key.hmacKey)) != 1))
+    {
+        return false;
+    }
+
+    key.created = std::chrono::steady_clock::now();
+
+    // newest first
+    mTicketKeys.push_front(key);
+
+    while (mTicketKeys.size() > mTicketKeyCount)
+    {
+        mTicketKeys.pop_back();
+    }
+
+    return true;
+}
+
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+int SslContext::onTicketKey(
+    SSL* ssl, unsigned char* keyName, unsigned char* iv,
+    EVP_CIPHER_CTX* cipherCtx, EVP_MAC_CTX* macCtx, int enc)
+#else
+int SslContext::onTicketKey(
+    SSL* ssl, unsigned char* keyName, unsigned char* iv,
+    EVP_CIPHER_CTX* cipherCtx, HMAC_CTX* macCtx, int enc)
+#endif
+{
+    SslContext* sslCtx = static_cast<SslContext*>(
+        SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+
+    if (sslCtx == nullptr)
+    {
+        return -1;
+    }
+
+    std::lock_guard<std::mutex> lock(sslCtx->mMutex);
+
+    if (sslCtx->mTicketKeys.empty())
+    {
+        return -1;
+    }
+
+    const TicketKey* key = nullptr;
+    int result = 1;
+
+    if (enc == 1)
+    {
+        // encrypt
+        auto age = std::chrono::steady_clock::now() -
+            sslCtx->mTicketKeys.front().created;
+
+        if ((sslCtx->mTicketKeyInterval != 0) &&
+            (age >= std::chrono::seconds(sslCtx->mTicketKeyInterval)))
+        {
+            // rotate
+            sslCtx->generateTicketKey();
+        }
+
+        key = &sslCtx->mTicketKeys.front();
+
+        if (RAND_bytes(iv, EVP_MAX_IV_LENGTH) != 1)
+        {
+            return -1;
+        }
+
+        std::memcpy(keyName, key->name, sizeof(key->name));
+
+        if (EVP_EncryptInit_ex(cipherCtx,
+            EVP_aes_256_cbc(), nullptr, key->aesKey, iv) != 1)
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        // decrypt
+        for (const auto& ticketKey : sslCtx->mTicketKeys)
+        {
+            if (std::memcmp(keyName,
+                ticketKey.name, sizeof(ticketKey.name)) == 0)
+            {
+                key = &ticketKey;
+                break;
+            }
+        }
+
+        if (key == nullptr)
+        {
+            // unknown or expired key, full handshake
+            return 0;
+        }
+
+        if ((key != &sslCtx->mTicketKeys.front()) ||
+            (SSL_version(ssl) >= TLS1_3_VERSION))
+        {
+            // issue a ticket with the current key,
+            // tls1.3 clients use each ticket only once
+            result = 2;
+        }
+
+        if (EVP_DecryptInit_ex(cipherCtx,
+            EVP_aes_256_cbc(), nullptr, key->aesKey, iv) != 1)
+        {
+            return -1;
+        }
+    }
+
+#if (OPENSSL_VERSION_NUMBER >= 0x30000000L)
+    OSSL_PARAM params[2];
+    params[0] = OSSL_PARAM_construct_utf8_string(
+        OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0);
+    params[1] = OSSL_PARAM_construct_end();
+
+    if (EVP_MAC_init(macCtx,
+        key->hmacKey, sizeof(key->hmacKey), params) != 1)
+    {
+        return -1;
+    }
+#else
+    if (HMAC_Init_ex(macCtx,
+        key->hmacKey, sizeof(key->hmacKey), EVP_sha256(), nullptr) != 1)
+    {
+        return -1;
+    }
+#endif
+
+    return result;
+}
+
 //----------------------------------------------------------------------------//
 // SecureSocket
 //----------------------------------------------------------------------------//
@@ -111,10 +486,17 @@ SecureSocket::SecureSocket(const SslContextPtr& sslCtx, Handle handle)
 
     mSslCtx = sslCtx;
     mSsl = nullptr;
+    mReadBio = nullptr;
+    mWriteBio = nullptr;
+    mReadDrained = false;
+    mReadEof = false;
+    mPeerClosed = false;
 }
 
 SecureSocket::~SecureSocket()
 {
+    // Socket::~Socket() does not free the SSL
+    close();
 }
 
 Socket* SecureSocket::accept()
@@ -136,40 +518,164 @@ Socket* SecureSocket::accept()
 int32_t SecureSocket::send(
     const void* data, uint32_t size, int32_t /* flags */)
 {
-    int result = SSL_write(mSsl, data, size);
+    ERR_clear_error();
 
-    mErrorCode = SSL_get_error(mSsl, result);
+    if (mWriteBio == nullptr)
+    {
+        int result = SSL_write(mSsl, data, size);
 
-    return result;
+        mErrorCode = SSL_get_error(mSsl, result);
+
+        return result;
+    }
+
+    const char* bytes = static_cast<const char*>(data);
+    uint32_t total = 0;
+
+    // the buffer is kept small, flushed when it gets full
+    while (total < size)
+    {
+        if ((getWritePending() >= MaxWriteBuffer) && !flush())
+        {
+            if (!Socket::isBlockingError())
+            {
+                return -1;
+            }
+
+            mErrorCode = SSL_ERROR_WANT_WRITE;
+            break;
+        }
+
+        uint32_t chunk = size - total;
+
+        if (chunk > MaxWriteBuffer)
+        {
+            chunk = static_cast<uint32_t>(MaxWriteBuffer);
+        }
+
+        int result = SSL_write(mSsl, bytes + total, chunk);
+
+        mErrorCode = SSL_get_error(mSsl, result);
+
+        if (result <= 0)
+        {
+            break;
+        }
+
+        total += static_cast<uint32_t>(result);
+    }
+
+    if ((total == 0) && (size > 0))
+    {
+        return -1;
+    }
+
+    return static_cast<int32_t>(total);
 }
 
 int32_t SecureSocket::receive(
     void* buff, uint32_t size, int32_t flags)
 {
     int result;
-    
+
+    if (mReadBio == nullptr)
+    {
+        if (flags & MSG_PEEK)
+        {
+            result = SSL_peek(mSsl, buff, size);
+
+            mErrorCode = SSL_get_error(mSsl, result);
+
+            if (result == -1)
+            {
+                if (mErrorCode == SSL_ERROR_WANT_READ)
+                {
+                    result = static_cast<int32_t>(size);
+                }
+            }
+        }
+        else
+        {
+            result = SSL_read(mSsl, buff, size);
+
+            mErrorCode = SSL_get_error(mSsl, result);
+        }
+
+        return result;
+    }
+
     if (flags & MSG_PEEK)
     {
-        result = SSL_peek(mSsl, buff, size);
+        // only tells eof or not, without a syscall if possible
+        if ((SSL_pending(mSsl) > 0) || (BIO_ctrl_pending(mReadBio) > 0))
+        {
+            return static_cast<int32_t>(size);
+        }
 
-        mErrorCode = SSL_get_error(mSsl, result);
+        if (!mReadEof && (mReadDrained || !mPeerClosed))
+        {
+            return static_cast<int32_t>(size);
+        }
 
-        if (result == -1)
+        if (!mReadEof)
         {
-            if (mErrorCode == SSL_ERROR_WANT_READ)
+            result = Socket::receive(buff, size, MSG_PEEK);
+
+            if (result != 0)
             {
-                result = static_cast<int32_t>(size);
+                return static_cast<int32_t>(size);
             }
+
+            mReadEof = true;
         }
+
+        return 0;
     }
-    else
+
+    for (;;)
     {
+        ERR_clear_error();
+
         result = SSL_read(mSsl, buff, size);
 
         mErrorCode = SSL_get_error(mSsl, result);
-    }
 
-    return result;
+        if ((result > 0) || (mErrorCode != SSL_ERROR_WANT_READ))
+        {
+            if (BIO_ctrl_pending(mWriteBio) > 0)
+            {
+                // written by SSL_read() (key update)
+                int sslError = mErrorCode;
+                flush();
+                mErrorCode = sslError;
+            }
+
+            // data, close_notify or error
+            return result;
+        }
+
+        if (mReadEof)
+        {
+            // closed without close_notify
+            return 0;
+        }
+
+        if (mReadDrained)
+        {
+            // blocking
+            return -1;
+        }
+
+        if (fill() < 0)
+        {
+            if (Socket::isBlockingError())
+            {
+                mErrorCode = SSL_ERROR_WANT_READ;
+            }
+
+            return -1;
+        }
+    }
 }
 
 void SecureSocket::close()
@@ -178,57 +684,359 @@ void SecureSocket::close()
     {
         SSL_shutdown(mSsl);
 
+        // close_notify
+        flush();
+
+        SSL_set_app_data(mSsl, nullptr);
         SSL_free(mSsl);
         mSsl = nullptr;
+
+        mReadBio = nullptr;
+        mWriteBio = nullptr;
     }
     
     Socket::close();
 }
 
-bool SecureSocket::onAccept()
+bool SecureSocket::flush()
 {
-    mSsl = SSL_new(mSslCtx->getHandle());
+    if (mWriteBio == nullptr)
+    {
+        return true;
+    }
+
+    char* data = nullptr;
+    long size = BIO_get_mem_data(mWriteBio, &data);
+    size_t index = 0;
 
-    if (SSL_set_fd(mSsl,
-        static_cast<int>(getHandle())) != 1)
+    if ((size <= 0) && mWriteBuffer.empty())
     {
-        return false;
+        // nothing buffered
+        return true;
     }
 
-    int result = SSL_accept(mSsl);
+    if (!mWriteBuffer.empty())
+    {
+        // older records first
+        while (index < mWriteBuffer.size())
+        {
+            int32_t result = Socket::send(
+                &mWriteBuffer[index],
+                static_cast<uint32_t>(mWriteBuffer.size() - index),
+                SendFlags);
 
-    mErrorCode = SSL_get_error(mSsl, result);
+            if (result < 0)
+            {
+                break;
+            }
 
-    if (result != 1)
+            index += static_cast<size_t>(result);
+        }
+
+        mWriteBuffer.erase(
+            mWriteBuffer.begin(), mWriteBuffer.begin() + index);
+
+        if (!mWriteBuffer.empty())
+        {
+            // blocking or error, the new ones go behind
+            mWriteBuffer.insert(mWriteBuffer.end(), data, data + size);
+            (void)BIO_reset(mWriteBio);
+
+            return false;
+        }
+
+        index = 0;
+    }
+
+    while (index < static_cast<size_t>(size))
+    {
+        int32_t result = Socket::send(
+            data + index,
+            static_cast<uint32_t>(size - index),
+            SendFlags);
+
+        if (result < 0)
+        {
+            // blocking or error
+            mWriteBuffer.assign(data + index, data + size);
+            (void)BIO_reset(mWriteBio);
+
+            return false;
+        }
+
+        index += static_cast<size_t>(result);
+    }
+
+    (void)BIO_reset(mWriteBio);
+
+    return true;
+}
+
+int32_t SecureSocket::sendFile(
+    int fileHandle, uint64_t offset, uint32_t size)
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    if (isKtlsSend())
+    {
+        // zero copy
+        ossl_ssize_t result = SSL_sendfile(
+            mSsl, fileHandle, static_cast<off_t>(offset), size, 0);
+
+        mErrorCode = SSL_get_error(mSsl, static_cast<int>(result));
+
+        return static_cast<int32_t>(result);
+    }
+#endif
+
+    // one record, read again from the same offset on retry
+    char buff[16384];
+
+    int32_t result = readFile(fileHandle, offset, buff,
+        ((size < sizeof(buff)) ? size : sizeof(buff)));
+
+    if (result <= 0)
+    {
+        mErrorCode = SSL_ERROR_SYSCALL;
+        return -1;
+    }
+
+    return send(buff, static_cast<uint32_t>(result));
+}
+
+bool SecureSocket::isBlockingError() const
+{
+    return ((mErrorCode == SSL_ERROR_WANT_READ) ||
+            (mErrorCode == SSL_ERROR_WANT_WRITE) ||
+            Socket::isBlockingError());
+}
+
+bool SecureSocket::isKtlsSend() const
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    return ((mSsl != nullptr) && (mWriteBio == nullptr) &&
+        (BIO_get_ktls_send(SSL_get_wbio(mSsl)) != 0));
+#else
+    return false;
+#endif
+}
+
+bool SecureSocket::isKtlsReceive() const
+{
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    return ((mSsl != nullptr) && (mReadBio == nullptr) &&
+        (BIO_get_ktls_recv(SSL_get_rbio(mSsl)) != 0));
+#else
+    return false;
+#endif
+}
+
+bool SecureSocket::onAccept()
+{
+    if (!createSsl())
     {
         return false;
     }
 
+    // the handshake is driven by handshake()
+    SSL_set_accept_state(mSsl);
+
     return true;
 }
 
 bool SecureSocket::onConnect()
 {
-    mSsl = SSL_new(mSslCtx->getHandle());
-    
-    if (SSL_set_fd(mSsl,
-        static_cast<int>(getHandle())) != 1)
+    if (!createSsl())
     {
         return false;
     }
-    
-    int result = SSL_connect(mSsl);
 
-    mErrorCode = SSL_get_error(mSsl, result);
+    if (!mSessionKey.empty())
+    {
+        mSslCtx->enableClientSessionCache();
 
-    if (result != 1)
+        SSL_set_app_data(mSsl, this);
+
+        // resume
+        SSL_SESSION* session = mSslCtx->getSession(mSessionKey);
+
+        if (session != nullptr)
+        {
+            SSL_set_session(mSsl, session);
+            SSL_SESSION_free(session);
+        }
+    }
+
+    // the handshake is driven by handshake()
+    SSL_set_connect_state(mSsl);
+
+    return true;
+}
+
+bool SecureSocket::handshake()
+{
+    for (;;)
+    {
+        ERR_clear_error();
+
+        int result = SSL_do_handshake(mSsl);
+        int sslError = SSL_get_error(mSsl, result);
+
+        if (mWriteBio != nullptr)
+        {
+            // the flight just made
+            if (!flush() && !Socket::isBlockingError())
+            {
+                break;
+            }
+
+            if (sslError == SSL_ERROR_WANT_READ)
+            {
+                if (fill() > 0)
+                {
+                    continue;
+                }
+
+                if (mReadEof || !Socket::isBlockingError())
+                {
+                    break;
+                }
+            }
+        }
+
+        mErrorCode = sslError;
+
+        if (result == 1)
+        {
+            // completed
+            return true;
+        }
+
+        if ((mErrorCode == SSL_ERROR_WANT_READ) ||
+            (mErrorCode == SSL_ERROR_WANT_WRITE))
+        {
+            // next round trip
+            return true;
+        }
+
+        break;
+    }
+
+    if (!mSessionKey.empty())
+    {
+        mSslCtx->removeSession(mSessionKey);
+    }
+
+    return false;
+}
+
+bool SecureSocket::isHandshaking() const
+{
+    return ((mSsl != nullptr) && !SSL_is_init_finished(mSsl));
+}
+
+bool SecureSocket::isSessionReused() const
+{
+    return ((mSsl != nullptr) && (SSL_session_reused(mSsl) == 1));
+}
+
+void SecureSocket::onReadable(bool peerClosed)
+{
+    mReadDrained = false;
+
+    if (peerClosed)
+    {
+        // read up to eof from now on
+        mPeerClosed = true;
+    }
+}
+
+bool SecureSocket::createSsl()
+{
+    mSsl = SSL_new(mSslCtx->getHandle());
+
+    if (mSsl == nullptr)
     {
         return false;
     }
 
+    bool ktls = false;
+
+#if defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS)
+    ktls = ((SSL_get_options(mSsl) & SSL_OP_ENABLE_KTLS) != 0);
+#endif
+
+    if (ktls)
+    {
+        // the kernel needs the socket BIO
+        if (SSL_set_fd(mSsl,
+            static_cast<int>(getHandle())) != 1)
+        {
+            return false;
+        }
+    }
+    else
+    {
+        // records are decrypted from what receive() has read in one go,
+        // and encrypted into a buffer flush() writes in one go
+        mReadBio = BIO_new(BIO_s_mem());
+        mWriteBio = BIO_new(BIO_s_mem());
+
+        if ((mReadBio == nullptr) || (mWriteBio == nullptr))
+        {
+            BIO_free(mReadBio);
+            BIO_free(mWriteBio);
+            mReadBio = nullptr;
+            mWriteBio = nullptr;
+
+            return false;
+        }
+
+        // empty is not eof
+        BIO_set_mem_eof_return(mReadBio, -1);
+        BIO_set_mem_eof_return(mWriteBio, -1);
+
+        SSL_set_bio(mSsl, mReadBio, mWriteBio);
+    }
+
+    // a blocked write is retried from another buffer
+    SSL_set_mode(mSsl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
     return true;
 }
 
+int32_t SecureSocket::fill()
+{
+    char buff[ReadSize];
+
+    int32_t result = Socket::receive(buff, sizeof(buff));
+
+    if (result > 0)
+    {
+        BIO_write(mReadBio, buff, result);
+
+        // a short read leaves the socket empty,
+        // more data raises another event (edge-triggered)
+        mReadDrained =
+            (!mPeerClosed && (static_cast<size_t>(result) < sizeof(buff)));
+    }
+    else if (result == 0)
+    {
+        mReadEof = true;
+    }
+    else if (Socket::isBlockingError())
+    {
+        mReadDrained = true;
+    }
+
+    return result;
+}
+
+size_t SecureSocket::getWritePending() const
+{
+    return (mWriteBuffer.size() +
+        static_cast<size_t>(BIO_ctrl_pending(mWriteBio)));
+}
+
 //---------------------------------------------------------------------------//
 // OpenSsl
 //---------------------------------------------------------------------------//
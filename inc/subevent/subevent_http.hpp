@@ -15,17 +15,29 @@
 #   define SEV_SUPPORTS_SSL
 #endif
 
+#if (SEV_CPP_VER >= 17)
+#   if __has_include(<zlib.h>)
+#       define SEV_SUPPORTS_ZLIB
+#   endif
+#endif
+
 #include <subevent/ssl_socket.hpp>
+#include <subevent/compression.hpp>
 #include <subevent/http.hpp>
 #include <subevent/http_client.hpp>
+#include <subevent/http_client_pool.hpp>
+#include <subevent/http_client_runtime.hpp>
 #include <subevent/http_server.hpp>
 #include <subevent/http_server_worker.hpp>
 #include <subevent/ws.hpp>
 
 #ifdef SEV_HEADER_ONLY
 #include <subevent/ssl_socket.inl>
+#include <subevent/compression.inl>
 #include <subevent/http.inl>
 #include <subevent/http_client.inl>
+#include <subevent/http_client_pool.inl>
+#include <subevent/http_client_runtime.inl>
 #include <subevent/http_server.inl>
 #include <subevent/http_server_worker.inl>
 #include <subevent/ws.inl>
@@ -9,6 +9,7 @@
 #include <subevent/socket.hpp>
 #include <subevent/tcp.hpp>
 #include <subevent/udp.hpp>
+#include <subevent/resolver.hpp>
 #include <subevent/tcp_server_worker.hpp>
 
 #ifdef SEV_HEADER_ONLY
@@ -20,6 +21,7 @@
 #include <subevent/socket_selector_mac.inl>
 #include <subevent/tcp.inl>
 #include <subevent/udp.inl>
+#include <subevent/resolver.inl>
 #include <subevent/tcp_server_worker.inl>
 #endif
 
@@ -2,7 +2,10 @@
 #define SUBEVENT_TCP_HPP
 
 #include <list>
+#include <cstdio>
+#include <string>
 #include <vector>
+#include <chrono>
 #include <memory>
 #include <utility>
 #include <functional>
@@ -10,7 +13,9 @@
 #include <subevent/std.hpp>
 #include <subevent/common.hpp>
 #include <subevent/event.hpp>
+#include <subevent/timer.hpp>
 #include <subevent/socket.hpp>
+#include <subevent/resolver.hpp>
 
 SEV_NS_BEGIN
 
@@ -123,6 +128,21 @@ public:
     SEV_DECL int32_t sendString(const std::string& data,
         const TcpSendHandler& sendHandler = nullptr);
 
+    // queues a buffer that other channels may send too,
+    // it must not be changed after this call.
+    SEV_DECL int32_t send(
+        const std::shared_ptr<const std::vector<char>>& data,
+        const TcpSendHandler& sendHandler = nullptr);
+
+    // sends size bytes of the file from offset through the send queue,
+    // with sendfile() where the socket allows it.
+    SEV_DECL int32_t sendFile(
+        const std::shared_ptr<std::FILE>& file,
+        uint64_t offset, uint64_t size,
+        const TcpSendHandler& sendHandler = nullptr);
+    SEV_DECL int32_t sendFile(const std::string& fileName,
+        const TcpSendHandler& sendHandler = nullptr);
+
     SEV_DECL int32_t receive(void* buff, size_t size);
     SEV_DECL std::vector<char> receiveAll(size_t reserveSize = 8192);
 
@@ -130,6 +150,17 @@ public:
 
     SEV_DECL bool cancelSend();
 
+    // bytes queued by async send() but not yet written to the socket
+    SEV_DECL size_t getSendQueueSize() const;
+
+    SEV_DECL void pauseReceive();
+    SEV_DECL void resumeReceive();
+
+    SEV_DECL bool isReceivePaused() const
+    {
+        return mReceivePaused;
+    }
+
     SEV_DECL void setReceiveHandler(
         const TcpReceiveHandler& receiveHandler);
     SEV_DECL void setCloseHandler(
@@ -152,6 +183,11 @@ public:
         return mPeerEndPoint;
     }
 
+    SEV_DECL NetWorker* getNetWorker() const
+    {
+        return mNetWorker;
+    }
+
 public:
     SEV_DECL TcpChannel(Socket* socket);
 
@@ -172,9 +208,16 @@ protected:
 
 private:
     SEV_DECL void create(Socket* socket);
+    SEV_DECL int32_t sendNow(const void* data, size_t size);
     SEV_DECL void onReceive();
     SEV_DECL void onSend(int32_t errorCode);
     SEV_DECL void onClose();
+    SEV_DECL virtual void onHandshake(int32_t errorCode);
+
+    // close() on a channel without a socket
+    SEV_DECL virtual void abortConnect()
+    {
+    }
 
     TcpChannel(const TcpChannel&) = delete;
     TcpChannel& operator=(const TcpChannel&) = delete;
@@ -189,6 +232,9 @@ private:
     TcpReceiveHandler mReceiveHandler;
     std::list<TcpSendHandler> mSendHandlers;
 
+    bool mReceivePaused;
+    bool mReceivePending;
+
     friend class TcpServer;
     friend class TcpClient;
     friend class SocketController;
@@ -231,12 +277,20 @@ private:
         const IpEndPoint& peerEndPoint, int32_t& errorCode);
 
     SEV_DECL void onConnect(Socket* socket, int32_t errorCode);
+    SEV_DECL void onHandshake(int32_t errorCode) override;
+    SEV_DECL void abortConnect() override;
+    SEV_DECL void onResolve(
+        const std::list<IpEndPoint>& endPointList, uint32_t msecTimeout);
+    SEV_DECL void notifyConnect(int32_t errorCode);
 
     TcpClient() = delete;
     TcpClient(const TcpClient&) = delete;
     TcpClient& operator=(const TcpClient&) = delete;
 
     TcpConnectHandler mConnectHandler;
+    Resolver::RequestId mResolveId;
+    Timer mResolveTimer;
+    std::chrono::steady_clock::time_point mResolveStart;
 
     friend class SocketController;
 };
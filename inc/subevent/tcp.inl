@@ -5,7 +5,9 @@
 
 #include <subevent/network.hpp>
 #include <subevent/tcp.hpp>
+#include <subevent/resolver.hpp>
 #include <subevent/thread.hpp>
+#include <subevent/utility.hpp>
 #include <subevent/socket_controller.hpp>
 
 SEV_NS_BEGIN
@@ -228,9 +230,10 @@ void TcpServer::onAccept()
 
         if (!socket->onAccept())
         {
+            // the others are still waiting
             socket->close();
             delete socket;
-            break;
+            continue;
         }
 
         channels.push_back(
@@ -274,12 +277,16 @@ TcpChannel::TcpChannel(NetWorker* netWorker)
 
     mNetWorker = netWorker;
     mSocket = nullptr;
+    mReceivePaused = false;
+    mReceivePending = false;
 }
 
 TcpChannel::TcpChannel(Socket* socket)
 {
     mNetWorker = nullptr;
     mSocket = nullptr;
+    mReceivePaused = false;
+    mReceivePending = false;
     create(socket);
 }
 
@@ -314,6 +321,9 @@ void TcpChannel::close()
             mCloseCanceller->cancel();
         }
 
+        // resolving or connecting
+        abortConnect();
+
         return;
     }
 
@@ -329,6 +339,8 @@ void TcpChannel::close()
     mCloseHandler = nullptr;
     mCloseCanceller.reset();
     mSendHandlers.clear();
+    mReceivePaused = false;
+    mReceivePending = false;
 
     if (mNetWorker != nullptr)
     {
@@ -362,24 +374,62 @@ int32_t TcpChannel::send(
         return -5201;
     }
 
-    if (sendHandler == nullptr)
+    if ((sendHandler == nullptr) && mSendHandlers.empty())
     {
         // sync
+        return sendNow(data, size);
+    }
 
-        return mSocket->send(
-            data, static_cast<int32_t>(size), Socket::SendFlags);
+    if ((sendHandler == nullptr) &&
+        mNetWorker->getSocketController()->
+            appendTcpSend(shared_from_this(), data, size))
+    {
+        // joined the last queued buffer
+        return 0;
     }
-    else
+
+    // async, or behind the queued data
+
+    const char* bytes =
+        reinterpret_cast<const char*>(data);
+
+    return send(
+        std::vector<char>(bytes, bytes + size),
+        sendHandler);
+}
+
+int32_t TcpChannel::sendNow(const void* data, size_t size)
+{
+    int32_t result = mSocket->send(
+        data, static_cast<uint32_t>(size), Socket::SendFlags);
+
+    if ((result < 0) && mSocket->isBlockingError())
     {
-        // async
+        result = 0;
+    }
 
+    if ((result >= 0) && (static_cast<size_t>(result) < size))
+    {
+        // the rest is queued until the socket gets writable
         const char* bytes =
-            reinterpret_cast<const char*>(data);
+            reinterpret_cast<const char*>(data) + result;
+
+        mSendHandlers.push_back(nullptr);
 
-        return send(
-            std::vector<char>(bytes, bytes + size),
-            sendHandler);
+        if (!mNetWorker->getSocketController()->
+            requestTcpSend(
+                shared_from_this(),
+                std::vector<char>(bytes, bytes + (size - result))))
+        {
+            mSendHandlers.pop_back();
+            return -1;
+        }
     }
+
+    // what the socket has buffered (TLS records)
+    mSocket->flush();
+
+    return result;
 }
 
 int32_t TcpChannel::sendString(
@@ -409,28 +459,118 @@ int32_t TcpChannel::send(
         return -5250;
     }
 
-    if (sendHandler == nullptr)
+    if ((sendHandler == nullptr) && mSendHandlers.empty())
     {
-        return mSocket->send(
-            &data[0], static_cast<int32_t>(data.size()),
-            Socket::SendFlags);
-    }
-    else
-    {
-        mSendHandlers.push_back(sendHandler);
+        return sendNow(&data[0], data.size());
     }
 
+    // a handler (or null) is kept for each queued item
+    mSendHandlers.push_back(sendHandler);
+
     if (!mNetWorker->getSocketController()->
         requestTcpSend(
             shared_from_this(),
             std::forward<std::vector<char>>(data)))
     {
+        mSendHandlers.pop_back();
         return -1;
     }
 
     return 0;
 }
 
+int32_t TcpChannel::send(
+    const std::shared_ptr<const std::vector<char>>& data,
+    const TcpSendHandler& sendHandler)
+{
+    assert(NetWorker::getCurrent() != nullptr);
+
+    if (isClosed())
+    {
+        return -1;
+    }
+
+    if (mNetWorker != NetWorker::getCurrent())
+    {
+        assert(false);
+        return -5255;
+    }
+
+    if (data == nullptr)
+    {
+        return -5256;
+    }
+
+    // always async, a handler (or null) is kept for each queued item
+    mSendHandlers.push_back(sendHandler);
+
+    if (!mNetWorker->getSocketController()->
+        requestTcpSend(shared_from_this(), data))
+    {
+        mSendHandlers.pop_back();
+        return -1;
+    }
+
+    return 0;
+}
+
+int32_t TcpChannel::sendFile(
+    const std::shared_ptr<std::FILE>& file,
+    uint64_t offset, uint64_t size,
+    const TcpSendHandler& sendHandler)
+{
+    assert(NetWorker::getCurrent() != nullptr);
+
+    if (isClosed())
+    {
+        return -1;
+    }
+
+    if (mNetWorker != NetWorker::getCurrent())
+    {
+        assert(false);
+        return -5260;
+    }
+
+    if (file == nullptr)
+    {
+        return -5261;
+    }
+
+    // always async, a handler (or null) is kept for each queued item
+    mSendHandlers.push_back(sendHandler);
+
+    if (!mNetWorker->getSocketController()->
+        requestTcpSendFile(shared_from_this(), file, offset, size))
+    {
+        mSendHandlers.pop_back();
+        return -1;
+    }
+
+    return 0;
+}
+
+int32_t TcpChannel::sendFile(
+    const std::string& fileName,
+    const TcpSendHandler& sendHandler)
+{
+    std::shared_ptr<std::FILE> file = File::open(fileName, "rb");
+
+    if (file == nullptr)
+    {
+        return -5261;
+    }
+
+    int64_t size = File::getSize(file.get());
+
+    if (size < 0)
+    {
+        return -5261;
+    }
+
+    return sendFile(file, 0, static_cast<uint64_t>(size), sendHandler);
+}
+
 int32_t TcpChannel::receive(void* buff, size_t size)
 {
     assert(NetWorker::getCurrent() != nullptr);
@@ -506,6 +646,19 @@ std::vector<char> TcpChannel::receiveAll(size_t reserveSize)
     return buff;
 }
 
+size_t TcpChannel::getSendQueueSize() const
+{
+    assert(NetWorker::getCurrent() != nullptr);
+
+    if (isClosed() || (mNetWorker != NetWorker::getCurrent()))
+    {
+        return 0;
+    }
+
+    return mNetWorker->getSocketController()->
+        getTcpSendQueueSize(mSocket->getHandle());
+}
+
 bool TcpChannel::cancelSend()
 {
     assert(NetWorker::getCurrent() != nullptr);
@@ -521,8 +674,53 @@ bool TcpChannel::cancelSend()
         return false;
     }
 
-    return mNetWorker->getSocketController()->
-        cancelTcpSend(shared_from_this());
+    if (!mNetWorker->getSocketController()->
+        cancelTcpSend(shared_from_this()))
+    {
+        return false;
+    }
+
+    mSendHandlers.clear();
+
+    return true;
+}
+
+void TcpChannel::pauseReceive()
+{
+    assert(NetWorker::getCurrent() != nullptr);
+
+    mReceivePaused = true;
+}
+
+void TcpChannel::resumeReceive()
+{
+    assert(NetWorker::getCurrent() != nullptr);
+
+    if (!mReceivePaused)
+    {
+        return;
+    }
+
+    mReceivePaused = false;
+
+    if (isClosed())
+    {
+        return;
+    }
+
+    if (mNetWorker != NetWorker::getCurrent())
+    {
+        assert(false);
+        return;
+    }
+
+    if (mReceivePending)
+    {
+        // the selector is edge-triggered, so data that arrived
+        // while paused must be picked up here
+        mReceivePending = false;
+        onReceive();
+    }
 }
 
 void TcpChannel::setReceiveHandler(
@@ -555,6 +753,12 @@ void TcpChannel::onReceive()
         return;
     }
 
+    if (mReceivePaused)
+    {
+        mReceivePending = true;
+        return;
+    }
+
     TcpChannelPtr self(shared_from_this());
     TcpReceiveHandler handler = mReceiveHandler;
 
@@ -562,7 +766,7 @@ void TcpChannel::onReceive()
 
         handler(self);
 
-        if (self->isClosed())
+        if (self->isClosed() || self->isReceivePaused())
         {
             return;
         }
@@ -585,10 +789,16 @@ void TcpChannel::onSend(int32_t errorCode)
         return;
     }
 
-    TcpChannelPtr self(shared_from_this());
     TcpSendHandler handler = mSendHandlers.front();
     mSendHandlers.pop_front();
 
+    if (handler == nullptr)
+    {
+        return;
+    }
+
+    TcpChannelPtr self(shared_from_this());
+
     mNetWorker->postTask(
         [self, handler, errorCode]() {
             handler(self, errorCode);
@@ -620,6 +830,15 @@ void TcpChannel::onClose()
         });
 }
 
+void TcpChannel::onHandshake(int32_t errorCode)
+{
+    if (errorCode != 0)
+    {
+        // same as closed by the peer
+        onClose();
+    }
+}
+
 //----------------------------------------------------------------------------//
 // TcpClient
 //----------------------------------------------------------------------------//
@@ -627,6 +846,7 @@ void TcpChannel::onClose()
 TcpClient::TcpClient(NetWorker* netWorker)
     : TcpChannel(netWorker)
 {
+    mResolveId = 0;
 }
 
 TcpClient::~TcpClient()
@@ -689,32 +909,50 @@ void TcpClient::connect(
         return;
     }
 
+    if (mResolveId != 0)
+    {
+        // resolving
+        assert(false);
+        return;
+    }
+
     mConnectHandler = connectHandler;
 
     IpEndPoint peerEndPoint(address, port);
-    std::list<IpEndPoint> endPointList;
+
+    TcpClientPtr self(
+        std::dynamic_pointer_cast<TcpClient>(shared_from_this()));
 
     if (peerEndPoint.isUnspec())
     {
-        // resolve
-        endPointList = IpEndPoint::resolveName(
+        // resolve on the resolver threads, within the timeout
+        mResolveStart = std::chrono::steady_clock::now();
+        mResolveId = Resolver::getInstance().resolve(
             address, port,
             AddressFamily::Unspec,
-            Socket::Type::Tcp);
+            Socket::Type::Tcp,
+            [self, msecTimeout](const std::list<IpEndPoint>& endPointList) {
+                self->onResolve(endPointList, msecTimeout);
+            });
 
-        if (endPointList.empty())
+        if (mResolveId == 0)
         {
             onConnect(nullptr, -5110);
             return;
         }
-    }
-    else
-    {
-        endPointList.push_back(peerEndPoint);
+
+        mResolveTimer.start(msecTimeout, false, [this](Timer*) {
+            Resolver::getInstance().cancel(mResolveId);
+            mResolveId = 0;
+
+            onConnect(nullptr, -5102);
+        });
+
+        return;
     }
 
-    TcpClientPtr self(
-        std::dynamic_pointer_cast<TcpClient>(shared_from_this()));
+    std::list<IpEndPoint> endPointList;
+    endPointList.push_back(peerEndPoint);
 
     mNetWorker->getSocketController()->
         requestTcpConnect(self, endPointList, msecTimeout);
@@ -732,6 +970,21 @@ bool TcpClient::cancelConnect()
 
     mConnectHandler = nullptr;
 
+    if (mResolveId != 0)
+    {
+        Resolver::getInstance().cancel(mResolveId);
+        mResolveId = 0;
+        mResolveTimer.cancel();
+
+        return true;
+    }
+
+    if (!isClosed() && mSocket->isHandshaking())
+    {
+        close();
+        return true;
+    }
+
     TcpClientPtr self(
         std::dynamic_pointer_cast<TcpClient>(shared_from_this()));
 
@@ -739,6 +992,41 @@ bool TcpClient::cancelConnect()
         cancelTcpConnect(self);
 }
 
+void TcpClient::abortConnect()
+{
+    if (mNetWorker == NetWorker::getCurrent())
+    {
+        cancelConnect();
+    }
+}
+
+void TcpClient::onResolve(
+    const std::list<IpEndPoint>& endPointList, uint32_t msecTimeout)
+{
+    mResolveId = 0;
+    mResolveTimer.cancel();
+
+    if (endPointList.empty())
+    {
+        onConnect(nullptr, -5110);
+        return;
+    }
+
+    // the rest of the timeout
+    uint64_t elapsed = std::chrono::duration_cast<
+        std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - mResolveStart).count();
+
+    msecTimeout = (elapsed < msecTimeout) ?
+        static_cast<uint32_t>(msecTimeout - elapsed) : 1;
+
+    TcpClientPtr self(
+        std::dynamic_pointer_cast<TcpClient>(shared_from_this()));
+
+    mNetWorker->getSocketController()->
+        requestTcpConnect(self, endPointList, msecTimeout);
+}
+
 Socket* TcpClient::createSocket(
     const IpEndPoint& peerEndPoint, int32_t& errorCode)
 {
@@ -765,13 +1053,13 @@ Socket* TcpClient::createSocket(
 
 void TcpClient::onConnect(Socket* socket, int32_t errorCode)
 {
-    TcpClientPtr self(
-        std::dynamic_pointer_cast<TcpClient>(shared_from_this()));
-
     if (socket != nullptr)
     {
         create(socket);
 
+        TcpClientPtr self(
+            std::dynamic_pointer_cast<TcpClient>(shared_from_this()));
+
         if (!mSocket->onConnect())
         {
             // error
@@ -786,13 +1074,35 @@ void TcpClient::onConnect(Socket* socket, int32_t errorCode)
             create(nullptr);
             errorCode = -5122;
         }
+        else if (mSocket->isHandshaking())
+        {
+            // notified by onHandshake()
+            return;
+        }
     }
 
+    notifyConnect(errorCode);
+}
+
+void TcpClient::onHandshake(int32_t errorCode)
+{
+    if (errorCode != 0)
+    {
+        create(nullptr);
+    }
+
+    notifyConnect(errorCode);
+}
+
+void TcpClient::notifyConnect(int32_t errorCode)
+{
     if (mConnectHandler == nullptr)
     {
         return;
     }
 
+    TcpClientPtr self(
+        std::dynamic_pointer_cast<TcpClient>(shared_from_this()));
     TcpConnectHandler handler = mConnectHandler;
     mConnectHandler = nullptr;
 
@@ -129,10 +129,8 @@ TcpChannelWorker* TcpServerWorker::nextWorker()
         return nullptr;
     }
 
-    int32_t startIndex = mWorkerIndex;
-
-    // round robin
-    for (;;)
+    // round robin, the last one is tried last
+    for (size_t count = 0; count < mWorkerPool.size(); ++count)
     {
         ++mWorkerIndex;
 
@@ -142,11 +140,6 @@ TcpChannelWorker* TcpServerWorker::nextWorker()
             mWorkerIndex = 0;
         }
 
-        if (startIndex == mWorkerIndex)
-        {
-            break;
-        }
-
         auto worker = mWorkerPool[mWorkerIndex];
 
         if (!worker->isChannelFull() &&
@@ -3,6 +3,8 @@
 
 #include <list>
 #include <string>
+#include <memory>
+#include <mutex>
 #include <functional>
 #include <thread>
 
@@ -12,12 +14,44 @@
 SEV_NS_BEGIN
 
 class Thread;
+class ThreadRef;
 class EventController;
 
 //---------------------------------------------------------------------------//
 //---------------------------------------------------------------------------//
 
 typedef std::function<void(Thread*)> ChildFinishedHandler;
+typedef std::shared_ptr<ThreadRef> ThreadRefPtr;
+
+//----------------------------------------------------------------------------//
+// ThreadRef
+//----------------------------------------------------------------------------//
+
+// refers to a thread from any other thread.
+// post() fails once the thread has been deleted.
+class ThreadRef
+{
+public:
+    SEV_DECL ~ThreadRef();
+
+public:
+    // the event is deleted if it could not be posted
+    SEV_DECL bool post(Event* event);
+    SEV_DECL bool post(const std::function<void()>& task);
+
+private:
+    SEV_DECL explicit ThreadRef(Thread* thread);
+
+    SEV_DECL void reset();
+
+    ThreadRef(const ThreadRef&) = delete;
+    ThreadRef& operator=(const ThreadRef&) = delete;
+
+    std::mutex mMutex;
+    Thread* mThread;
+
+    friend class Thread;
+};
 
 //----------------------------------------------------------------------------//
 // Thread
@@ -65,6 +99,12 @@ public:
         return mChilds;
     }
 
+    // for posting from other threads that may outlive this one
+    SEV_DECL const ThreadRefPtr& getRef() const
+    {
+        return mRef;
+    }
+
     SEV_DECL static Thread* getCurrent();
 
 public:
@@ -151,6 +191,7 @@ private:
     ChildFinishedHandler mChildFinishedHandler;
 
     EventLoop mEventLoop;
+    ThreadRefPtr mRef;
 
     bool mInitResult;
     int32_t mExitCode;
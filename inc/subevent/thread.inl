@@ -39,6 +39,8 @@ Thread::Thread(const std::string& name, Thread* parent)
     mParent = parent;
     mInitResult = false;
 
+    mRef.reset(new ThreadRef(this));
+
     if (mParent != nullptr)
     {
         mParent->mChilds.push_back(this);
@@ -54,6 +56,8 @@ Thread::Thread(const std::string& name, Thread* parent)
 
 Thread::~Thread()
 {
+    mRef->reset();
+
     if (gThread == this)
     {
         gThread = nullptr;
@@ -268,6 +272,43 @@ void Thread::onTaskEvent(const Event* event)
     task();
 }
 
+//----------------------------------------------------------------------------//
+// ThreadRef
+//----------------------------------------------------------------------------//
+
+ThreadRef::ThreadRef(Thread* thread)
+{
+    mThread = thread;
+}
+
+ThreadRef::~ThreadRef()
+{
+}
+
+bool ThreadRef::post(Event* event)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mThread == nullptr)
+    {
+        delete event;
+        return false;
+    }
+
+    return mThread->post(event);
+}
+
+bool ThreadRef::post(const std::function<void()>& task)
+{
+    return post(new TaskEvent(task));
+}
+
+void ThreadRef::reset()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mThread = nullptr;
+}
+
 SEV_NS_END
 
 #endif // SUBEVENT_THREAD_INL
@@ -6,6 +6,8 @@
 #include <string>
 #include <utility>
 #include <cctype>
+#include <cstdio>
+#include <memory>
 
 #include <subevent/std.hpp>
 
@@ -144,6 +146,23 @@ namespace Random
     SEV_DECL std::vector<unsigned char> generateBytes(size_t length);
 }
 
+//----------------------------------------------------------------------------//
+// File
+//----------------------------------------------------------------------------//
+
+namespace File
+{
+    // closed when the last reference is released, nullptr on error
+    SEV_DECL std::shared_ptr<std::FILE> open(
+        const std::string& fileName, const char* mode);
+
+    // -1: error
+    SEV_DECL int64_t getSize(std::FILE* file);
+
+    // descriptor for pread() / sendfile()
+    SEV_DECL int getHandle(std::FILE* file);
+}
+
 SEV_NS_END
 
 #endif // SUBEVENT_UTILITY_HPP
@@ -2,6 +2,8 @@
 #define SUBEVENT_UTILITY_INL
 
 #include <random>
+#include <cstring>
+#include <algorithm>
 
 #include <subevent/utility.hpp>
 #include <subevent/thread.hpp>
@@ -61,27 +63,95 @@ namespace Processor
 
 namespace Random
 {
+    // masking keys and handshake keys must not be predictable,
+    // so both come from the random source of the os, opened once
+    // per thread, and never from a seeded generator
     uint32_t generate32()
     {
-        std::random_device seed;
-        std::mt19937 mt(seed());
+        static thread_local std::random_device device;
 
-        return mt();
+        return device();
     }
 
     std::vector<unsigned char> generateBytes(size_t length)
     {
         std::vector<unsigned char> result(length);
 
-        for (size_t index = 0; index < length; ++index)
+        for (size_t index = 0; index < length; index += sizeof(uint32_t))
         {
-            result[index] = (unsigned char)(generate32() % 256);
+            uint32_t value = generate32();
+
+            memcpy(&result[index], &value,
+                std::min(sizeof(value), length - index));
         }
 
         return result;
     }
 }
 
+//----------------------------------------------------------------------------//
+// File
+//----------------------------------------------------------------------------//
+
+namespace File
+{
+    std::shared_ptr<std::FILE> open(
+        const std::string& fileName, const char* mode)
+    {
+        std::FILE* file = nullptr;
+
+#ifdef SEV_OS_WIN
+        if (fopen_s(&file, fileName.c_str(), mode) != 0)
+        {
+            file = nullptr;
+        }
+#else
+        file = std::fopen(fileName.c_str(), mode);
+#endif
+
+        if (file == nullptr)
+        {
+            return nullptr;
+        }
+
+        return std::shared_ptr<std::FILE>(file, std::fclose);
+    }
+
+    int64_t getSize(std::FILE* file)
+    {
+#ifdef SEV_OS_WIN
+        if (_fseeki64(file, 0, SEEK_END) != 0)
+        {
+            return -1;
+        }
+
+        int64_t size = _ftelli64(file);
+
+        _fseeki64(file, 0, SEEK_SET);
+#else
+        if (fseeko(file, 0, SEEK_END) != 0)
+        {
+            return -1;
+        }
+
+        int64_t size = static_cast<int64_t>(ftello(file));
+
+        fseeko(file, 0, SEEK_SET);
+#endif
+
+        return size;
+    }
+
+    int getHandle(std::FILE* file)
+    {
+#ifdef SEV_OS_WIN
+        return _fileno(file);
+#else
+        return fileno(file);
+#endif
+    }
+}
+
 SEV_NS_END
 
 #endif // SUBEVENT_UTILITY_INL
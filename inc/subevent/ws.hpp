@@ -1,7 +1,10 @@
 #ifndef SUBEVENT_WS_HPP
 #define SUBEVENT_WS_HPP
 
+#include <map>
 #include <array>
+#include <atomic>
+#include <mutex>
 #include <vector>
 #include <string>
 #include <memory>
@@ -10,6 +13,7 @@
 #include <subevent/std.hpp>
 #include <subevent/byte_io.hpp>
 #include <subevent/utility.hpp>
+#include <subevent/timer.hpp>
 #include <subevent/tcp.hpp>
 #include <subevent/http_server.hpp>
 
@@ -56,6 +60,17 @@ public:
         return mFin;
     }
 
+    // compressed message (permessage-deflate)
+    SEV_DECL void setRsv1(bool rsv1)
+    {
+        mRsv1 = rsv1;
+    }
+
+    SEV_DECL bool isRsv1() const
+    {
+        return mRsv1;
+    }
+
     SEV_DECL void setOpCode(uint8_t opCode)
     {
         mOpCode = opCode;
@@ -117,12 +132,14 @@ public:
     SEV_DECL void setPayload(const std::vector<char>& payload)
     {
         mPayload = payload;
+        mPayloadView = nullptr;
         mPayloadLength = mPayload.size();
     }
 
     SEV_DECL void setPayload(std::vector<char>&& payload)
     {
         mPayload = std::move(payload);
+        mPayloadView = nullptr;
         mPayloadLength = mPayload.size();
     }
 
@@ -130,20 +147,35 @@ public:
     {
         mPayload.resize(size);
         memcpy(&mPayload[0], data, size);
+        mPayloadView = nullptr;
         mPayloadLength = mPayload.size();
     }
 
     SEV_DECL void addPayload(const std::vector<char>& payload)
     {
+        ownPayload();
         mPayload.insert(mPayload.end(), payload.begin(), payload.end());
         mPayloadLength += payload.size();
     }
 
     SEV_DECL const std::vector<char>& getPayload() const
     {
+        ownPayload();
         return mPayload;
     }
 
+    // received payload without a copy,
+    // valid while the receive handler runs.
+    SEV_DECL const char* getPayloadData() const
+    {
+        return (mPayloadView != nullptr) ? mPayloadView : mPayload.data();
+    }
+
+    SEV_DECL size_t getPayloadSize() const
+    {
+        return static_cast<size_t>(mPayloadLength);
+    }
+
     SEV_DECL void clear();
 
 public:
@@ -157,16 +189,62 @@ public:
         return 2;
     }
 
+    // header length told by its first getMinLength() bytes
+    SEV_DECL static size_t getHeaderLength(const char* data)
+    {
+        const uint8_t len8 = data[1] & 0x7F;
+
+        return getMinLength() +
+            ((len8 == 127) ? sizeof(uint64_t) :
+                (len8 == 126) ? sizeof(uint16_t) : 0) +
+            ((data[1] & 0x80) ? 4 : 0);
+    }
+
+    // xor data with the masking key in place,
+    // offset is the position of data in the payload.
+    SEV_DECL static void mask(
+        void* data, size_t size,
+        const std::array<unsigned char, 4>& maskingKey,
+        size_t offset = 0);
+
     SEV_DECL WsFrame& operator=(const WsFrame& other);
     SEV_DECL WsFrame& operator=(WsFrame&& other);
 
 protected:
     bool mFin;
+    bool mRsv1;
     uint8_t mOpCode;
     bool mMask;
     uint64_t mPayloadLength;
     std::array<unsigned char, 4> mMaskingKey;
-    std::vector<char> mPayload;
+    mutable std::vector<char> mPayload;
+
+    // points into the receive buffer of WsChannel
+    mutable const char* mPayloadView = nullptr;
+
+    SEV_DECL void setPayloadView(const char* data, size_t size)
+    {
+        mPayload.clear();
+        mPayloadView = data;
+        mPayloadLength = size;
+    }
+
+    // copy the viewed payload into mPayload
+    SEV_DECL void ownPayload() const;
+
+    friend class WsChannel;
+
+private:
+    typedef size_t (*MaskKernel)(
+        unsigned char* data, size_t size, uint32_t maskingKey);
+
+    SEV_DECL static size_t maskWord(
+        unsigned char* data, size_t size, uint32_t maskingKey);
+    SEV_DECL static size_t maskSse2(
+        unsigned char* data, size_t size, uint32_t maskingKey);
+    SEV_DECL static size_t maskAvx2(
+        unsigned char* data, size_t size, uint32_t maskingKey);
+    SEV_DECL static MaskKernel getMaskKernel();
 };
 
 //---------------------------------------------------------------------------//
@@ -260,6 +338,20 @@ public:
 
     SEV_DECL virtual ~WsChannel();
 
+    // bytes read from the socket at a time
+    static const size_t ReceiveSize = 8192;
+
+    // receive and message buffers larger than this
+    // are released when they become empty.
+    // the receive buffer is reserved at once for the length a frame
+    // announces up to this size (or the max message size), a larger
+    // one doubles as the payload arrives.
+    static const size_t KeepBufferSize = 64 * 1024;
+
+    // text and binary payloads up to this size (7 bit length)
+    // are framed on the stack and written without a WsFrame
+    static const size_t SmallPayloadSize = 125;
+
 public:
 
     // binary
@@ -284,6 +376,30 @@ public:
         const void* payload = nullptr, size_t size = 0,
         const TcpSendHandler& handler = nullptr);
 
+    // a message sent in parts, each part is a frame of its own
+    // (continuation frames) and its handler is called when written.
+    // other data frames can not be sent until endMessage().
+    SEV_DECL int32_t beginMessage(bool text = false);
+    SEV_DECL int32_t appendMessage(
+        const void* data, size_t size,
+        const TcpSendHandler& handler = nullptr);
+    SEV_DECL int32_t endMessage(
+        const void* data = nullptr, size_t size = 0,
+        const TcpSendHandler& handler = nullptr);
+
+    // bytes not written yet, to wait with the next part
+    SEV_DECL size_t getSendQueueSize() const;
+
+    // can be called from any thread. messages are queued without a
+    // lock and sent in order by the thread of the channel, which is
+    // woken up once for all that are queued until it gets to them.
+    // they fail like send() while a message is sent in parts.
+    // returns -1 if the thread of the channel has ended, what was
+    // queued is dropped then.
+    SEV_DECL int32_t postSend(const void* payload, size_t size);
+    SEV_DECL int32_t postSend(std::vector<char>&& payload);
+    SEV_DECL int32_t postSend(const std::string& payload);
+
     SEV_DECL void close(
         uint16_t statusCode = WsCloseFrame::StatusCode::NormalClosure);
 
@@ -305,6 +421,32 @@ public:
         mCloseHandler = handler;
     }
 
+    // data frames are delivered as they arrive, fragments are not
+    // reassembled and a large frame comes in chunks. the first part
+    // has the opcode of the message, the others Continuation and
+    // the last one isFin(). compressed messages still come whole.
+    SEV_DECL void setIncrementalReceive(bool incremental)
+    {
+        mIncrementalReceive = incremental;
+    }
+
+    SEV_DECL bool isIncrementalReceive() const
+    {
+        return mIncrementalReceive;
+    }
+
+    // a larger message closes the channel with MessageTooBig.
+    // 0: unlimited
+    SEV_DECL void setMaxMessageSize(uint64_t maxSize)
+    {
+        mMaxMessageSize = maxSize;
+    }
+
+    SEV_DECL uint64_t getMaxMessageSize() const
+    {
+        return mMaxMessageSize;
+    }
+
 public:
     SEV_DECL bool isClosed() const
     {
@@ -342,37 +484,149 @@ private:
 
     SEV_DECL void onReceiveFrame(const WsFramePtr& frame);
 
+    SEV_DECL static void serializeFrame(
+        const WsFrame& frame, const void* payload,
+        std::vector<char>& sendData);
+    SEV_DECL int32_t sendData(
+        uint8_t opCode, const void* payload, size_t size,
+        const TcpSendHandler& handler);
+    SEV_DECL bool isSmallPayload(size_t size) const;
+    SEV_DECL int32_t sendSmall(
+        uint8_t opCode, const void* payload, size_t size,
+        const TcpSendHandler& handler);
+    SEV_DECL int32_t sendSerialized(
+        const std::shared_ptr<const std::vector<char>>& sendData);
+    SEV_DECL int32_t sendFragment(
+        const void* data, size_t size, bool fin,
+        const TcpSendHandler& handler);
+    SEV_DECL void onMessageTooBig();
+
+    SEV_DECL int32_t postSend(
+        uint8_t opCode, std::vector<char>&& payload);
+    SEV_DECL void onPostedSend();
+
+    SEV_DECL void onKeepAliveTimeout();
+
+    SEV_DECL const WsFramePtr& getReceiveFrame();
+    SEV_DECL void keepReceiveFrame(size_t framePosition);
+    SEV_DECL bool inflateFrame(WsFrame& frame);
+    SEV_DECL static void releaseBuffer(std::vector<char>& buffer);
+
     bool mIsClient;
     std::weak_ptr<TcpChannel> mChannel;
+
+    // the thread of the channel, for postSend() and WsBroadcastGroup
+    ThreadRefPtr mThreadRef;
     WsReceiveHandler mDataFrameHandler;
     WsReceiveHandler mControlFrameHandler;
     TcpCloseHandler mCloseHandler;
     TcpReceiveHandler mOldReceiveHandler;
 
+    // unparsed bytes, frames are unmasked in place
+    // and delivered as views into it.
     struct ReceiveCache
     {
-        size_t mPosition = 0;
+        // mSize bytes are received, the rest is room for the reads.
+        // the room is made in the reserved capacity as the reads
+        // need it and not shrunk, so each byte is initialized once.
         std::vector<char> mBuffer;
+        size_t mSize = 0;
+
+        // the frame at the head is incomplete until this size
+        uint64_t mNeeded = 0;
 
         void clear()
         {
-            mPosition = 0;
             mBuffer.clear();
+            mSize = 0;
+            mNeeded = 0;
         }
 
     } mReceiveCache;
 
+    // reused while the handlers do not keep it
+    WsFramePtr mReceiveFrame;
+
+    // fragmented message being reassembled
+    struct Message
+    {
+        bool mActive = false;
+        bool mCompressed = false;
+        uint8_t mOpCode = 0;
+        std::vector<char> mBuffer;
+
+        // received so far, also in the incremental mode
+        uint64_t mSize = 0;
+
+    } mMessage;
+
+    // frame being delivered in chunks
+    struct Chunk
+    {
+        bool mActive = false;
+        bool mFin = false;
+        bool mMask = false;
+        uint8_t mOpCode = 0;
+        std::array<unsigned char, 4> mMaskingKey;
+        uint64_t mOffset = 0;
+        uint64_t mRemaining = 0;
+
+    } mChunk;
+
+    bool mIncrementalReceive;
+    uint64_t mMaxMessageSize;
+
+    // message being sent in parts
+    struct SendMessage
+    {
+        bool mActive = false;
+        bool mStarted = false;
+        uint8_t mOpCode = 0;
+
+    } mSendMessage;
+
+    // pushed by postSend(), newest first
+    struct PostedSend
+    {
+        uint8_t mOpCode;
+        std::vector<char> mPayload;
+        PostedSend* mNext;
+    };
+
+    std::atomic<PostedSend*> mPostedSends;
+
+#ifdef SEV_SUPPORTS_ZLIB
+    // negotiated in the handshake
+    WsDeflatePtr mDeflate;
+    std::vector<char> mDeflateBuffer;
+    std::vector<char> mInflateBuffer;
+#endif
+
+    // checked and cleared by WsKeepAlive
+    struct KeepAliveState
+    {
+        bool mWatched = false;
+        bool mReceived = false;
+        bool mPinging = false;
+
+    } mKeepAlive;
+
     struct CloseState
     {
         bool mClosed = false;
         bool mSent = false;
+
+        // the rest of the stream can not be parsed
+        bool mFailed = false;
+
         WsFramePtr mFrame;
     
     } mCloseState;
 
-    WsFramePtr mContinuationFrame;
-
     friend class HttpChannel;
+    friend class HttpClient;
+    friend class WsBroadcastGroup;
+    friend class WsKeepAlive;
 
     friend bool operator==(
         const WsChannelPtr&, const TcpChannelPtr&);
@@ -380,6 +634,142 @@ private:
         const WsChannelPtr&, const HttpChannelPtr&);
 };
 
+//----------------------------------------------------------------------------//
+// WsBroadcastGroup
+//----------------------------------------------------------------------------//
+
+// a frame is serialized once and the same buffer is queued on every
+// member, members of other threads get it with one task per thread.
+// the methods can be called from any thread.
+class WsBroadcastGroup
+{
+public:
+    SEV_DECL WsBroadcastGroup();
+    SEV_DECL ~WsBroadcastGroup();
+
+public:
+    // server channels only, the frames are not masked
+    SEV_DECL bool add(const WsChannelPtr& channel);
+    SEV_DECL bool remove(const WsChannelPtr& channel);
+    SEV_DECL void clear();
+
+    SEV_DECL size_t getSize() const;
+
+    // binary
+    SEV_DECL size_t broadcast(const void* payload, size_t size);
+    SEV_DECL size_t broadcast(const std::vector<char>& payload);
+
+    // text
+    SEV_DECL size_t broadcast(const std::string& payload);
+
+    // returns the number of channels the frame was queued for.
+    // a member between beginMessage() and endMessage()
+    // does not get a data frame.
+    SEV_DECL size_t broadcast(
+        const WsFrame& frame, const void* payload = nullptr);
+
+private:
+    WsBroadcastGroup(const WsBroadcastGroup&) = delete;
+    WsBroadcastGroup& operator=(const WsBroadcastGroup&) = delete;
+
+    typedef std::vector<std::weak_ptr<WsChannel>> Channels;
+    typedef std::shared_ptr<const Channels> ChannelsPtr;
+
+    // members of one thread
+    struct Members
+    {
+        // keeps the key valid, a new thread gets a new one
+        ThreadRefPtr mThreadRef;
+
+        std::map<WsChannel*, std::weak_ptr<WsChannel>> mChannels;
+
+        // what broadcast() sends to, rebuilt after a change
+        ChannelsPtr mSnapshot;
+    };
+
+    // shared with the send tasks, which outlive the group
+    struct State
+    {
+        std::map<ThreadRef*, Members> mMembers;
+        size_t mSize = 0;
+        std::mutex mMutex;
+    };
+
+    typedef std::shared_ptr<State> StatePtr;
+
+    // on the thread of the members, returns the number of sends
+    SEV_DECL static size_t send(
+        const std::weak_ptr<State>& state,
+        ThreadRef* threadRef,
+        const Channels& channels,
+        const std::shared_ptr<const std::vector<char>>& sendData);
+
+    // removes the released members of the thread and the closed ones
+    SEV_DECL static void prune(
+        const StatePtr& state,
+        ThreadRef* threadRef,
+        const std::vector<WsChannel*>& closed);
+
+    StatePtr mState;
+};
+
+//----------------------------------------------------------------------------//
+// WsKeepAlive
+//----------------------------------------------------------------------------//
+
+// pings the channels of one thread that have received nothing for
+// the interval, and closes the ones still silent after the timeout.
+// one timer checks them all, each channel sits in the slot of
+// a timing wheel for its next check.
+class WsKeepAlive
+{
+public:
+    SEV_DECL static WsKeepAlivePtr newInstance(
+        const WsKeepAliveOption& option = WsKeepAliveOption())
+    {
+        return std::make_shared<WsKeepAlive>(option);
+    }
+
+    SEV_DECL explicit WsKeepAlive(const WsKeepAliveOption& option);
+    SEV_DECL ~WsKeepAlive();
+
+public:
+    // the channel must belong to the current thread, it is
+    // watched until closed. a closed one calls its close handler.
+    // the first add() binds the instance to its thread, which must
+    // also release the instance.
+    SEV_DECL bool add(const WsChannelPtr& channel);
+
+    SEV_DECL size_t getSize() const
+    {
+        return mSize;
+    }
+
+    SEV_DECL const WsKeepAliveOption& getOption() const
+    {
+        return mOption;
+    }
+
+private:
+    WsKeepAlive(const WsKeepAlive&) = delete;
+    WsKeepAlive& operator=(const WsKeepAlive&) = delete;
+
+    SEV_DECL void schedule(
+        const std::weak_ptr<WsChannel>& channel, size_t ticks);
+    SEV_DECL void onTimer();
+
+    WsKeepAliveOption mOption;
+    size_t mIntervalTicks;
+    size_t mTimeoutTicks;
+
+    std::vector<std::vector<std::weak_ptr<WsChannel>>> mWheel;
+    size_t mCursor;
+    size_t mSize;
+
+    NetWorker* mNetWorker;
+    Timer mTimer;
+};
+
 // operator for TcpChannelPtr
 inline bool operator==(
     const WsChannelPtr& l, const TcpChannelPtr& r)
@@ -3,11 +3,33 @@
 
 #include <string>
 #include <cstring>
+#include <algorithm>
 
 #include <subevent/ws.hpp>
 #include <subevent/net_byte_io.hpp>
 #include <subevent/network.hpp>
 
+#if defined(__x86_64__) || defined(__i386__) || \
+    defined(_M_X64) || defined(_M_IX86)
+#   if defined(__SSE2__) || defined(_M_X64) || \
+       (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#       define SEV_WS_MASK_SSE2
+#   endif
+#   if defined(__GNUC__) || defined(_MSC_VER)
+#       define SEV_WS_MASK_AVX2
+#   endif
+#   include <immintrin.h>
+#   ifdef _MSC_VER
+#       include <intrin.h>
+#   endif
+#endif
+
+#if defined(SEV_WS_MASK_AVX2) && defined(__GNUC__)
+#   define SEV_WS_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#   define SEV_WS_TARGET_AVX2
+#endif
+
 SEV_NS_BEGIN
 
 //---------------------------------------------------------------------------//
@@ -49,11 +71,24 @@ WsFrame::~WsFrame()
 WsFrame& WsFrame::operator=(const WsFrame& other)
 {
     mFin = other.mFin;
+    mRsv1 = other.mRsv1;
     mOpCode = other.mOpCode;
     mMask = other.mMask;
     mPayloadLength = other.mPayloadLength;
     mMaskingKey = other.mMaskingKey;
-    mPayload = other.mPayload;
+
+    if (other.mPayloadView != nullptr)
+    {
+        mPayload.assign(
+            other.mPayloadView,
+            other.mPayloadView + other.getPayloadSize());
+    }
+    else
+    {
+        mPayload = other.mPayload;
+    }
+
+    mPayloadView = nullptr;
 
     return *this;
 }
@@ -61,11 +96,13 @@ WsFrame& WsFrame::operator=(const WsFrame& other)
 WsFrame& WsFrame::operator=(WsFrame&& other)
 {
     mFin = std::move(other.mFin);
+    mRsv1 = std::move(other.mRsv1);
     mOpCode = std::move(other.mOpCode);
     mMask = std::move(other.mMask);
     mPayloadLength = std::move(other.mPayloadLength);
     mMaskingKey = std::move(other.mMaskingKey);
     mPayload = std::move(other.mPayload);
+    mPayloadView = other.mPayloadView;
 
     other.clear();
 
@@ -75,11 +112,24 @@ WsFrame& WsFrame::operator=(WsFrame&& other)
 void WsFrame::clear()
 {
     mFin = true;
+    mRsv1 = false;
     mOpCode = OpCode::Binary;
     mMask = false;
     mMaskingKey.fill(0);
     mPayloadLength = 0;
     mPayload.clear();
+    mPayloadView = nullptr;
+}
+
+void WsFrame::ownPayload() const
+{
+    if (mPayloadView == nullptr)
+    {
+        return;
+    }
+
+    mPayload.assign(mPayloadView, mPayloadView + getPayloadSize());
+    mPayloadView = nullptr;
 }
 
 void WsFrame::serializeHeader(ByteWriter& writer) const
@@ -91,6 +141,11 @@ void WsFrame::serializeHeader(ByteWriter& writer) const
         b |= 0x80;
     }
 
+    if (mRsv1)
+    {
+        b |= 0x40;
+    }
+
     b |= (mOpCode & 0x0F);
 
     writer << b;
@@ -132,21 +187,15 @@ void WsFrame::serializePayload(ByteWriter& writer) const
         return;
     }
 
-    if (mMask)
-    {
-        const auto& maskingKey = getMaskingKey();
+    size_t cur = writer.getCur();
 
-        for (size_t index = 0; index < payloadLength; ++index)
-        {
-            unsigned char b =
-                mPayload[index] ^ maskingKey[index % 4];
+    writer.writeBytes(getPayloadData(), getPayloadSize());
 
-            writer.writeBytes(&b, sizeof(b));
-        }
-    }
-    else
+    if (mMask)
     {
-        writer.writeBytes(&mPayload[0], mPayload.size());
+        writer.setCur(cur);
+        mask(writer.getPtr(), getPayloadSize(), getMaskingKey());
+        writer.seekCur(static_cast<int32_t>(getPayloadSize()));
     }
 }
 
@@ -160,6 +209,7 @@ bool WsFrame::deserializeHeader(ByteReader& reader)
     }
 
     mFin = bytes[0] & 0x80;
+    mRsv1 = bytes[0] & 0x40;
     mOpCode = bytes[0] & 0x0F;
     mMask = bytes[1] & 0x80;
 
@@ -211,29 +261,158 @@ bool WsFrame::deserializePayload(ByteReader& reader)
 
     const auto payloadLength = getPayloadLength();
     mPayload.resize(static_cast<size_t>(payloadLength));
+    mPayloadView = nullptr;
 
     if (payloadLength > 0)
     {
+        reader.readBytes(
+            &mPayload[0], static_cast<size_t>(payloadLength));
+
         if (mMask)
         {
-            const auto& maskingKey = getMaskingKey();
+            mask(&mPayload[0], mPayload.size(), getMaskingKey());
+        }
+    }
+    
+    return true;
+}
 
-            for (size_t index = 0; index < payloadLength; ++index)
-            {
-                unsigned char b;
-                reader.readBytes(&b, sizeof(b));
+void WsFrame::mask(
+    void* data, size_t size,
+    const std::array<unsigned char, 4>& maskingKey,
+    size_t offset)
+{
+    unsigned char* bytes = static_cast<unsigned char*>(data);
+
+    // rotate the key so that bytes[0] is masked by key[0]
+    unsigned char key[4];
+
+    for (size_t index = 0; index < 4; ++index)
+    {
+        key[index] = maskingKey[(offset + index) % 4];
+    }
+
+    uint32_t key32;
+    memcpy(&key32, key, sizeof(key32));
+
+    // every kernel consumes multiples of 4 bytes
+    size_t done = getMaskKernel()(bytes, size, key32);
+    done += maskWord(bytes + done, size - done, key32);
+
+    for (size_t index = done; index < size; ++index)
+    {
+        bytes[index] ^= key[index % 4];
+    }
+}
+
+size_t WsFrame::maskWord(
+    unsigned char* data, size_t size, uint32_t maskingKey)
+{
+    uint64_t key64 = maskingKey;
+    key64 = (key64 << 32) | key64;
+
+    size_t done = 0;
+
+    for (; done + sizeof(key64) <= size; done += sizeof(key64))
+    {
+        uint64_t word;
+        memcpy(&word, data + done, sizeof(word));
+        word ^= key64;
+        memcpy(data + done, &word, sizeof(word));
+    }
+
+    return done;
+}
+
+size_t WsFrame::maskSse2(
+    unsigned char* data, size_t size, uint32_t maskingKey)
+{
+    size_t done = 0;
+
+#ifdef SEV_WS_MASK_SSE2
+    const __m128i key128 =
+        _mm_set1_epi32(static_cast<int32_t>(maskingKey));
+
+    for (; done + sizeof(__m128i) <= size; done += sizeof(__m128i))
+    {
+        __m128i* p = reinterpret_cast<__m128i*>(data + done);
+        _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), key128));
+    }
+#else
+    (void)data;
+    (void)size;
+    (void)maskingKey;
+#endif
+
+    return done;
+}
+
+SEV_WS_TARGET_AVX2
+size_t WsFrame::maskAvx2(
+    unsigned char* data, size_t size, uint32_t maskingKey)
+{
+    size_t done = 0;
+
+#ifdef SEV_WS_MASK_AVX2
+    const __m256i key256 =
+        _mm256_set1_epi32(static_cast<int32_t>(maskingKey));
+
+    for (; done + sizeof(__m256i) <= size; done += sizeof(__m256i))
+    {
+        __m256i* p = reinterpret_cast<__m256i*>(data + done);
+        _mm256_storeu_si256(
+            p, _mm256_xor_si256(_mm256_loadu_si256(p), key256));
+    }
+#else
+    (void)data;
+    (void)size;
+    (void)maskingKey;
+#endif
+
+    return done;
+}
+
+WsFrame::MaskKernel WsFrame::getMaskKernel()
+{
+    // checked once at the first call
+    static const MaskKernel kernel = []() -> MaskKernel
+    {
+#ifdef SEV_WS_MASK_AVX2
+#   ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+
+        if (info[0] >= 7)
+        {
+            __cpuid(info, 1);
+            bool osxsave = ((info[2] & (1 << 27)) != 0);
 
-                mPayload[index] = b ^ maskingKey[index % 4];
+            __cpuidex(info, 7, 0);
+            bool avx2 = ((info[1] & (1 << 5)) != 0);
+
+            // ymm state enabled by the os
+            if (osxsave && avx2 && ((_xgetbv(0) & 0x06) == 0x06))
+            {
+                return &WsFrame::maskAvx2;
             }
         }
-        else
+#   else
+        __builtin_cpu_init();
+
+        if (__builtin_cpu_supports("avx2"))
         {
-            reader.readBytes(
-                &mPayload[0], static_cast<size_t>(payloadLength));
+            return &WsFrame::maskAvx2;
         }
-    }
-    
-    return true;
+#   endif
+#endif
+#ifdef SEV_WS_MASK_SSE2
+        return &WsFrame::maskSse2;
+#else
+        return &WsFrame::maskWord;
+#endif
+    }();
+
+    return kernel;
 }
 
 //----------------------------------------------------------------------------//
@@ -241,7 +420,10 @@ bool WsFrame::deserializePayload(ByteReader& reader)
 //----------------------------------------------------------------------------//
 
 WsChannel::WsChannel(const TcpChannelPtr& channel, bool isClient)
-    : mIsClient(isClient), mChannel(channel)
+    : mIsClient(isClient), mChannel(channel),
+      mThreadRef(channel->getNetWorker()->getThread()->getRef()),
+      mIncrementalReceive(false), mMaxMessageSize(0),
+      mPostedSends(nullptr)
 {
     mOldReceiveHandler = channel->getReceiveHandler();
 
@@ -253,6 +435,14 @@ WsChannel::WsChannel(const TcpChannelPtr& channel, bool isClient)
 
 WsChannel::~WsChannel()
 {
+    PostedSend* posted = mPostedSends.exchange(nullptr);
+
+    while (posted != nullptr)
+    {
+        PostedSend* next = posted->mNext;
+        delete posted;
+        posted = next;
+    }
 }
 
 void WsChannel::close(uint16_t statusCode)
@@ -283,6 +473,12 @@ int32_t WsChannel::send(
         return -1;
     }
 
+    if (mSendMessage.mActive && !frame.isControlFrame())
+    {
+        // in the middle of a message
+        return -3;
+    }
+
     TcpChannelPtr channel = mChannel.lock();
 
     if (channel == nullptr)
@@ -290,7 +486,53 @@ int32_t WsChannel::send(
         return  -2;
     }
 
+#ifdef SEV_SUPPORTS_ZLIB
+    // compress a whole data message
+    if ((mDeflate != nullptr) &&
+        frame.isFin() && !frame.isRsv1() &&
+        ((frame.getOpCode() == WsFrame::OpCode::Text) ||
+            (frame.getOpCode() == WsFrame::OpCode::Binary)) &&
+        (frame.getPayloadSize() >= mDeflate->getMinSize()))
+    {
+        const void* data = (payload != nullptr) ?
+            payload : frame.getPayloadData();
+
+        mDeflateBuffer.clear();
+
+        if (mDeflate->compress(
+            data, frame.getPayloadSize(), mDeflateBuffer))
+        {
+            WsFrame compressed(frame.getOpCode(), false);
+            compressed.setMask(frame.isMask());
+            compressed.setMaskingKey(&frame.getMaskingKey()[0]);
+            compressed.setRsv1(true);
+            compressed.setPayloadLength(mDeflateBuffer.size());
+
+            int32_t result =
+                send(compressed, &mDeflateBuffer[0], handler);
+
+            releaseBuffer(mDeflateBuffer);
+
+            return result;
+        }
+    }
+#endif
+
     std::vector<char> sendData;
+    serializeFrame(frame, payload, sendData);
+
+    return channel->send(std::move(sendData), handler);
+}
+
+void WsChannel::serializeFrame(
+    const WsFrame& frame, const void* payload,
+    std::vector<char>& sendData)
+{
+    const size_t payloadLength =
+        static_cast<size_t>(frame.getPayloadLength());
+
+    // header is 14 bytes at most
+    sendData.reserve(14 + payloadLength);
 
     NetByteWriter writer(sendData);
 
@@ -298,25 +540,137 @@ int32_t WsChannel::send(
 
     if (payload != nullptr)
     {
-        writer.writeBytes(
-            payload, static_cast<size_t>(frame.getPayloadLength()));
+        size_t cur = writer.getCur();
+
+        writer.writeBytes(payload, payloadLength);
+
+        if (frame.isMask() && (payloadLength > 0))
+        {
+            writer.setCur(cur);
+            WsFrame::mask(
+                writer.getPtr(), payloadLength, frame.getMaskingKey());
+            writer.seekCur(static_cast<int32_t>(payloadLength));
+        }
     }
     else
     {
         frame.serializePayload(writer);
     }
-    
-    return channel->send(std::move(sendData), handler);
+}
+
+int32_t WsChannel::sendSerialized(
+    const std::shared_ptr<const std::vector<char>>& sendData)
+{
+    if (isClosed() || isSentCloseFrame())
+    {
+        return -1;
+    }
+
+    // control frames (opcode 0x8-0xF) may go between the fragments
+    if (mSendMessage.mActive && !sendData->empty() &&
+        (((*sendData)[0] & 0x08) == 0))
+    {
+        // in the middle of a message
+        return -3;
+    }
+
+    TcpChannelPtr channel = mChannel.lock();
+
+    if (channel == nullptr)
+    {
+        return -2;
+    }
+
+    return channel->send(sendData);
+}
+
+bool WsChannel::isSmallPayload(size_t size) const
+{
+#ifdef SEV_SUPPORTS_ZLIB
+    if ((mDeflate != nullptr) && (size >= mDeflate->getMinSize()))
+    {
+        // compressed
+        return false;
+    }
+#endif
+
+    return (size <= SmallPayloadSize);
+}
+
+int32_t WsChannel::sendSmall(
+    uint8_t opCode, const void* payload, size_t size,
+    const TcpSendHandler& handler)
+{
+    if (isClosed() || isSentCloseFrame())
+    {
+        return -1;
+    }
+
+    if (mSendMessage.mActive)
+    {
+        // in the middle of a message
+        return -3;
+    }
+
+    TcpChannelPtr channel = mChannel.lock();
+
+    if (channel == nullptr)
+    {
+        return  -2;
+    }
+
+    // fin, 7 bit length, masking key
+    char sendData[6 + SmallPayloadSize];
+    size_t headerSize = 2;
+
+    sendData[0] = static_cast<char>(0x80 | (opCode & 0x0F));
+    sendData[1] = static_cast<char>(size);
+
+    std::array<unsigned char, 4> maskingKey;
+
+    if (isClientChannel())
+    {
+        uint32_t random32 = Random::generate32();
+        memcpy(&maskingKey[0], &random32, sizeof(random32));
+
+        sendData[1] |= 0x80;
+        memcpy(&sendData[headerSize], &maskingKey[0], maskingKey.size());
+        headerSize += maskingKey.size();
+    }
+
+    if (size > 0)
+    {
+        memcpy(&sendData[headerSize], payload, size);
+
+        if (isClientChannel())
+        {
+            WsFrame::mask(&sendData[headerSize], size, maskingKey);
+        }
+    }
+
+    return channel->send(sendData, headerSize + size, handler);
+}
+
+int32_t WsChannel::sendData(
+    uint8_t opCode, const void* payload, size_t size,
+    const TcpSendHandler& handler)
+{
+    if (isSmallPayload(size))
+    {
+        return sendSmall(opCode, payload, size, handler);
+    }
+
+    WsFrame frame(opCode, isClientChannel());
+    frame.setPayloadLength(size);
+
+    return send(frame, payload, handler);
 }
 
 int32_t WsChannel::send(
     const void* data, size_t size,
     const TcpSendHandler& handler)
 {
-    WsFrame frame(WsFrame::OpCode::Binary, isClientChannel());
-    frame.setPayloadLength(size);
-    
-    return send(frame, data, handler);
+    return sendData(WsFrame::OpCode::Binary, data, size, handler);
 }
 
 int32_t WsChannel::send(
@@ -330,10 +684,8 @@ int32_t WsChannel::send(
     const std::string& payload,
     const TcpSendHandler& handler)
 {
-    WsFrame frame(WsFrame::OpCode::Text, isClientChannel());
-    frame.setPayloadLength(payload.size());
-
-    return send(frame, payload.c_str(), handler);
+    return sendData(WsFrame::OpCode::Text,
+        payload.c_str(), payload.size(), handler);
 }
 
 int32_t WsChannel::sendPing(
@@ -346,131 +698,676 @@ int32_t WsChannel::sendPing(
     return send(frame, payload, handler);
 }
 
-void WsChannel::onTcpReceive(const TcpChannelPtr& channel)
+int32_t WsChannel::beginMessage(bool text)
 {
-    auto message = channel->receiveAll();
-
-    if (mReceiveCache.mPosition > 0)
+    if (isClosed() || isSentCloseFrame())
     {
-        mReceiveCache.mBuffer.insert(
-            mReceiveCache.mBuffer.end(),
-            message.begin(), message.end());
+        return -1;
     }
-    else
+
+    if (mSendMessage.mActive)
     {
-        mReceiveCache.mBuffer = std::move(message);
+        return -3;
     }
 
-    NetByteReader reader(mReceiveCache.mBuffer);
-    reader.setCur(mReceiveCache.mPosition);
-
-    uint32_t headPosition =
-        (uint32_t)mReceiveCache.mPosition;
+    mSendMessage.mActive = true;
+    mSendMessage.mStarted = false;
+    mSendMessage.mOpCode = text ?
+        WsFrame::OpCode::Text : WsFrame::OpCode::Binary;
 
-    std::list<WsFramePtr> receiveFrames;
+    return 0;
+}
 
-    for (;;)
-    {
-        uint32_t totalLength =
-            (uint32_t)(mReceiveCache.mBuffer.size() - headPosition);
+int32_t WsChannel::appendMessage(
+    const void* data, size_t size,
+    const TcpSendHandler& handler)
+{
+    return sendFragment(data, size, false, handler);
+}
 
-        if (totalLength < WsFrame::getMinLength())
-        {
-            break;
-        }
+int32_t WsChannel::endMessage(
+    const void* data, size_t size,
+    const TcpSendHandler& handler)
+{
+    return sendFragment(data, size, true, handler);
+}
 
-        size_t size = reader.getReadableSize();
+int32_t WsChannel::sendFragment(
+    const void* data, size_t size, bool fin,
+    const TcpSendHandler& handler)
+{
+    if (isClosed() || isSentCloseFrame())
+    {
+        return -1;
+    }
 
-        WsFramePtr frame = std::make_shared<WsFrame>();
+    if (!mSendMessage.mActive)
+    {
+        return -3;
+    }
 
-        try
-        {
-            if (!frame->deserializeHeader(reader))
-            {
-                break;
-            }
+    TcpChannelPtr channel = mChannel.lock();
 
-            if (!frame->deserializePayload(reader))
-            {
-                break;
-            }
+    if (channel == nullptr)
+    {
+        return -2;
+    }
 
-            if (frame->isControlFrame())
-            {
-                if (frame->getOpCode() == WsFrame::OpCode::ConnectionClose)
-                { 
-                    mCloseState.mFrame = frame;
-                }
-                else
-                {
-                    receiveFrames.push_back(frame);
-                }
-            }
-            else if (mContinuationFrame != nullptr)
-            {
-                mContinuationFrame->addPayload(frame->getPayload());
+    WsFrame frame(mSendMessage.mStarted ?
+        WsFrame::OpCode::Continuation : mSendMessage.mOpCode,
+        isClientChannel());
+    frame.setFin(fin);
+    frame.setPayloadLength(size);
 
-                if (frame->isFin())
-                {
-                    mContinuationFrame->setFin(true);
-                    receiveFrames.push_back(mContinuationFrame);
-                    mContinuationFrame.reset();
-                }
-            }
-            else
-            {
-                if (frame->isFin())
-                {
-                    receiveFrames.push_back(frame);
-                }
-                else
-                {
-                    mContinuationFrame = frame;
-                }
-            }
-        }
-        catch (...)
-        {
-            // error
-            return;
-        }
+    std::vector<char> sendData;
+    serializeFrame(frame, data, sendData);
 
-        headPosition +=
-            (uint32_t)(size - reader.getReadableSize());
-    }
+    // always through the send queue
+    int32_t result = channel->send(
+        std::make_shared<const std::vector<char>>(std::move(sendData)),
+        handler);
 
-    if (reader.getReadableSize() == 0)
-    {
-        mReceiveCache.clear();
-    }
-    else
+    if (result < 0)
     {
-        mReceiveCache.mPosition = headPosition;
+        return result;
     }
 
-    if (mCloseState.mFrame != nullptr)
-    {
-        if (mContinuationFrame == nullptr)
-        {
-            receiveFrames.push_back(mCloseState.mFrame);
-        }
-    }
+    mSendMessage.mStarted = true;
 
-    for (const auto& frame : receiveFrames)
+    if (fin)
     {
-        onReceiveFrame(frame);
+        mSendMessage.mActive = false;
     }
+
+    return result;
 }
 
-void WsChannel::onTcpClose(const TcpChannelPtr& channel)
+size_t WsChannel::getSendQueueSize() const
 {
-    if (mCloseHandler != nullptr)
+    TcpChannelPtr channel = mChannel.lock();
+
+    if (channel == nullptr)
     {
-        mCloseHandler(channel);
+        return 0;
     }
+
+    return channel->getSendQueueSize();
 }
 
-void WsChannel::onReceiveFrame(const WsFramePtr& frame)
+int32_t WsChannel::postSend(const void* payload, size_t size)
+{
+    const char* bytes = static_cast<const char*>(payload);
+
+    return postSend(WsFrame::OpCode::Binary,
+        std::vector<char>(bytes, bytes + size));
+}
+
+int32_t WsChannel::postSend(std::vector<char>&& payload)
+{
+    return postSend(WsFrame::OpCode::Binary,
+        std::forward<std::vector<char>>(payload));
+}
+
+int32_t WsChannel::postSend(const std::string& payload)
+{
+    return postSend(WsFrame::OpCode::Text,
+        std::vector<char>(payload.begin(), payload.end()));
+}
+
+int32_t WsChannel::postSend(
+    uint8_t opCode, std::vector<char>&& payload)
+{
+    PostedSend* posted = new PostedSend;
+    posted->mOpCode = opCode;
+    posted->mPayload = std::move(payload);
+
+    // posted belongs to the thread of the channel once pushed
+    PostedSend* head = mPostedSends.load(std::memory_order_relaxed);
+
+    do
+    {
+        posted->mNext = head;
+    }
+    while (!mPostedSends.compare_exchange_weak(
+        head, posted,
+        std::memory_order_release, std::memory_order_relaxed));
+
+    if (head != nullptr)
+    {
+        // the thread is already woken up
+        return 0;
+    }
+
+    std::weak_ptr<WsChannel> weak = shared_from_this();
+
+    if (!mThreadRef->post([weak]() {
+
+        WsChannelPtr channel = weak.lock();
+
+        if (channel != nullptr)
+        {
+            channel->onPostedSend();
+        }
+    }))
+    {
+        // nothing takes them, the next call fails too
+        posted = mPostedSends.exchange(nullptr, std::memory_order_acquire);
+
+        while (posted != nullptr)
+        {
+            PostedSend* next = posted->mNext;
+            delete posted;
+            posted = next;
+        }
+
+        return -1;
+    }
+
+    return 0;
+}
+
+void WsChannel::onPostedSend()
+{
+    PostedSend* posted =
+        mPostedSends.exchange(nullptr, std::memory_order_acquire);
+
+    // oldest first
+    PostedSend* first = nullptr;
+
+    while (posted != nullptr)
+    {
+        PostedSend* next = posted->mNext;
+        posted->mNext = first;
+        first = posted;
+        posted = next;
+    }
+
+    while (first != nullptr)
+    {
+        sendData(first->mOpCode,
+            first->mPayload.data(), first->mPayload.size(), nullptr);
+
+        PostedSend* next = first->mNext;
+        delete first;
+        first = next;
+    }
+}
+
+void WsChannel::onTcpReceive(const TcpChannelPtr& channel)
+{
+    WsChannelPtr self = shared_from_this();
+
+    std::vector<char>& buffer = mReceiveCache.mBuffer;
+    size_t& total = mReceiveCache.mSize;
+
+    // append to the unparsed bytes
+    try
+    {
+        for (;;)
+        {
+            if ((buffer.size() - total) < ReceiveSize)
+            {
+                const size_t receiveSize = ReceiveSize;
+                const size_t keepBufferSize = KeepBufferSize;
+
+                if ((total + receiveSize) > buffer.capacity())
+                {
+                    buffer.reserve(std::max(
+                        2 * buffer.capacity(), total + receiveSize));
+                }
+
+                // at most KeepBufferSize ahead of the data
+                buffer.resize(total + std::max(receiveSize,
+                    std::min(buffer.capacity() - total, keepBufferSize)));
+            }
+
+            int32_t size = channel->receive(&buffer[total],
+                std::min<size_t>(buffer.size() - total, INT32_MAX));
+
+            if (size <= 0)
+            {
+                break;
+            }
+
+            total += size;
+            mKeepAlive.mReceived = true;
+        }
+    }
+    catch (...)
+    {
+        mReceiveCache.clear();
+        channel->close();
+        return;
+    }
+
+    if (mCloseState.mFailed)
+    {
+        // discarded until the peer closes
+        mReceiveCache.clear();
+        return;
+    }
+
+    if (total < mReceiveCache.mNeeded)
+    {
+        // the frame at the head is still incomplete
+        return;
+    }
+
+    mReceiveCache.mNeeded = 0;
+
+    size_t position = 0;
+
+    try
+    {
+        for (;;)
+        {
+            const size_t framePosition = position;
+            const WsFramePtr& frame = getReceiveFrame();
+
+            if (mChunk.mActive)
+            {
+                // the rest of a frame delivered in chunks
+                const size_t size = static_cast<size_t>(std::min<uint64_t>(
+                    total - position, mChunk.mRemaining));
+
+                if (size == 0)
+                {
+                    break;
+                }
+
+                char* payload = &buffer[0] + position;
+
+                if (mChunk.mMask)
+                {
+                    WsFrame::mask(payload, size, mChunk.mMaskingKey,
+                        static_cast<size_t>(mChunk.mOffset));
+                }
+
+                frame->setOpCode((mChunk.mOffset == 0) ?
+                    mChunk.mOpCode : WsFrame::OpCode::Continuation);
+                frame->setMask(mChunk.mMask);
+                frame->setMaskingKey(&mChunk.mMaskingKey[0]);
+
+                mChunk.mOffset += size;
+                mChunk.mRemaining -= size;
+                mChunk.mActive = (mChunk.mRemaining > 0);
+
+                frame->setFin(!mChunk.mActive && mChunk.mFin);
+                frame->setPayloadView(payload, size);
+                position += size;
+
+                mMessage.mSize = frame->isFin() ? 0 : (mMessage.mSize + size);
+            }
+            else
+            {
+                if (((total - position) < WsFrame::getMinLength()) ||
+                    ((total - position) <
+                        WsFrame::getHeaderLength(&buffer[position])))
+                {
+                    break;
+                }
+
+                // the room after total is not read
+                NetByteReader reader(buffer);
+                reader.setCur(position);
+
+                if (!frame->deserializeHeader(reader))
+                {
+                    break;
+                }
+
+                const uint64_t maxSize = (mMaxMessageSize > 0) ?
+                    mMaxMessageSize : (SIZE_MAX - KeepBufferSize);
+
+                if (!frame->isControlFrame() &&
+                    ((mMessage.mSize + frame->getPayloadLength()) > maxSize))
+                {
+                    onMessageTooBig();
+                    return;
+                }
+
+                const size_t received = total - reader.getCur();
+
+                if (received < frame->getPayloadLength())
+                {
+                    if (!mIncrementalReceive || frame->isControlFrame() ||
+                        frame->isRsv1() || mMessage.mActive)
+                    {
+                        // wait for the whole frame
+                        mReceiveCache.mNeeded =
+                            reader.getCur() - position +
+                            frame->getPayloadLength();
+
+                        break;
+                    }
+
+                    // deliver what has arrived
+                    mChunk.mActive = true;
+                    mChunk.mFin = frame->isFin();
+                    mChunk.mMask = frame->isMask();
+                    mChunk.mOpCode = frame->getOpCode();
+                    mChunk.mMaskingKey = frame->getMaskingKey();
+                    mChunk.mOffset = 0;
+                    mChunk.mRemaining = frame->getPayloadLength();
+
+                    position = reader.getCur();
+                    continue;
+                }
+
+                const size_t payloadSize = frame->getPayloadSize();
+                char* payload = &buffer[0] + reader.getCur();
+
+                if (frame->isMask())
+                {
+                    WsFrame::mask(
+                        payload, payloadSize, frame->getMaskingKey());
+                }
+
+                frame->setPayloadView(payload, payloadSize);
+                position = reader.getCur() + payloadSize;
+
+                if (frame->isControlFrame())
+                {
+                    if (frame->getOpCode() ==
+                        WsFrame::OpCode::ConnectionClose)
+                    {
+                        // delivered after the parse
+                        frame->ownPayload();
+                        mCloseState.mFrame = frame;
+
+                        continue;
+                    }
+                }
+                else if (mMessage.mActive)
+                {
+                    mMessage.mBuffer.insert(mMessage.mBuffer.end(),
+                        payload, payload + payloadSize);
+                    mMessage.mSize += payloadSize;
+
+                    if (!frame->isFin())
+                    {
+                        continue;
+                    }
+
+                    // deliver the whole message in this frame
+                    mMessage.mActive = false;
+                    mMessage.mSize = 0;
+
+                    frame->setOpCode(mMessage.mOpCode);
+                    frame->setRsv1(mMessage.mCompressed);
+                    frame->setPayloadView(
+                        mMessage.mBuffer.data(), mMessage.mBuffer.size());
+                }
+                else if (mIncrementalReceive && !frame->isRsv1())
+                {
+                    // delivered as it is
+                    mMessage.mSize = frame->isFin() ?
+                        0 : (mMessage.mSize + payloadSize);
+                }
+                else if (!frame->isFin())
+                {
+                    mMessage.mActive = true;
+                    mMessage.mCompressed = frame->isRsv1();
+                    mMessage.mOpCode = frame->getOpCode();
+                    mMessage.mBuffer.assign(payload, payload + payloadSize);
+                    mMessage.mSize = payloadSize;
+
+                    continue;
+                }
+
+                if (!frame->isControlFrame() &&
+                    frame->isRsv1() && !inflateFrame(*frame))
+                {
+                    mReceiveCache.clear();
+                    mMessage.mActive = false;
+
+                    return;
+                }
+            }
+
+            onReceiveFrame(frame);
+
+            if (mReceiveFrame.use_count() > 1)
+            {
+                keepReceiveFrame(framePosition);
+
+                if (buffer.empty())
+                {
+                    position = 0;
+                    break;
+                }
+            }
+            else
+            {
+                if (!mMessage.mActive && !mMessage.mBuffer.empty())
+                {
+                    releaseBuffer(mMessage.mBuffer);
+                }
+
+#ifdef SEV_SUPPORTS_ZLIB
+                if (!mInflateBuffer.empty())
+                {
+                    releaseBuffer(mInflateBuffer);
+                }
+#endif
+            }
+        }
+    }
+    catch (...)
+    {
+        // error
+        return;
+    }
+
+    // keep the incomplete frame at the head
+    if (position >= total)
+    {
+        total = 0;
+
+        if (buffer.capacity() > KeepBufferSize)
+        {
+            std::vector<char>().swap(buffer);
+        }
+    }
+    else if (position > 0)
+    {
+        std::memmove(&buffer[0], &buffer[position], total - position);
+        total -= position;
+    }
+
+    if (mReceiveCache.mNeeded > buffer.capacity())
+    {
+        // the announced length is not trusted beyond the limit,
+        // a larger frame grows with what arrives
+        const uint64_t keepBufferSize = KeepBufferSize;
+
+        if (mReceiveCache.mNeeded <=
+            std::max(keepBufferSize, mMaxMessageSize))
+        {
+            buffer.reserve(static_cast<size_t>(mReceiveCache.mNeeded));
+        }
+    }
+
+    if (mCloseState.mFrame != nullptr)
+    {
+        if (!mMessage.mActive)
+        {
+            onReceiveFrame(mCloseState.mFrame);
+        }
+    }
+}
+
+const WsFramePtr& WsChannel::getReceiveFrame()
+{
+    if ((mReceiveFrame == nullptr) || (mReceiveFrame.use_count() > 1))
+    {
+        mReceiveFrame = std::make_shared<WsFrame>();
+    }
+    else
+    {
+        mReceiveFrame->clear();
+    }
+
+    return mReceiveFrame;
+}
+
+void WsChannel::keepReceiveFrame(size_t framePosition)
+{
+    // the handler kept the frame, give it its own payload
+    WsFrame& frame = *mReceiveFrame;
+    std::vector<char>& buffer = mReceiveCache.mBuffer;
+
+    if (frame.mPayloadView == nullptr)
+    {
+        // getPayload() has made a copy
+    }
+    else if (frame.mPayloadView == mMessage.mBuffer.data())
+    {
+        frame.mPayload = std::move(mMessage.mBuffer);
+        frame.mPayloadView = nullptr;
+
+        mMessage.mBuffer = std::vector<char>();
+    }
+#ifdef SEV_SUPPORTS_ZLIB
+    else if (frame.mPayloadView == mInflateBuffer.data())
+    {
+        frame.mPayload = std::move(mInflateBuffer);
+        frame.mPayloadView = nullptr;
+
+        mInflateBuffer = std::vector<char>();
+    }
+#endif
+    else if ((framePosition == 0) &&
+        (frame.mPayloadView + frame.getPayloadSize() ==
+            buffer.data() + mReceiveCache.mSize))
+    {
+        // one frame spans the buffer, move it
+        buffer.resize(mReceiveCache.mSize);
+        buffer.erase(
+            buffer.begin(),
+            buffer.begin() + (frame.mPayloadView - buffer.data()));
+
+        frame.mPayload = std::move(buffer);
+        frame.mPayloadView = nullptr;
+
+        buffer = std::vector<char>();
+        mReceiveCache.mSize = 0;
+    }
+    else
+    {
+        frame.ownPayload();
+    }
+
+    mReceiveFrame.reset();
+}
+
+void WsChannel::onMessageTooBig()
+{
+    mReceiveCache.clear();
+
+    mMessage.mActive = false;
+    mMessage.mSize = 0;
+    releaseBuffer(mMessage.mBuffer);
+
+    mChunk.mActive = false;
+    mCloseState.mFailed = true;
+
+    close(WsCloseFrame::StatusCode::MessageTooBig);
+}
+
+bool WsChannel::inflateFrame(WsFrame& frame)
+{
+#ifdef SEV_SUPPORTS_ZLIB
+    if (mDeflate != nullptr)
+    {
+        mInflateBuffer.clear();
+
+        size_t maxSize = static_cast<size_t>(
+            std::min<uint64_t>(mMaxMessageSize, SIZE_MAX));
+
+        if (maxSize == 0)
+        {
+            // a small message can inflate to any size
+            maxSize = mDeflate->getMaxMessageSize();
+        }
+
+        if (!mDeflate->decompress(
+            frame.getPayloadData(), frame.getPayloadSize(),
+            mInflateBuffer, maxSize))
+        {
+            if ((maxSize > 0) && (mInflateBuffer.size() >= maxSize))
+            {
+                onMessageTooBig();
+            }
+            else
+            {
+                mCloseState.mFailed = true;
+                close(WsCloseFrame::StatusCode::InvalidFramePayloadData);
+            }
+
+            return false;
+        }
+
+        frame.setRsv1(false);
+        frame.setPayloadView(mInflateBuffer.data(), mInflateBuffer.size());
+
+        return true;
+    }
+#else
+    (void)frame;
+#endif
+
+    // not negotiated
+    mCloseState.mFailed = true;
+    close(WsCloseFrame::StatusCode::ProtocolError);
+
+    return false;
+}
+
+void WsChannel::releaseBuffer(std::vector<char>& buffer)
+{
+    if (buffer.capacity() > KeepBufferSize)
+    {
+        std::vector<char>().swap(buffer);
+    }
+    else
+    {
+        buffer.clear();
+    }
+}
+
+void WsChannel::onTcpClose(const TcpChannelPtr& channel)
+{
+    if (mCloseHandler != nullptr)
+    {
+        mCloseHandler(channel);
+    }
+}
+
+void WsChannel::onKeepAliveTimeout()
+{
+    TcpChannelPtr channel = mChannel.lock();
+
+    mCloseState.mClosed = true;
+    mCloseState.mFrame.reset();
+
+    if ((channel == nullptr) || channel->isClosed())
+    {
+        return;
+    }
+
+    // the peer is gone, no close handshake
+    TcpCloseHandler closeHandler = mCloseHandler;
+
+    channel->close();
+
+    if (closeHandler != nullptr)
+    {
+        closeHandler(channel);
+    }
+}
+
+void WsChannel::onReceiveFrame(const WsFramePtr& frame)
 {
     WsChannelPtr self =
         std::dynamic_pointer_cast<WsChannel>(shared_from_this());
@@ -559,6 +1456,482 @@ void WsChannel::onControlFrame(const WsFramePtr& frame)
     }
 }
 
+//----------------------------------------------------------------------------//
+// WsBroadcastGroup
+//----------------------------------------------------------------------------//
+
+WsBroadcastGroup::WsBroadcastGroup()
+    : mState(std::make_shared<State>())
+{
+}
+
+WsBroadcastGroup::~WsBroadcastGroup()
+{
+}
+
+bool WsBroadcastGroup::add(const WsChannelPtr& channel)
+{
+    // a closed one is pruned by the next broadcast on its thread
+    if ((channel == nullptr) || channel->isClientChannel())
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mState->mMutex);
+
+    Members& members = mState->mMembers[channel->mThreadRef.get()];
+    members.mThreadRef = channel->mThreadRef;
+
+    auto it = members.mChannels.find(channel.get());
+
+    if (it != members.mChannels.end())
+    {
+        if (!it->second.expired())
+        {
+            return false;
+        }
+
+        // the address of a released one
+        it->second = channel;
+    }
+    else
+    {
+        members.mChannels.emplace(channel.get(), channel);
+        ++mState->mSize;
+    }
+
+    members.mSnapshot.reset();
+
+    return true;
+}
+
+bool WsBroadcastGroup::remove(const WsChannelPtr& channel)
+{
+    std::lock_guard<std::mutex> lock(mState->mMutex);
+
+    // the channel may have left its thread already
+    for (auto it = mState->mMembers.begin();
+        it != mState->mMembers.end(); ++it)
+    {
+        Members& members = it->second;
+
+        if (members.mChannels.erase(channel.get()) == 0)
+        {
+            continue;
+        }
+
+        --mState->mSize;
+
+        if (members.mChannels.empty())
+        {
+            mState->mMembers.erase(it);
+        }
+        else
+        {
+            members.mSnapshot.reset();
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void WsBroadcastGroup::clear()
+{
+    std::lock_guard<std::mutex> lock(mState->mMutex);
+
+    mState->mMembers.clear();
+    mState->mSize = 0;
+}
+
+size_t WsBroadcastGroup::getSize() const
+{
+    std::lock_guard<std::mutex> lock(mState->mMutex);
+
+    return mState->mSize;
+}
+
+size_t WsBroadcastGroup::broadcast(const void* payload, size_t size)
+{
+    WsFrame frame(WsFrame::OpCode::Binary);
+    frame.setPayloadLength(size);
+
+    return broadcast(frame, payload);
+}
+
+size_t WsBroadcastGroup::broadcast(const std::vector<char>& payload)
+{
+    return broadcast(&payload[0], payload.size());
+}
+
+size_t WsBroadcastGroup::broadcast(const std::string& payload)
+{
+    WsFrame frame(WsFrame::OpCode::Text);
+    frame.setPayloadLength(payload.size());
+
+    return broadcast(frame, payload.c_str());
+}
+
+size_t WsBroadcastGroup::broadcast(
+    const WsFrame& frame, const void* payload)
+{
+    if (frame.isMask())
+    {
+        return 0;
+    }
+
+    std::vector<std::pair<ThreadRefPtr, ChannelsPtr>> targets;
+
+    {
+        std::lock_guard<std::mutex> lock(mState->mMutex);
+
+        targets.reserve(mState->mMembers.size());
+
+        for (auto& item : mState->mMembers)
+        {
+            Members& members = item.second;
+
+            if (members.mSnapshot == nullptr)
+            {
+                std::shared_ptr<Channels> channels =
+                    std::make_shared<Channels>();
+                channels->reserve(members.mChannels.size());
+
+                for (auto it = members.mChannels.begin();
+                    it != members.mChannels.end();)
+                {
+                    if (it->second.expired())
+                    {
+                        it = members.mChannels.erase(it);
+                        --mState->mSize;
+                    }
+                    else
+                    {
+                        channels->push_back(it->second);
+                        ++it;
+                    }
+                }
+
+                members.mSnapshot = channels;
+            }
+
+            if (!members.mSnapshot->empty())
+            {
+                targets.push_back(std::make_pair(
+                    members.mThreadRef, members.mSnapshot));
+            }
+        }
+    }
+
+    if (targets.empty())
+    {
+        return 0;
+    }
+
+    std::vector<char> data;
+    WsChannel::serializeFrame(frame, payload, data);
+
+    std::shared_ptr<const std::vector<char>> sendData =
+        std::make_shared<const std::vector<char>>(std::move(data));
+
+    std::weak_ptr<State> state = mState;
+    Thread* current = Thread::getCurrent();
+    size_t count = 0;
+
+    for (const auto& target : targets)
+    {
+        ThreadRef* threadRef = target.first.get();
+
+        if ((current != nullptr) && (threadRef == current->getRef().get()))
+        {
+            count += send(state, threadRef, *target.second, sendData);
+            continue;
+        }
+
+        // one task for all the members of the thread
+        ChannelsPtr channels = target.second;
+
+        if (!target.first->post([state, threadRef, channels, sendData]() {
+            send(state, threadRef, *channels, sendData);
+        }))
+        {
+            // the thread has ended with its members
+            std::lock_guard<std::mutex> lock(mState->mMutex);
+
+            auto it = mState->mMembers.find(threadRef);
+
+            if (it != mState->mMembers.end())
+            {
+                mState->mSize -= it->second.mChannels.size();
+                mState->mMembers.erase(it);
+            }
+
+            continue;
+        }
+
+        // the ones released since the snapshot are not counted
+        for (const auto& member : *channels)
+        {
+            if (!member.expired())
+            {
+                ++count;
+            }
+        }
+    }
+
+    return count;
+}
+
+size_t WsBroadcastGroup::send(
+    const std::weak_ptr<State>& state,
+    ThreadRef* threadRef,
+    const Channels& channels,
+    const std::shared_ptr<const std::vector<char>>& sendData)
+{
+    std::vector<WsChannel*> closed;
+    bool released = false;
+    size_t count = 0;
+
+    for (const auto& member : channels)
+    {
+        WsChannelPtr channel = member.lock();
+
+        if (channel == nullptr)
+        {
+            released = true;
+        }
+        else if (channel->isClosed())
+        {
+            closed.push_back(channel.get());
+        }
+        else if (channel->sendSerialized(sendData) >= 0)
+        {
+            ++count;
+        }
+    }
+
+    if (released || !closed.empty())
+    {
+        StatePtr current = state.lock();
+
+        if (current != nullptr)
+        {
+            prune(current, threadRef, closed);
+        }
+    }
+
+    return count;
+}
+
+void WsBroadcastGroup::prune(
+    const StatePtr& state,
+    ThreadRef* threadRef,
+    const std::vector<WsChannel*>& closed)
+{
+    std::lock_guard<std::mutex> lock(state->mMutex);
+
+    auto it = state->mMembers.find(threadRef);
+
+    if (it == state->mMembers.end())
+    {
+        return;
+    }
+
+    Members& members = it->second;
+    size_t size = members.mChannels.size();
+
+    for (auto member = members.mChannels.begin();
+        member != members.mChannels.end();)
+    {
+        WsChannelPtr channel = member->second.lock();
+
+        // a channel added again since the send is kept
+        if ((channel == nullptr) ||
+            ((std::find(closed.begin(), closed.end(), channel.get()) !=
+                closed.end()) && channel->isClosed()))
+        {
+            member = members.mChannels.erase(member);
+        }
+        else
+        {
+            ++member;
+        }
+    }
+
+    state->mSize -= size - members.mChannels.size();
+
+    if (members.mChannels.empty())
+    {
+        state->mMembers.erase(it);
+    }
+    else if (members.mChannels.size() != size)
+    {
+        members.mSnapshot.reset();
+    }
+}
+
+//----------------------------------------------------------------------------//
+// WsKeepAlive
+//----------------------------------------------------------------------------//
+
+WsKeepAlive::WsKeepAlive(const WsKeepAliveOption& option)
+    : mOption(option)
+{
+    if (mOption.tick == 0)
+    {
+        mOption.tick = 1;
+    }
+
+    // rounded up, at least one tick
+    mIntervalTicks = std::max<size_t>(
+        (mOption.interval + mOption.tick - 1) / mOption.tick, 1);
+    mTimeoutTicks = std::max<size_t>(
+        (mOption.timeout + mOption.tick - 1) / mOption.tick, 1);
+
+    mWheel.resize(std::max(mIntervalTicks, mTimeoutTicks) + 1);
+    mCursor = 0;
+    mSize = 0;
+    mNetWorker = nullptr;
+}
+
+WsKeepAlive::~WsKeepAlive()
+{
+    mTimer.cancel();
+
+    // the channels can be added to another one
+    for (const auto& slot : mWheel)
+    {
+        for (const auto& item : slot)
+        {
+            WsChannelPtr channel = item.lock();
+
+            if (channel != nullptr)
+            {
+                channel->mKeepAlive.mWatched = false;
+            }
+        }
+    }
+}
+
+bool WsKeepAlive::add(const WsChannelPtr& channel)
+{
+    if ((channel == nullptr) || channel->isClosed() ||
+        channel->mKeepAlive.mWatched)
+    {
+        return false;
+    }
+
+    NetWorker* current = NetWorker::getCurrent();
+
+    // the wheel and the timer are not locked
+    if ((current == nullptr) ||
+        ((mNetWorker != nullptr) && (mNetWorker != current)))
+    {
+        return false;
+    }
+
+    TcpChannelPtr tcpChannel = channel->getTcpChannel();
+
+    if ((tcpChannel == nullptr) || (tcpChannel->getNetWorker() != current))
+    {
+        return false;
+    }
+
+    mNetWorker = current;
+
+    channel->mKeepAlive.mWatched = true;
+    channel->mKeepAlive.mReceived = false;
+    channel->mKeepAlive.mPinging = false;
+
+    schedule(channel, mIntervalTicks);
+    ++mSize;
+
+    if (!mTimer.isRunning())
+    {
+        mTimer.start(mOption.tick, true,
+            [this](Timer*) { onTimer(); });
+    }
+
+    return true;
+}
+
+void WsKeepAlive::schedule(
+    const std::weak_ptr<WsChannel>& channel, size_t ticks)
+{
+    mWheel[(mCursor + ticks) % mWheel.size()].push_back(channel);
+}
+
+void WsKeepAlive::onTimer()
+{
+    mCursor = (mCursor + 1) % mWheel.size();
+
+    std::vector<std::weak_ptr<WsChannel>> due;
+    due.swap(mWheel[mCursor]);
+
+    for (const auto& item : due)
+    {
+        WsChannelPtr channel = item.lock();
+
+        if (channel == nullptr)
+        {
+            --mSize;
+            continue;
+        }
+
+        WsChannel::KeepAliveState& state = channel->mKeepAlive;
+
+        if (channel->isClosed())
+        {
+            state.mWatched = false;
+            --mSize;
+            continue;
+        }
+
+        if (state.mReceived)
+        {
+            // alive, check again after the interval
+            state.mReceived = false;
+            state.mPinging = false;
+
+            schedule(item, mIntervalTicks);
+        }
+        else if (!state.mPinging)
+        {
+            // idle, the pong (or anything) has to come by the timeout
+            if (channel->sendPing() < 0)
+            {
+                state.mWatched = false;
+                --mSize;
+                continue;
+            }
+
+            state.mPinging = true;
+
+            schedule(item, mTimeoutTicks);
+        }
+        else
+        {
+            // no reply
+            state.mWatched = false;
+            --mSize;
+            channel->onKeepAliveTimeout();
+        }
+    }
+
+    // the slot keeps its capacity for the next round
+    if (mWheel[mCursor].empty())
+    {
+        due.clear();
+        mWheel[mCursor].swap(due);
+    }
+
+    if (mSize == 0)
+    {
+        mTimer.cancel();
+    }
+}
+
 SEV_NS_END
 
 #endif // SUBEVENT_WS_INL